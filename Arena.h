@@ -0,0 +1,153 @@
+#pragma once
+#include "Types.h"
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+namespace dry
+{
+  //!\brief Scratch memory for short lived containers.
+  //! Allocations bump a pointer through large blocks and are never freed one by one, reset
+  //! releases everything at once at the end of a frame or an estimate. Blocks are kept for the
+  //! next frame, and when a frame needed several they are merged so later frames use a single
+  //! block. An arena is not thread safe, each thread uses its own, see local.
+  class Arena
+  {
+  public:
+    //!\brief Position to rewind to, see ArenaScope
+    struct Mark
+    {
+      size_t block;
+      size_t offset;
+    };
+
+    explicit Arena(size_t block_size = size_t(1) << 20)
+      : current(0), offset(0), block_size(block_size) {}
+    ~Arena()
+    {
+      for (Block& block : blocks)
+        ::operator delete(block.data);
+    }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    //!\brief Uninitialized memory of the given size, alignment must be a power of two
+    void* allocate(size_t bytes, size_t alignment)
+    {
+      for (;;) {
+        if (current < blocks.size()) {
+          const Block& block = blocks[current];
+          const uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+          const size_t start = ((base + offset + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+          if (start <= block.size && bytes <= block.size - start) {
+            offset = start + bytes;
+            return block.data + start;
+          }
+          // Blocks too small for the request are skipped until the next reset
+          if (current + 1 < blocks.size()) {
+            ++current;
+            offset = 0;
+            continue;
+          }
+        }
+        if (bytes > size_t(-1) - alignment)
+          throw std::bad_alloc();
+        addBlock(std::max(block_size, bytes + alignment));
+        current = blocks.size() - 1;
+        offset = 0;
+      }
+    }
+    //!\brief Uninitialized memory for count elements, aligned for vector loads
+    template <typename T>
+    T* allocate(size_t count)
+    {
+      if (count > size_t(-1) / sizeof(T))
+        throw std::bad_alloc();
+      return static_cast<T*>(allocate(count * sizeof(T), std::max(alignof(T), size_t(64))));
+    }
+
+    //!\brief Release every allocation. Containers using the arena must not be used afterwards.
+    void reset()
+    {
+      // Blocks are only added when the ones before are full, also when a scope rewound past them
+      if (blocks.size() > 1) {
+        const size_t total = getCapacity();
+        for (Block& block : blocks)
+          ::operator delete(block.data);
+        blocks.clear();
+        addBlock(total);
+      }
+      current = 0;
+      offset = 0;
+    }
+
+    Mark getMark() const { return Mark{ current, offset }; }
+    //!\brief Release the allocations made since the mark was taken
+    void rewind(const Mark& mark)
+    {
+      current = mark.block;
+      offset = mark.offset;
+    }
+
+    //!\brief Bytes handed out since the last reset, including alignment and skipped blocks
+    size_t getUsed() const
+    {
+      size_t used = offset;
+      for (size_t i = 0; i < current && i < blocks.size(); ++i)
+        used += blocks[i].size;
+      return used;
+    }
+    //!\brief Bytes held by the blocks
+    size_t getCapacity() const
+    {
+      size_t capacity = 0;
+      for (const Block& block : blocks)
+        capacity += block.size;
+      return capacity;
+    }
+
+    //!\brief Arena of the calling thread. Worker threads of the pool keep theirs between jobs,
+    //! so work done per chunk should be wrapped in an ArenaScope.
+    static Arena& local()
+    {
+      static thread_local Arena arena;
+      return arena;
+    }
+
+  private:
+    struct Block
+    {
+      char* data;
+      size_t size;
+    };
+
+    void addBlock(size_t size)
+    {
+      blocks.reserve(blocks.size() + 1);
+      blocks.push_back(Block{ static_cast<char*>(::operator new(size)), size });
+    }
+
+    std::vector<Block> blocks;
+    size_t current;
+    size_t offset;
+    size_t block_size;
+  };
+
+  //!\brief Rewinds an arena to where it was when the scope was entered, so nested calls such as
+  //! one estimate inside a frame can release their temporaries early
+  class ArenaScope
+  {
+  public:
+    explicit ArenaScope(Arena& arena = Arena::local()) : arena(arena), mark(arena.getMark()) {}
+    ~ArenaScope() { arena.rewind(mark); }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    Arena& getArena() const { return arena; }
+
+  private:
+    Arena& arena;
+    Arena::Mark mark;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,541 @@
+#pragma once
+
+#include "Camera.h"
+#include "FixedSolvers.h"
+#include "MatrixOperations.h"
+#include "Parallel.h"
+#include "VectorOperations.h"
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace dry
+{
+  //!\brief Measurement of a point in a camera, in normalized image coordinates
+  struct Observation
+  {
+    uint32 camera;
+    uint32 point;
+    Vector2d measurement;
+  };
+
+  struct BundleAdjustmentOptions
+  {
+    size_t max_iterations = 50;
+    double function_tolerance = 1e-8;   //!< Stop when the relative decrease of the cost falls below this
+    double lambda = 1e-4;               //!< Initial Levenberg-Marquardt damping
+    size_t max_cg_iterations = 100;
+    double cg_tolerance = 1e-3;         //!< Relative residual at which the reduced camera system counts as solved
+    double huber = 0;                   //!< Huber threshold on the residual norm, 0 for plain least squares
+    size_t fixed_cameras = 1;           //!< The first cameras are held fixed to remove the gauge freedom
+    size_t threads = 0;                 //!< 0 uses every available thread
+  };
+
+  //!\brief Sparse Levenberg-Marquardt bundle adjustment of cameras [R | t] and points.
+  //! Cameras are parameterized by their rotation and position (see getRotation/getPosition) and
+  //! updated as exp([w]x) R and p + dp. The points are eliminated with the Schur complement and the
+  //! reduced camera system is solved with block Jacobi preconditioned conjugate gradients without
+  //! ever being formed. Every pass runs in parallel over the points, with the observations grouped
+  //! by point, and Jacobians are recomputed per pass instead of being stored, so memory stays at a
+  //! few values per camera, point and observation.
+  class BundleAdjuster
+  {
+  public:
+    BundleAdjuster(const BundleAdjustmentOptions& options = BundleAdjustmentOptions())
+      : options(options), initial_cost(0), final_cost(0), iterations(0) {}
+
+    BundleAdjustmentOptions options;
+
+    //!\brief Refine the cameras and points in place. Returns false if the problem is malformed.
+    bool adjust(Matrix3x4d* cameras, size_t camera_count, Vector3d* points, size_t point_count,
+      const Observation* observations, size_t observation_count)
+    {
+      iterations = 0;
+      initial_cost = final_cost = 0;
+      if (camera_count == 0 || point_count == 0 || observation_count == 0)
+        return false;
+      for (size_t k = 0; k < observation_count; ++k)
+        if (observations[k].camera >= camera_count || observations[k].point >= point_count)
+          return false;
+
+      this->observations = observations;
+      this->camera_count = camera_count;
+      this->point_count = point_count;
+      ThreadPool& pool = ThreadPool::global();
+      chunks = std::max(size_t(1), std::min(point_count, options.threads == 0 ? pool.getThreadCount() : options.threads));
+      allocate();
+
+      // Observations grouped by point (counting sort)
+      std::fill(point_offsets.begin(), point_offsets.end(), 0);
+      for (size_t k = 0; k < observation_count; ++k)
+        ++point_offsets[observations[k].point + 1];
+      for (size_t j = 0; j < point_count; ++j)
+        point_offsets[j + 1] += point_offsets[j];
+      order.resize(observation_count);
+      std::vector<uint32> fill(point_offsets.begin(), point_offsets.end() - 1);
+      for (size_t k = 0; k < observation_count; ++k)
+        order[fill[observations[k].point]++] = uint32(k);
+
+      for (size_t i = 0; i < camera_count; ++i) {
+        rotations[i] = Matrix3d(
+          cameras[i].a00, cameras[i].a01, cameras[i].a02,
+          cameras[i].a10, cameras[i].a11, cameras[i].a12,
+          cameras[i].a20, cameras[i].a21, cameras[i].a22);
+        positions[i] = getPosition(cameras[i]);
+      }
+      std::copy(points, points + point_count, this->points.begin());
+
+      double cost = linearize();
+      initial_cost = cost;
+      double lambda = options.lambda;
+      while (iterations < options.max_iterations && lambda < 1e10 && cost > 0) {
+        ++iterations;
+        if (!solveStep(lambda)) {
+          lambda *= 10;
+          continue;
+        }
+
+        for (size_t i = 0; i < camera_count; ++i) {
+          const double* d = &delta_cameras[6 * i];
+          candidate_rotations[i] = getRotationRodrigues(Vector3d(d[0], d[1], d[2])) * rotations[i];
+          candidate_positions[i] = positions[i] + Vector3d(d[3], d[4], d[5]);
+        }
+        parallelFor(point_count, chunks, [&](size_t begin, size_t end, size_t) {
+          for (size_t j = begin; j < end; ++j)
+            candidate_points[j] = this->points[j] + delta_points[j];
+        });
+        const double candidate_cost = evaluate(candidate_rotations, candidate_positions, candidate_points);
+        if (!(candidate_cost < cost)) {
+          lambda *= 10;
+          continue;
+        }
+
+        const double decrease = (cost - candidate_cost) / cost;
+        rotations.swap(candidate_rotations);
+        positions.swap(candidate_positions);
+        this->points.swap(candidate_points);
+        lambda = std::max(lambda * 0.1, 1e-12);
+        if (decrease < options.function_tolerance) {
+          cost = candidate_cost;
+          break;
+        }
+        cost = linearize();
+      }
+      final_cost = cost;
+
+      for (size_t i = 0; i < camera_count; ++i)
+        cameras[i] = getCameraMatrix(transpose(rotations[i]), positions[i]);
+      std::copy(this->points.begin(), this->points.begin() + point_count, points);
+      return true;
+    }
+
+    //!\brief Sum of squared (Huber weighted) residuals before and after the last adjustment
+    double getInitialCost() const { return initial_cost; }
+    double getFinalCost() const { return final_cost; }
+    size_t getIterationCount() const { return iterations; }
+
+  private:
+    struct Linearization
+    {
+      double r[2];
+      double Jc[2][6];
+      double Jp[2][3];
+      double cost;
+    };
+
+    bool isFixed(size_t camera) const { return camera < options.fixed_cameras; }
+
+    //!\brief Residual and Jacobians of one observation, scaled by the square root of the Huber weight
+    void linearize(const Observation& o, const Matrix3d& R, const Vector3d& p, const Vector3d& X, bool jacobians, Linearization& l) const
+    {
+      const Vector3d Xc = R * (X - p);
+      if (!(Xc.z > 1e-12)) {
+        // Behind the camera, the observation does not take part
+        l = Linearization();
+        return;
+      }
+      const double iz = 1.0 / Xc.z;
+      const double u = Xc.x * iz, v = Xc.y * iz;
+      l.r[0] = u - o.measurement.x;
+      l.r[1] = v - o.measurement.y;
+      const double e2 = l.r[0] * l.r[0] + l.r[1] * l.r[1];
+      double w = 1.0;
+      l.cost = e2;
+      if (options.huber > 0 && e2 > options.huber * options.huber) {
+        const double e = std::sqrt(e2);
+        w = std::sqrt(options.huber / e);
+        l.cost = 2 * options.huber * e - options.huber * options.huber;
+        l.r[0] *= w;
+        l.r[1] *= w;
+      }
+      if (!jacobians)
+        return;
+
+      // Projection derivative A = d(u, v)/dXc, then dXc/dw = -[Xc]x, dXc/dp = -R and dXc/dX = R
+      const double A[2][3] = { { w * iz, 0, -w * u * iz }, { 0, w * iz, -w * v * iz } };
+      for (size_t k = 0; k < 2; ++k) {
+        l.Jc[k][0] = -A[k][1] * Xc.z + A[k][2] * Xc.y;
+        l.Jc[k][1] = A[k][0] * Xc.z - A[k][2] * Xc.x;
+        l.Jc[k][2] = -A[k][0] * Xc.y + A[k][1] * Xc.x;
+        for (size_t c = 0; c < 3; ++c) {
+          l.Jp[k][c] = A[k][0] * R(0, c) + A[k][1] * R(1, c) + A[k][2] * R(2, c);
+          l.Jc[k][3 + c] = -l.Jp[k][c];
+        }
+      }
+      if (isFixed(o.camera))
+        for (size_t k = 0; k < 2; ++k)
+          for (size_t c = 0; c < 6; ++c)
+            l.Jc[k][c] = 0;
+    }
+    void linearize(const Observation& o, Linearization& l) const
+    {
+      linearize(o, rotations[o.camera], positions[o.camera], points[o.point], true, l);
+    }
+
+    void allocate()
+    {
+      const size_t per_camera = 42;
+      rotations.resize(camera_count);
+      positions.resize(camera_count);
+      candidate_rotations.resize(camera_count);
+      candidate_positions.resize(camera_count);
+      U.resize(36 * camera_count);
+      gc.resize(6 * camera_count);
+      preconditioner.resize(36 * camera_count);
+      rhs.resize(6 * camera_count);
+      delta_cameras.resize(6 * camera_count);
+      cg_r.resize(6 * camera_count);
+      cg_z.resize(6 * camera_count);
+      cg_p.resize(6 * camera_count);
+      cg_q.resize(6 * camera_count);
+      scratch.resize(chunks * per_camera * camera_count);
+      chunk_cost.resize(chunks);
+
+      points.resize(point_count);
+      candidate_points.resize(point_count);
+      V.resize(point_count);
+      Vinv.resize(point_count);
+      gp.resize(point_count);
+      delta_points.resize(point_count);
+      point_offsets.resize(point_count + 1);
+    }
+
+    //!\brief Sum the per chunk camera buffers of the given width into the first chunk
+    void reduceCameras(size_t width)
+    {
+      if (chunks == 1)
+        return;
+      parallelFor(camera_count, chunks, [&](size_t begin, size_t end, size_t) {
+        for (size_t chunk = 1; chunk < chunks; ++chunk) {
+          const double* src = &scratch[chunk * width * camera_count];
+          for (size_t k = begin * width; k < end * width; ++k)
+            scratch[k] += src[k];
+        }
+      });
+    }
+
+    //!\brief Cost, camera blocks U and gradients gc, point blocks V and gradients gp at the current estimate
+    double linearize()
+    {
+      const size_t width = 42;
+      parallelFor(point_count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+        double* buffer = &scratch[chunk * width * camera_count];
+        std::fill(buffer, buffer + width * camera_count, 0.0);
+        double cost = 0;
+        Linearization l;
+        for (size_t j = begin; j < end; ++j) {
+          Matrix3d& Vj = V[j];
+          Vj = Matrix3d(0, 0, 0, 0, 0, 0, 0, 0, 0);
+          Vector3d g(0, 0, 0);
+          for (size_t k = point_offsets[j]; k < point_offsets[j + 1]; ++k) {
+            const Observation& o = observations[order[k]];
+            linearize(o, l);
+            cost += l.cost;
+            for (size_t a = 0; a < 3; ++a) {
+              for (size_t b = 0; b < 3; ++b)
+                Vj(a, b) += l.Jp[0][a] * l.Jp[0][b] + l.Jp[1][a] * l.Jp[1][b];
+              g[a] += l.Jp[0][a] * l.r[0] + l.Jp[1][a] * l.r[1];
+            }
+            if (isFixed(o.camera))
+              continue;
+            double* Ui = buffer + width * o.camera;
+            for (size_t a = 0; a < 6; ++a) {
+              for (size_t b = a; b < 6; ++b)
+                Ui[6 * a + b] += l.Jc[0][a] * l.Jc[0][b] + l.Jc[1][a] * l.Jc[1][b];
+              Ui[36 + a] += l.Jc[0][a] * l.r[0] + l.Jc[1][a] * l.r[1];
+            }
+          }
+          gp[j] = g;
+        }
+        chunk_cost[chunk] = cost;
+      });
+      reduceCameras(width);
+
+      for (size_t i = 0; i < camera_count; ++i) {
+        const double* src = &scratch[width * i];
+        for (size_t a = 0; a < 6; ++a) {
+          for (size_t b = 0; b < 6; ++b)
+            U[36 * i + 6 * a + b] = a <= b ? src[6 * a + b] : src[6 * b + a];
+          gc[6 * i + a] = src[36 + a];
+        }
+      }
+      double cost = 0;
+      for (size_t chunk = 0; chunk < chunks; ++chunk)
+        cost += chunk_cost[chunk];
+      return cost;
+    }
+
+    double evaluate(const std::vector<Matrix3d>& R, const std::vector<Vector3d>& p, const std::vector<Vector3d>& X)
+    {
+      parallelFor(point_count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+        double cost = 0;
+        Linearization l;
+        for (size_t j = begin; j < end; ++j) {
+          for (size_t k = point_offsets[j]; k < point_offsets[j + 1]; ++k) {
+            const Observation& o = observations[order[k]];
+            linearize(o, R[o.camera], p[o.camera], X[j], false, l);
+            cost += l.cost;
+          }
+        }
+        chunk_cost[chunk] = cost;
+      });
+      double cost = 0;
+      for (size_t chunk = 0; chunk < chunks; ++chunk)
+        cost += chunk_cost[chunk];
+      return cost;
+    }
+
+    double getDampedDiagonal(double value, double lambda) const { return value + lambda * std::max(value, 1e-12); }
+
+    //!\brief out = S x with S = U - W V^-1 W^T the damped reduced camera matrix
+    void multiplyReduced(const std::vector<double>& x, std::vector<double>& out, double lambda)
+    {
+      const size_t width = 6;
+      parallelFor(point_count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+        double* buffer = &scratch[chunk * width * camera_count];
+        std::fill(buffer, buffer + width * camera_count, 0.0);
+        // The linearizations of the first observations of a point are kept for the second half
+        Linearization cache[32], single;
+        for (size_t j = begin; j < end; ++j) {
+          // y = sum W^T x = sum Jp^T (Jc x), z = V^-1 y, out -= W z = Jc^T (Jp z)
+          Vector3d y(0, 0, 0);
+          for (size_t k = point_offsets[j]; k < point_offsets[j + 1]; ++k) {
+            const Observation& o = observations[order[k]];
+            if (isFixed(o.camera))
+              continue;
+            Linearization& l = k - point_offsets[j] < 32 ? cache[k - point_offsets[j]] : single;
+            linearize(o, l);
+            const double* xi = &x[6 * o.camera];
+            for (size_t r = 0; r < 2; ++r) {
+              double jx = 0;
+              for (size_t c = 0; c < 6; ++c)
+                jx += l.Jc[r][c] * xi[c];
+              for (size_t c = 0; c < 3; ++c)
+                y[c] += l.Jp[r][c] * jx;
+            }
+          }
+          const Vector3d z = Vinv[j] * y;
+          for (size_t k = point_offsets[j]; k < point_offsets[j + 1]; ++k) {
+            const Observation& o = observations[order[k]];
+            if (isFixed(o.camera))
+              continue;
+            const bool cached = k - point_offsets[j] < 32;
+            Linearization& l = cached ? cache[k - point_offsets[j]] : single;
+            if (!cached)
+              linearize(o, l);
+            double* bi = buffer + width * o.camera;
+            for (size_t r = 0; r < 2; ++r) {
+              const double jz = l.Jp[r][0] * z.x + l.Jp[r][1] * z.y + l.Jp[r][2] * z.z;
+              for (size_t c = 0; c < 6; ++c)
+                bi[c] -= l.Jc[r][c] * jz;
+            }
+          }
+        }
+      });
+      reduceCameras(width);
+
+      for (size_t i = 0; i < camera_count; ++i) {
+        double* o = &out[6 * i];
+        if (isFixed(i)) {
+          std::fill(o, o + 6, 0.0);
+          continue;
+        }
+        const double* Ui = &U[36 * i];
+        const double* xi = &x[6 * i];
+        for (size_t a = 0; a < 6; ++a) {
+          double sum = scratch[6 * i + a] + (getDampedDiagonal(Ui[7 * a], lambda) - Ui[7 * a]) * xi[a];
+          for (size_t b = 0; b < 6; ++b)
+            sum += Ui[6 * a + b] * xi[b];
+          o[a] = sum;
+        }
+      }
+    }
+
+    void applyPreconditioner(const std::vector<double>& r, std::vector<double>& z) const
+    {
+      for (size_t i = 0; i < camera_count; ++i)
+        for (size_t a = 0; a < 6; ++a) {
+          double sum = 0;
+          for (size_t b = 0; b < 6; ++b)
+            sum += preconditioner[36 * i + 6 * a + b] * r[6 * i + b];
+          z[6 * i + a] = sum;
+        }
+    }
+
+    static double dotProduct(const std::vector<double>& a, const std::vector<double>& b)
+    {
+      double sum = 0;
+      for (size_t i = 0; i < a.size(); ++i)
+        sum += a[i] * b[i];
+      return sum;
+    }
+
+    //!\brief Damped Gauss-Newton step into delta_cameras and delta_points
+    bool solveStep(double lambda)
+    {
+      // Damped point blocks, and the reduced right hand side and block diagonal of S
+      const size_t width = 42;
+      std::atomic<bool> valid(true);
+      parallelFor(point_count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+        double* buffer = &scratch[chunk * width * camera_count];
+        std::fill(buffer, buffer + width * camera_count, 0.0);
+        Linearization l;
+        for (size_t j = begin; j < end; ++j) {
+          Matrix3d Vd = V[j];
+          for (size_t a = 0; a < 3; ++a)
+            Vd(a, a) = getDampedDiagonal(Vd(a, a), lambda);
+          const double d = det(Vd);
+          if (!(d > 0)) {
+            valid = false;
+            continue;
+          }
+          Vinv[j] = inverse(Vd);
+          const Vector3d e = Vinv[j] * gp[j];
+
+          for (size_t k = point_offsets[j]; k < point_offsets[j + 1]; ++k) {
+            const Observation& o = observations[order[k]];
+            if (isFixed(o.camera))
+              continue;
+            linearize(o, l);
+            // W = Jc^T Jp (6x3) and W V^-1
+            double W[6][3], WV[6][3];
+            for (size_t a = 0; a < 6; ++a)
+              for (size_t b = 0; b < 3; ++b)
+                W[a][b] = l.Jc[0][a] * l.Jp[0][b] + l.Jc[1][a] * l.Jp[1][b];
+            for (size_t a = 0; a < 6; ++a)
+              for (size_t b = 0; b < 3; ++b)
+                WV[a][b] = W[a][0] * Vinv[j](0, b) + W[a][1] * Vinv[j](1, b) + W[a][2] * Vinv[j](2, b);
+            double* Si = buffer + width * o.camera;
+            for (size_t a = 0; a < 6; ++a) {
+              for (size_t b = a; b < 6; ++b)
+                Si[6 * a + b] -= WV[a][0] * W[b][0] + WV[a][1] * W[b][1] + WV[a][2] * W[b][2];
+              Si[36 + a] += W[a][0] * e.x + W[a][1] * e.y + W[a][2] * e.z;
+            }
+          }
+        }
+      });
+      if (!valid)
+        return false;
+      reduceCameras(width);
+
+      for (size_t i = 0; i < camera_count; ++i) {
+        double* P = &preconditioner[36 * i];
+        if (isFixed(i)) {
+          std::fill(P, P + 36, 0.0);
+          std::fill(&rhs[6 * i], &rhs[6 * i] + 6, 0.0);
+          continue;
+        }
+        const double* src = &scratch[width * i];
+        MatrixN<double, 6> S;
+        for (size_t a = 0; a < 6; ++a) {
+          for (size_t b = a; b < 6; ++b)
+            S(a, b) = U[36 * i + 6 * a + b] + src[6 * a + b];
+          S(a, a) += getDampedDiagonal(U[36 * i + 7 * a], lambda) - U[36 * i + 7 * a];
+          rhs[6 * i + a] = -gc[6 * i + a] + src[36 + a];
+        }
+        for (size_t b = 0; b < 6; ++b) {
+          VectorN<double, 6> unit, column;
+          unit.Set(0.0);
+          unit[b] = 1;
+          if (!choleskySolve(S, unit, column))
+            return false;
+          for (size_t a = 0; a < 6; ++a)
+            P[6 * a + b] = column[a];
+        }
+      }
+
+      // Preconditioned conjugate gradients on S x = rhs
+      std::fill(delta_cameras.begin(), delta_cameras.end(), 0.0);
+      cg_r = rhs;
+      applyPreconditioner(cg_r, cg_z);
+      cg_p = cg_z;
+      double rz = dotProduct(cg_r, cg_z);
+      const double target = options.cg_tolerance * std::sqrt(dotProduct(rhs, rhs));
+      for (size_t iteration = 0; iteration < options.max_cg_iterations && rz > 0; ++iteration) {
+        multiplyReduced(cg_p, cg_q, lambda);
+        const double pq = dotProduct(cg_p, cg_q);
+        if (!(pq > 0))
+          break;
+        const double alpha = rz / pq;
+        for (size_t k = 0; k < delta_cameras.size(); ++k) {
+          delta_cameras[k] += alpha * cg_p[k];
+          cg_r[k] -= alpha * cg_q[k];
+        }
+        if (std::sqrt(dotProduct(cg_r, cg_r)) <= target)
+          break;
+        applyPreconditioner(cg_r, cg_z);
+        const double rz_next = dotProduct(cg_r, cg_z);
+        const double beta = rz_next / rz;
+        rz = rz_next;
+        for (size_t k = 0; k < cg_p.size(); ++k)
+          cg_p[k] = cg_z[k] + beta * cg_p[k];
+      }
+
+      // Back substitution dp = V^-1 (-gp - W^T dc)
+      parallelFor(point_count, chunks, [&](size_t begin, size_t end, size_t) {
+        Linearization l;
+        for (size_t j = begin; j < end; ++j) {
+          Vector3d y = gp[j] * -1.0;
+          for (size_t k = point_offsets[j]; k < point_offsets[j + 1]; ++k) {
+            const Observation& o = observations[order[k]];
+            if (isFixed(o.camera))
+              continue;
+            linearize(o, l);
+            const double* dc = &delta_cameras[6 * o.camera];
+            for (size_t r = 0; r < 2; ++r) {
+              double jx = 0;
+              for (size_t c = 0; c < 6; ++c)
+                jx += l.Jc[r][c] * dc[c];
+              for (size_t c = 0; c < 3; ++c)
+                y[c] -= l.Jp[r][c] * jx;
+            }
+          }
+          delta_points[j] = Vinv[j] * y;
+        }
+      });
+      return true;
+    }
+
+    const Observation* observations;
+    size_t camera_count;
+    size_t point_count;
+    size_t chunks;
+
+    std::vector<Matrix3d> rotations, candidate_rotations;
+    std::vector<Vector3d> positions, candidate_positions;
+    std::vector<double> U, gc, preconditioner, rhs, delta_cameras;
+    std::vector<double> cg_r, cg_z, cg_p, cg_q;
+    std::vector<double> scratch, chunk_cost;
+
+    std::vector<Vector3d> points, candidate_points;
+    std::vector<Matrix3d> V, Vinv;
+    std::vector<Vector3d> gp, delta_points;
+    std::vector<uint32> point_offsets, order;
+
+    double initial_cost;
+    double final_cost;
+    size_t iterations;
+  };
+}
\ No newline at end of file
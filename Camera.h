@@ -29,4 +29,18 @@ namespace dry
       R.a01, R.a11, R.a21, -R.a01*t.x - R.a11*t.y - R.a21*t.z,
       R.a02, R.a12, R.a22, -R.a02*t.x - R.a12*t.y - R.a22*t.z);
   }
+
+  //!\brief Camera A applied after the rigid transform B, A * [B; 0 0 0 1].
+  //! Places a camera with a fixed offset A relative to a body at pose B.
+  template <typename T>
+  Matrix3x4<T> compose(const Matrix3x4<T>& A, const Matrix3x4<T>& B)
+  {
+    return Matrix3x4<T>(
+      A.a00*B.a00 + A.a01*B.a10 + A.a02*B.a20, A.a00*B.a01 + A.a01*B.a11 + A.a02*B.a21,
+      A.a00*B.a02 + A.a01*B.a12 + A.a02*B.a22, A.a00*B.a03 + A.a01*B.a13 + A.a02*B.a23 + A.a03,
+      A.a10*B.a00 + A.a11*B.a10 + A.a12*B.a20, A.a10*B.a01 + A.a11*B.a11 + A.a12*B.a21,
+      A.a10*B.a02 + A.a11*B.a12 + A.a12*B.a22, A.a10*B.a03 + A.a11*B.a13 + A.a12*B.a23 + A.a13,
+      A.a20*B.a00 + A.a21*B.a10 + A.a22*B.a20, A.a20*B.a01 + A.a21*B.a11 + A.a22*B.a21,
+      A.a20*B.a02 + A.a21*B.a12 + A.a22*B.a22, A.a20*B.a03 + A.a21*B.a13 + A.a22*B.a23 + A.a23);
+  }
 }
\ No newline at end of file
@@ -0,0 +1,512 @@
+#pragma once
+
+#include "Gemm.h"
+#include "Matrix.h"
+#include "Parallel.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+namespace dry
+{
+  //!\brief Scratch memory of the dense decompositions. The buffers only grow, so once a workspace
+  //! has seen the largest problem the decompositions using it no longer allocate.
+  template <typename T>
+  struct DenseWorkspace
+  {
+    DenseWorkspace() {}
+    //!\brief Buffers in an arena, for a workspace that lives for one frame
+    explicit DenseWorkspace(Arena& arena)
+      : matrix(arena), rotated(arena), vector(arena), tau(arena), reflectors(arena), factor(arena), product(arena) {}
+
+    MatrixX<T> matrix;      //!< Factorized copy of the input
+    MatrixX<T> rotated;     //!< Rows orthogonalized by the Jacobi SVD
+    VectorX<T> vector;      //!< Transformed right hand side
+    VectorX<T> tau;         //!< Householder scalars of a QR inside another decomposition
+    VectorX<T> reflectors;  //!< Explicit Householder vectors of a block
+    VectorX<T> factor;      //!< Triangular factor of a block reflector
+    VectorX<T> product;     //!< Block reflector times the rows it is applied to
+  };
+
+  //!\brief In place Cholesky decomposition A = R^T R of a symmetric positive definite n x n matrix.
+  //! Only the upper triangle is read and it receives R, the strictly lower triangle is unspecified
+  //! afterwards. Rows are factorized in blocks whose trailing update is a syrk, so large matrices
+  //! run at matrix product speed. Returns false if A is not positive definite.
+  template <typename T>
+  inline bool choleskyDecompose(MatrixX<T>& A, const GemmOptions& options = GemmOptions())
+  {
+    const size_t n = A.rows;
+    const size_t block = 64;
+    for (size_t k0 = 0; k0 < n; k0 += block) {
+      const size_t k1 = std::min(n, k0 + block);
+      // Rows of the block including their part right of it, the rows of R are contiguous
+      for (size_t j = k0; j < k1; ++j) {
+        T* rj = &A(j, 0);
+        if (!(rj[j] > T(0)))
+          return false;
+        const T d = std::sqrt(rj[j]);
+        const T scale = T(1) / d;
+        rj[j] = d;
+        for (size_t c = j + 1; c < n; ++c)
+          rj[c] *= scale;
+        for (size_t i = j + 1; i < k1; ++i) {
+          T* ri = &A(i, 0);
+          const T f = rj[i];
+          for (size_t c = i; c < n; ++c)
+            ri[c] -= f * rj[c];
+        }
+      }
+      if (k1 < n)
+        syrk(true, n - k1, k1 - k0, T(-1), &A(k0, k1), A.cols, T(1), &A(k1, k1), A.cols, options);
+    }
+    return true;
+  }
+
+  //!\brief Solve A x = b in place given the factor R of choleskyDecompose, b receives x
+  template <typename T>
+  inline void choleskySubstitute(const MatrixX<T>& R, VectorX<T>& b)
+  {
+    const size_t n = R.rows;
+    // R^T y = b, each solved element is removed along a contiguous row of R
+    for (size_t i = 0; i < n; ++i) {
+      const T* r = &R(i, 0);
+      const T y = b[i] / r[i];
+      b[i] = y;
+      for (size_t j = i + 1; j < n; ++j)
+        b[j] -= y * r[j];
+    }
+    // R x = y
+    for (size_t i = n; i-- > 0;) {
+      const T* r = &R(i, 0);
+      T sum = b[i];
+      for (size_t j = i + 1; j < n; ++j)
+        sum -= r[j] * b[j];
+      b[i] = sum / r[i];
+    }
+  }
+
+  //!\brief Solve A x = b for a symmetric positive definite A, the factor is formed in the workspace.
+  //! Only the upper triangle of A is read. Returns false if A is not positive definite.
+  template <typename T>
+  inline bool choleskySolve(const MatrixX<T>& A, const VectorX<T>& b, VectorX<T>& x, DenseWorkspace<T>& workspace,
+    const GemmOptions& options = GemmOptions())
+  {
+    workspace.matrix = A;
+    if (!choleskyDecompose(workspace.matrix, options))
+      return false;
+    x = b;
+    choleskySubstitute(workspace.matrix, x);
+    return true;
+  }
+  template <typename T>
+  inline bool choleskySolve(const MatrixX<T>& A, const VectorX<T>& b, VectorX<T>& x)
+  {
+    DenseWorkspace<T> workspace;
+    return choleskySolve(A, b, x, workspace);
+  }
+
+  //!\brief Householder reflection of count elements x[0], x[stride], ... in place: x[0] receives
+  //! beta and the rest the vector v with an implicit leading one, such that
+  //! (I - tau v v^T) x = beta e0. Returns tau, zero when there is nothing to annihilate.
+  template <typename T>
+  inline T makeHouseholder(T* x, size_t stride, size_t count)
+  {
+    T sigma(0);
+    for (size_t i = 1; i < count; ++i)
+      sigma += x[i*stride] * x[i*stride];
+    if (sigma == T(0))
+      return T(0);
+    const T alpha = x[0];
+    const T norm = std::sqrt(alpha * alpha + sigma);
+    const T beta = alpha > T(0) ? -norm : norm;
+    const T scale = T(1) / (alpha - beta);
+    for (size_t i = 1; i < count; ++i)
+      x[i*stride] *= scale;
+    x[0] = beta;
+    return (beta - alpha) / beta;
+  }
+
+  //!\brief Explicit Householder vectors V and upper triangular T of the block reflector
+  //! H(k0) ... H(k1 - 1) = I - V T V^T of a QR factorization, stored in the workspace
+  template <typename T>
+  inline void getBlockReflector(const MatrixX<T>& QR, const VectorX<T>& tau, size_t k0, size_t k1,
+    DenseWorkspace<T>& workspace, const GemmOptions& options)
+  {
+    const size_t rows = QR.rows - k0, width = k1 - k0;
+    workspace.reflectors.resize(rows * width);
+    workspace.factor.resize(2 * width * width);
+    T* V = workspace.reflectors.v;
+    for (size_t i = 0; i < rows; ++i)
+      for (size_t p = 0; p < width; ++p)
+        V[i*width + p] = i < p ? T(0) : i == p ? T(1) : QR(k0 + i, k0 + p);
+
+    // Columns of T follow from the inner products of the Householder vectors
+    T* F = workspace.factor.v;
+    T* G = F + width * width;
+    gemm(true, false, width, width, rows, T(1), V, width, V, width, T(0), G, width, options);
+    for (size_t i = 0; i < width; ++i) {
+      const T t = tau[k0 + i];
+      for (size_t j = 0; j < i; ++j) {
+        T sum(0);
+        for (size_t p = j; p < i; ++p)
+          sum += F[j*width + p] * G[p*width + i];
+        F[j*width + i] = -t * sum;
+      }
+      F[i*width + i] = t;
+      for (size_t j = i + 1; j < width; ++j)
+        F[j*width + i] = T(0);
+    }
+  }
+
+  //!\brief X = (I - V T V^T) X, or with T^T when transposed, for the block reflector in the
+  //! workspace and the rows x cols array X with row stride ldx
+  template <typename T>
+  inline void applyBlockReflector(bool transpose, size_t rows, size_t width, T* X, size_t ldx, size_t cols,
+    DenseWorkspace<T>& workspace, const GemmOptions& options)
+  {
+    const T* V = workspace.reflectors.v;
+    const T* F = workspace.factor.v;
+    workspace.product.resize(width * cols);
+    T* W = workspace.product.v;
+    gemm(true, false, width, cols, rows, T(1), V, width, X, ldx, T(0), W, cols, options);
+
+    // W = op(T) W in place, rows are replaced in the order that keeps the ones still needed
+    if (transpose) {
+      for (size_t i = width; i-- > 0;) {
+        T* w = W + i*cols;
+        const T d = F[i*width + i];
+        for (size_t c = 0; c < cols; ++c)
+          w[c] *= d;
+        for (size_t p = 0; p < i; ++p) {
+          const T f = F[p*width + i];
+          const T* wp = W + p*cols;
+          for (size_t c = 0; c < cols; ++c)
+            w[c] += f * wp[c];
+        }
+      }
+    }
+    else {
+      for (size_t i = 0; i < width; ++i) {
+        T* w = W + i*cols;
+        const T d = F[i*width + i];
+        for (size_t c = 0; c < cols; ++c)
+          w[c] *= d;
+        for (size_t p = i + 1; p < width; ++p) {
+          const T f = F[i*width + p];
+          const T* wp = W + p*cols;
+          for (size_t c = 0; c < cols; ++c)
+            w[c] += f * wp[c];
+        }
+      }
+    }
+    gemm(false, false, rows, cols, width, T(-1), V, width, W, cols, T(1), X, ldx, options);
+  }
+
+  //!\brief In place QR decomposition A = Q R of an m x n matrix by Householder reflections.
+  //! As in LAPACK, R is left in the upper triangle and the Householder vectors below it, tau
+  //! receives their min(m, n) scalars. Panels of columns are factorized one column at a time,
+  //! the rest of the matrix is updated per panel with a block reflector built from products.
+  template <typename T>
+  inline void qrDecompose(MatrixX<T>& A, VectorX<T>& tau, DenseWorkspace<T>& workspace,
+    const GemmOptions& options = GemmOptions())
+  {
+    const size_t m = A.rows, n = A.cols;
+    const size_t count = std::min(m, n);
+    const size_t block = 32;
+    tau.resize(count);
+    for (size_t k0 = 0; k0 < count; k0 += block) {
+      const size_t k1 = std::min(count, k0 + block);
+      for (size_t k = k0; k < k1; ++k) {
+        tau[k] = makeHouseholder(&A(k, k), n, m - k);
+        if (tau[k] == T(0))
+          continue;
+        // Remaining columns of the panel, w = tau v^T A accumulated along contiguous rows
+        const size_t width = k1 - k - 1;
+        T w[block];
+        for (size_t c = 0; c < width; ++c)
+          w[c] = A(k, k + 1 + c);
+        for (size_t i = k + 1; i < m; ++i) {
+          const T vi = A(i, k);
+          const T* row = &A(i, k + 1);
+          for (size_t c = 0; c < width; ++c)
+            w[c] += vi * row[c];
+        }
+        for (size_t c = 0; c < width; ++c) {
+          w[c] *= tau[k];
+          A(k, k + 1 + c) -= w[c];
+        }
+        for (size_t i = k + 1; i < m; ++i) {
+          const T vi = A(i, k);
+          T* row = &A(i, k + 1);
+          for (size_t c = 0; c < width; ++c)
+            row[c] -= vi * w[c];
+        }
+      }
+      if (k1 < n) {
+        getBlockReflector(A, tau, k0, k1, workspace, options);
+        applyBlockReflector(true, m - k0, k1 - k0, &A(k0, k1), n, n - k1, workspace, options);
+      }
+    }
+  }
+  template <typename T>
+  inline void qrDecompose(MatrixX<T>& A, VectorX<T>& tau)
+  {
+    DenseWorkspace<T> workspace;
+    qrDecompose(A, tau, workspace);
+  }
+
+  //!\brief x = Q x, or Q^T x when transposed, for Q given by qrDecompose
+  template <typename T>
+  inline void qrMultiply(const MatrixX<T>& QR, const VectorX<T>& tau, VectorX<T>& x, bool transpose)
+  {
+    const size_t m = QR.rows;
+    for (size_t j = 0; j < tau.size; ++j) {
+      const size_t k = transpose ? j : tau.size - 1 - j;
+      if (tau[k] == T(0))
+        continue;
+      T w = x[k];
+      for (size_t i = k + 1; i < m; ++i)
+        w += QR(i, k) * x[i];
+      w *= tau[k];
+      x[k] -= w;
+      for (size_t i = k + 1; i < m; ++i)
+        x[i] -= QR(i, k) * w;
+    }
+  }
+
+  //!\brief X = Q X, or Q^T X when transposed, for Q given by qrDecompose, applied one block
+  //! reflector at a time
+  template <typename T>
+  inline void qrMultiply(const MatrixX<T>& QR, const VectorX<T>& tau, MatrixX<T>& X, bool transpose,
+    DenseWorkspace<T>& workspace, const GemmOptions& options = GemmOptions())
+  {
+    const size_t block = 32;
+    const size_t blocks = (tau.size + block - 1) / block;
+    for (size_t b = 0; b < blocks; ++b) {
+      const size_t k0 = (transpose ? b : blocks - 1 - b) * block;
+      const size_t k1 = std::min(tau.size, k0 + block);
+      getBlockReflector(QR, tau, k0, k1, workspace, options);
+      applyBlockReflector(transpose, QR.rows - k0, k1 - k0, &X(k0, 0), X.cols, X.cols, workspace, options);
+    }
+  }
+
+  //!\brief Least squares solution of the overdetermined system A x = b (rows >= cols) by a blocked
+  //! Householder QR formed in the workspace. Returns false if A is rank deficient, has fewer rows
+  //! than columns or b does not have one element per row.
+  template <typename T>
+  inline bool leastSquares(const MatrixX<T>& A, const VectorX<T>& b, VectorX<T>& x, DenseWorkspace<T>& workspace,
+    const GemmOptions& options = GemmOptions())
+  {
+    const size_t n = A.cols;
+    if (A.rows < n || b.size != A.rows)
+      return false;
+    workspace.matrix = A;
+    qrDecompose(workspace.matrix, workspace.tau, workspace, options);
+    workspace.vector = b;
+    qrMultiply(workspace.matrix, workspace.tau, workspace.vector, true);
+
+    // Back substitution with R
+    const MatrixX<T>& R = workspace.matrix;
+    x.resize(n);
+    for (size_t i = n; i-- > 0;) {
+      const T* r = &R(i, 0);
+      if (std::abs(r[i]) <= std::numeric_limits<T>::epsilon() * std::abs(R(0, 0)))
+        return false;
+      T sum = workspace.vector[i];
+      for (size_t j = i + 1; j < n; ++j)
+        sum -= r[j] * x[j];
+      x[i] = sum / r[i];
+    }
+    return true;
+  }
+  template <typename T>
+  inline bool leastSquares(const MatrixX<T>& A, const VectorX<T>& b, VectorX<T>& x)
+  {
+    DenseWorkspace<T> workspace;
+    return leastSquares(A, b, x, workspace);
+  }
+
+  //!\brief Rotate rows p and q of the count x length array X so that they become orthogonal, and
+  //! the rows of J (if given) along with them. Returns false if they already are.
+  template <typename T>
+  inline bool orthogonalizeRows(T* X, size_t length, T* J, size_t width, size_t p, size_t q)
+  {
+    T* xp = X + p*length;
+    T* xq = X + q*length;
+    // Independent partial sums vectorize without reassociating the additions of one lane
+    const size_t lanes = 8;
+    T alphas[lanes] = {}, betas[lanes] = {}, gammas[lanes] = {};
+    size_t i = 0;
+    for (; i + lanes <= length; i += lanes)
+      for (size_t k = 0; k < lanes; ++k) {
+        alphas[k] += xp[i + k] * xp[i + k];
+        betas[k] += xq[i + k] * xq[i + k];
+        gammas[k] += xp[i + k] * xq[i + k];
+      }
+    T alpha(0), beta(0), gamma(0);
+    for (; i < length; ++i) {
+      alpha += xp[i] * xp[i];
+      beta += xq[i] * xq[i];
+      gamma += xp[i] * xq[i];
+    }
+    for (size_t k = 0; k < lanes; ++k) {
+      alpha += alphas[k];
+      beta += betas[k];
+      gamma += gammas[k];
+    }
+    if (!(std::abs(gamma) > std::numeric_limits<T>::epsilon() * std::sqrt(alpha * beta)))
+      return false;
+
+    const T zeta = (beta - alpha) / (2 * gamma);
+    const T t = std::abs(zeta) > T(1e150) ? T(0.5) / zeta :
+      (zeta >= 0 ? T(1) : T(-1)) / (std::abs(zeta) + std::sqrt(zeta * zeta + 1));
+    const T c = T(1) / std::sqrt(t * t + 1);
+    const T s = c * t;
+    for (i = 0; i < length; ++i) {
+      const T a = xp[i], b = xq[i];
+      xp[i] = c * a - s * b;
+      xq[i] = s * a + c * b;
+    }
+    if (J) {
+      T* jp = J + p*width;
+      T* jq = J + q*width;
+      for (i = 0; i < width; ++i) {
+        const T a = jp[i], b = jq[i];
+        jp[i] = c * a - s * b;
+        jq[i] = s * a + c * b;
+      }
+    }
+    return true;
+  }
+
+  //!\brief Singular value decomposition A = U diag(s) V^T of an m x n matrix by one-sided Jacobi
+  //! rotations. s receives the min(m, n) singular values in descending order, U (m x min(m, n))
+  //! and V (n x min(m, n)) are only formed when given. Columns of U belonging to zero singular
+  //! values are zero. Rectangular matrices are first reduced to a square triangle by the blocked
+  //! QR. The rotations work on contiguous rows and pairs are visited in round robin order, so
+  //! each round is a set of independent rotations spread over the thread pool.
+  //! The outputs are not used to deduce T, so either can be nullptr.
+  template <typename T>
+  inline void svdDecompose(const MatrixX<T>& A, VectorX<T>& s, typename std::decay<MatrixX<T>>::type* U,
+    typename std::decay<MatrixX<T>>::type* V, DenseWorkspace<T>& workspace, const GemmOptions& options = GemmOptions(),
+    size_t max_sweeps = 32)
+  {
+    // A wide matrix is decomposed as its transpose B, whose singular vectors swap roles
+    const bool wide = A.rows < A.cols;
+    const size_t m = wide ? A.cols : A.rows;
+    const size_t n = wide ? A.rows : A.cols;
+    MatrixX<T>* left = wide ? V : U;
+    MatrixX<T>* right = wide ? U : V;
+    s.resize(n);
+    if (left)
+      left->resize(m, n);
+    if (right)
+      right->resize(n, n);
+    if (n == 0)
+      return;
+
+    // Rows of the rotated array are the columns of B, or of its triangle R when B = Q R
+    MatrixX<T>& X = workspace.rotated;
+    X.resize(n, n);
+    const bool reduced = m > n;
+    if (reduced) {
+      MatrixX<T>& B = workspace.matrix;
+      B.resize(m, n);
+      for (size_t i = 0; i < m; ++i)
+        for (size_t j = 0; j < n; ++j)
+          B(i, j) = wide ? A(j, i) : A(i, j);
+      qrDecompose(B, workspace.tau, workspace, options);
+      for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < n; ++j)
+          X(i, j) = j <= i ? B(j, i) : T(0);
+    }
+    else {
+      for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < n; ++j)
+          X(i, j) = A(j, i);
+    }
+
+    // Rotations accumulate in the rows of the right singular vectors
+    T* J = nullptr;
+    if (right) {
+      J = right->v;
+      for (size_t i = 0; i < n * n; ++i)
+        J[i] = T(0);
+      for (size_t i = 0; i < n; ++i)
+        J[i*n + i] = T(1);
+    }
+
+    // Round robin pairs of rows, position 0 stays and the others turn, a padding row is skipped
+    const size_t slots = n + (n & 1);
+    const size_t max_chunks = 64;
+    size_t threads = options.threads == 0 ? ThreadPool::global().getThreadCount() : options.threads;
+    threads = std::max(size_t(1), std::min(std::min(threads, n / 64), max_chunks));
+    for (size_t sweep = 0; sweep < max_sweeps; ++sweep) {
+      size_t rotations = 0;
+      for (size_t round = 0; round + 1 < slots; ++round) {
+        size_t counts[max_chunks] = {};
+        parallelFor(slots / 2, threads, [&](size_t begin, size_t end, size_t chunk) {
+          for (size_t slot = begin; slot < end; ++slot) {
+            const size_t a = slot == 0 ? 0 : 1 + (slot - 1 + round) % (slots - 1);
+            const size_t b = 1 + (slots - 2 - slot + round) % (slots - 1);
+            if (a < n && b < n && orthogonalizeRows(X.v, n, J, n, std::min(a, b), std::max(a, b)))
+              ++counts[chunk];
+          }
+        });
+        for (size_t chunk = 0; chunk < threads; ++chunk)
+          rotations += counts[chunk];
+      }
+      if (rotations == 0)
+        break;
+    }
+
+    // Singular values are the norms of the rows, sorted by swapping rows
+    for (size_t i = 0; i < n; ++i) {
+      const T* x = &X(i, 0);
+      T norm(0);
+      for (size_t j = 0; j < n; ++j)
+        norm += x[j] * x[j];
+      s[i] = std::sqrt(norm);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      size_t best = i;
+      for (size_t j = i + 1; j < n; ++j)
+        if (s[j] > s[best])
+          best = j;
+      if (best == i)
+        continue;
+      std::swap(s[i], s[best]);
+      std::swap_ranges(&X(i, 0), &X(i, 0) + n, &X(best, 0));
+      if (J)
+        std::swap_ranges(J + i*n, J + i*n + n, J + best*n);
+    }
+
+    if (right)
+      for (size_t i = 0; i < n; ++i)
+        for (size_t j = i + 1; j < n; ++j)
+          std::swap(J[i*n + j], J[j*n + i]);
+    if (left) {
+      MatrixX<T>& L = *left;
+      for (size_t j = 0; j < n; ++j) {
+        const T scale = s[j] > T(0) ? T(1) / s[j] : T(0);
+        for (size_t i = 0; i < n; ++i)
+          L(i, j) = X(j, i) * scale;
+      }
+      for (size_t i = n; i < m; ++i)
+        for (size_t j = 0; j < n; ++j)
+          L(i, j) = T(0);
+      if (reduced)
+        qrMultiply(workspace.matrix, workspace.tau, L, false, workspace, options);
+    }
+  }
+  template <typename T>
+  inline void svdDecompose(const MatrixX<T>& A, VectorX<T>& s, typename std::decay<MatrixX<T>>::type* U = nullptr,
+    typename std::decay<MatrixX<T>>::type* V = nullptr)
+  {
+    DenseWorkspace<T> workspace;
+    svdDecompose(A, s, U, V, workspace);
+  }
+}
\ No newline at end of file
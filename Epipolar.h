@@ -0,0 +1,398 @@
+#pragma once
+
+#include "Camera.h"
+#include "FixedSolvers.h"
+#include "Homography.h"
+#include "Matrix.h"
+#include "MatrixOperations.h"
+#include "Vector.h"
+#include "VectorOperations.h"
+
+#include <cmath>
+#include <limits>
+
+namespace dry
+{
+  // Correspondences l -> r satisfy the epipolar constraint r^T F l = 0, in pixels for the
+  // fundamental matrix F and in normalized camera coordinates for the essential matrix E.
+
+  //!\brief Add the epipolar equation of the correspondence l -> r to the normal matrix A^T A.
+  //! Only the upper triangle is updated.
+  template <typename T>
+  inline void addEpipolarEquation(const Vector2<T>& l, const Vector2<T>& r, MatrixN<T, 9>& ATA, T weight = T(1))
+  {
+    const T a[9] = { r.x*l.x, r.x*l.y, r.x, r.y*l.x, r.y*l.y, r.y, l.x, l.y, T(1) };
+    for (size_t i = 0; i < 9; ++i) {
+      const T wa = weight * a[i];
+      for (size_t j = i; j < 9; ++j)
+        ATA(i, j) += wa * a[j];
+    }
+  }
+
+  //!\brief Closest rank 2 matrix in the Frobenius norm, used on the linear fundamental matrix
+  inline void enforceFundamentalRank(Matrix3d& F)
+  {
+    MatrixN<double, 3> FTF, V;
+    VectorN<double, 3> values;
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        FTF(i, j) = F(0, i)*F(0, j) + F(1, i)*F(1, j) + F(2, i)*F(2, j);
+    symmetricEigen(FTF, values, V);
+
+    // Remove the smallest singular value: F - (F v) v^T
+    const Vector3d v(V(0, 0), V(1, 0), V(2, 0));
+    const Vector3d Fv = F * v;
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        F(i, j) -= Fv[i] * v[j];
+  }
+
+  //!\brief Closest essential matrix, with two equal singular values and one zero, scaled to unit norm
+  inline bool enforceEssentialConstraints(Matrix3d& E)
+  {
+    MatrixN<double, 3> ETE, V;
+    VectorN<double, 3> values;
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        ETE(i, j) = E(0, i)*E(0, j) + E(1, i)*E(1, j) + E(2, i)*E(2, j);
+    symmetricEigen(ETE, values, V);
+    if (!(values[1] > 0))
+      return false;
+
+    // E = U diag(s1, s2, 0) V^T with u_i = E v_i / s_i, rebuilt as (u1 v1^T + u2 v2^T) / sqrt(2)
+    Matrix3d result(0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (size_t k = 1; k < 3; ++k) {
+      const Vector3d v(V(0, k), V(1, k), V(2, k));
+      const Vector3d u = (E * v) * (1.0 / std::sqrt(2.0 * values[k]));
+      for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 3; ++j)
+          result(i, j) += u[i] * v[j];
+    }
+    E = result;
+    return true;
+  }
+
+  //!\brief Normalized 8-point estimate of the fundamental matrix for at least 8 correspondences,
+  //! rank 2 and scaled to unit norm. Works on the caller's buffers and does not allocate.
+  //! Both views must have the same count.
+  template <typename T>
+  inline bool estimateFundamental(const Vector2View<T>& left, const Vector2View<T>& right, Matrix3d& F)
+  {
+    const size_t count = left.count;
+    if (count < 8 || right.count != count)
+      return false;
+
+    Matrix3d right_hartley, left_hartley;
+    getHartleyNormalization(right, right_hartley);
+    getHartleyNormalization(left, left_hartley);
+
+    MatrixN<double, 9> ATA;
+    ATA.Set(0.0);
+    for (size_t i = 0; i < count; ++i) {
+      const Vector2d l(left.x[i*left.stride], left.y[i*left.stride]);
+      const Vector2d r(right.x[i*right.stride], right.y[i*right.stride]);
+      addEpipolarEquation(
+        toInhomogeneous(left_hartley*l),
+        toInhomogeneous(right_hartley*r), ATA);
+    }
+    for (size_t i = 0; i < 9; ++i)
+      for (size_t j = 0; j < i; ++j)
+        ATA(i, j) = ATA(j, i);
+
+    VectorN<double, 9> f;
+    getNullVector(ATA, f);
+    Matrix3d Fn(f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7], f[8]);
+    enforceFundamentalRank(Fn);
+
+    // Undo the normalizations, r_n^T Fn l_n = r^T (Tr^T Fn Tl) l
+    F = transpose(right_hartley) * Fn * left_hartley;
+    double norm2 = 0;
+    for (size_t i = 0; i < 9; ++i)
+      norm2 += F[i] * F[i];
+    if (!(norm2 > 0) || !std::isfinite(norm2))
+      return false;
+    F /= std::sqrt(norm2);
+    return true;
+  }
+  inline bool estimateFundamental(const Vector2d* left, const Vector2d* right, size_t count, Matrix3d& F)
+  {
+    if (count < 8)
+      return false;
+    return estimateFundamental(
+      Vector2View<double>::Interleaved(&left[0].x, count),
+      Vector2View<double>::Interleaved(&right[0].x, count), F);
+  }
+
+  //!\brief Essential matrices consistent with five correspondences in normalized camera
+  //! coordinates (Nister's five point method). Returns the number of solutions, at most 10,
+  //! each scaled to unit norm. Does not allocate.
+  inline size_t solveEssential(const Vector2d* left, const Vector2d* right, Matrix3d (&E)[10])
+  {
+    // Null space of the 5 x 9 epipolar system from the Householder QR of its transpose
+    double A[9][5], v[5][9], vv[5];
+    for (size_t i = 0; i < 5; ++i) {
+      const Vector2d& l = left[i];
+      const Vector2d& r = right[i];
+      const double a[9] = { r.x*l.x, r.x*l.y, r.x, r.y*l.x, r.y*l.y, r.y, l.x, l.y, 1.0 };
+      for (size_t j = 0; j < 9; ++j)
+        A[j][i] = a[j];
+    }
+    for (size_t k = 0; k < 5; ++k) {
+      double norm = 0;
+      for (size_t i = k; i < 9; ++i)
+        norm += A[i][k] * A[i][k];
+      norm = std::sqrt(norm);
+      if (norm == 0)
+        return 0;
+      for (size_t i = 0; i < 9; ++i)
+        v[k][i] = i < k ? 0.0 : A[i][k];
+      v[k][k] += A[k][k] > 0 ? norm : -norm;
+      vv[k] = 0;
+      for (size_t i = k; i < 9; ++i)
+        vv[k] += v[k][i] * v[k][i];
+      for (size_t j = k; j < 5; ++j) {
+        double dot = 0;
+        for (size_t i = k; i < 9; ++i)
+          dot += v[k][i] * A[i][j];
+        const double f = 2 * dot / vv[k];
+        for (size_t i = k; i < 9; ++i)
+          A[i][j] -= f * v[k][i];
+      }
+    }
+    // Basis X, Y, Z, W are the last four columns of Q, E = x X + y Y + z Z + W
+    double basis[4][9];
+    for (size_t b = 0; b < 4; ++b) {
+      double* q = basis[b];
+      for (size_t i = 0; i < 9; ++i)
+        q[i] = i == 5 + b ? 1.0 : 0.0;
+      for (size_t k = 5; k-- > 0;) {
+        double dot = 0;
+        for (size_t i = k; i < 9; ++i)
+          dot += v[k][i] * q[i];
+        const double f = 2 * dot / vv[k];
+        for (size_t i = k; i < 9; ++i)
+          q[i] -= f * v[k][i];
+      }
+    }
+
+    // Entries of E as polynomials in the monomials (x, y, z, 1), products in degree 2 over
+    // (x^2, xy, xz, y^2, yz, z^2, x, y, z, 1) and in degree 3 in the order of the elimination
+    // (x^3, y^3, x^2y, xy^2, x^2z, x^2, y^2z, y^2, xyz, xy, xz^2, xz, x, yz^2, yz, y, z^3, z^2, z, 1).
+    static const unsigned char product11[4][4] = {
+      { 0, 1, 2, 6 }, { 1, 3, 4, 7 }, { 2, 4, 5, 8 }, { 6, 7, 8, 9 } };
+    static const unsigned char product21[10][4] = {
+      { 0, 2, 4, 5 }, { 2, 3, 8, 9 }, { 4, 8, 10, 11 }, { 3, 1, 6, 7 }, { 8, 6, 13, 14 },
+      { 10, 13, 16, 17 }, { 5, 9, 11, 12 }, { 9, 7, 14, 15 }, { 11, 14, 17, 18 }, { 12, 15, 18, 19 } };
+    double e[3][3][4];
+    for (size_t i = 0; i < 9; ++i)
+      for (size_t b = 0; b < 4; ++b)
+        e[i / 3][i % 3][b] = basis[b][i];
+    auto multiply11 = [&](const double* a, const double* b, double* out, double scale) {
+      for (size_t i = 0; i < 4; ++i)
+        for (size_t j = 0; j < 4; ++j)
+          out[product11[i][j]] += scale * a[i] * b[j];
+    };
+    auto multiply21 = [&](const double* a, const double* b, double* out, double scale) {
+      for (size_t i = 0; i < 10; ++i)
+        for (size_t j = 0; j < 4; ++j)
+          out[product21[i][j]] += scale * a[i] * b[j];
+    };
+
+    // Ten cubic constraints: det(E) = 0 and 2 E E^T E - trace(E E^T) E = 0
+    double M[10][20] = {};
+    double EET[3][3][10] = {}, trace[10] = {};
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = i; j < 3; ++j)
+        for (size_t k = 0; k < 3; ++k)
+          multiply11(e[i][k], e[j][k], EET[i][j], 1.0);
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = 0; j < i; ++j)
+        for (size_t m = 0; m < 10; ++m)
+          EET[i][j][m] = EET[j][i][m];
+    for (size_t m = 0; m < 10; ++m)
+      trace[m] = EET[0][0][m] + EET[1][1][m] + EET[2][2][m];
+    for (size_t i = 0; i < 3; ++i) {
+      for (size_t j = 0; j < 3; ++j) {
+        double* row = M[1 + 3*i + j];
+        for (size_t k = 0; k < 3; ++k)
+          multiply21(EET[i][k], e[k][j], row, 2.0);
+        multiply21(trace, e[i][j], row, -1.0);
+      }
+    }
+    for (size_t j = 0; j < 3; ++j) {
+      double cofactor[10] = {};
+      multiply11(e[0][(j + 1) % 3], e[1][(j + 2) % 3], cofactor, 1.0);
+      multiply11(e[0][(j + 2) % 3], e[1][(j + 1) % 3], cofactor, -1.0);
+      multiply21(cofactor, e[2][j], M[0], 1.0);
+    }
+
+    // Gauss-Jordan elimination of the first ten monomials
+    for (size_t c = 0; c < 10; ++c) {
+      size_t pivot = c;
+      for (size_t r = c + 1; r < 10; ++r)
+        if (std::abs(M[r][c]) > std::abs(M[pivot][c]))
+          pivot = r;
+      if (!(std::abs(M[pivot][c]) > 0))
+        return 0;
+      if (pivot != c)
+        for (size_t k = 0; k < 20; ++k)
+          std::swap(M[c][k], M[pivot][k]);
+      const double inverse_pivot = 1.0 / M[c][c];
+      for (size_t k = c; k < 20; ++k)
+        M[c][k] *= inverse_pivot;
+      for (size_t r = 0; r < 10; ++r) {
+        if (r == c || M[r][c] == 0)
+          continue;
+        const double f = M[r][c];
+        for (size_t k = c; k < 20; ++k)
+          M[r][k] -= f * M[c][k];
+      }
+    }
+
+    // Rows <e> - z <f>, <g> - z <h> and <i> - z <j> are linear in x and y with coefficients
+    // polynomial in z (ascending powers), their 3x3 determinant is of degree 10 in z
+    double B[3][3][11] = {};
+    for (size_t r = 0; r < 3; ++r) {
+      const double* p = M[4 + 2*r];
+      const double* q = M[5 + 2*r];
+      const size_t columns[2] = { 10, 13 };
+      for (size_t c = 0; c < 2; ++c) {
+        const size_t k = columns[c];
+        B[r][c][0] = p[k + 2];
+        B[r][c][1] = p[k + 1] - q[k + 2];
+        B[r][c][2] = p[k] - q[k + 1];
+        B[r][c][3] = -q[k];
+      }
+      B[r][2][0] = p[19];
+      B[r][2][1] = p[18] - q[19];
+      B[r][2][2] = p[17] - q[18];
+      B[r][2][3] = p[16] - q[17];
+      B[r][2][4] = -q[16];
+    }
+    auto multiply = [](const double* a, const double* b, double* out, double scale) {
+      for (size_t i = 0; i < 11; ++i)
+        for (size_t j = 0; i + j < 11; ++j)
+          out[i + j] += scale * a[i] * b[j];
+    };
+    double polynomial[11] = {};
+    for (size_t c = 0; c < 3; ++c) {
+      const size_t c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+      double minor[11] = {};
+      multiply(B[1][c1], B[2][c2], minor, 1.0);
+      multiply(B[1][c2], B[2][c1], minor, -1.0);
+      multiply(B[0][c], minor, polynomial, 1.0);
+    }
+
+    double roots[10];
+    const size_t root_count = solvePolynomial(polynomial, roots);
+    size_t solutions = 0;
+    for (size_t s = 0; s < root_count; ++s) {
+      const double z = roots[s];
+      Vector3d rows[3];
+      for (size_t r = 0; r < 3; ++r) {
+        double value[3];
+        for (size_t c = 0; c < 3; ++c) {
+          value[c] = 0;
+          for (size_t k = 5; k-- > 0;)
+            value[c] = value[c] * z + B[r][c][k];
+        }
+        rows[r] = Vector3d(value[0], value[1], value[2]);
+      }
+      // (x, y, 1) spans the null space of B(z)
+      Vector3d best(0, 0, 0);
+      for (size_t r = 0; r < 3; ++r) {
+        const Vector3d candidate = cross(rows[r], rows[(r + 1) % 3]);
+        if (dot(candidate, candidate) > dot(best, best))
+          best = candidate;
+      }
+      if (!(std::abs(best.z) > 1e-12 * (std::abs(best.x) + std::abs(best.y))))
+        continue;
+      const double x = best.x / best.z, y = best.y / best.z;
+
+      Matrix3d& result = E[solutions];
+      double norm2 = 0;
+      for (size_t i = 0; i < 9; ++i) {
+        result[i] = x * basis[0][i] + y * basis[1][i] + z * basis[2][i] + basis[3][i];
+        norm2 += result[i] * result[i];
+      }
+      if (!(norm2 > 0) || !std::isfinite(norm2))
+        continue;
+      result /= std::sqrt(norm2);
+      ++solutions;
+    }
+    return solutions;
+  }
+
+  //!\brief Squared Sampson distance of the correspondence l -> r to the epipolar geometry F
+  inline double getSampsonError2(const Matrix3d& F, const Vector2d& l, const Vector2d& r)
+  {
+    const Vector3d Fl = F * Vector3d(l.x, l.y, 1.0);
+    const Vector3d Ftr = transpose(F) * Vector3d(r.x, r.y, 1.0);
+    const double e = r.x * Fl.x + r.y * Fl.y + Fl.z;
+    const double d = Fl.x*Fl.x + Fl.y*Fl.y + Ftr.x*Ftr.x + Ftr.y*Ftr.y;
+    return d > 0 ? e * e / d : std::numeric_limits<double>::max();
+  }
+
+  //!\brief The four right camera matrices [R | t] compatible with E when the left camera is [I | 0].
+  //! The baseline |t| is 1. Returns false for a degenerate E.
+  inline bool decomposeEssential(Matrix3d E, Matrix3x4d (&cameras)[4])
+  {
+    if (!enforceEssentialConstraints(E))
+      return false;
+
+    // E = [t]x R with |t| = 1 after the scaling, t spans the left null space
+    E *= std::sqrt(2.0);
+    const Vector3d columns[3] = { Vector3d(E.a00, E.a10, E.a20), Vector3d(E.a01, E.a11, E.a21), Vector3d(E.a02, E.a12, E.a22) };
+    Vector3d t(0, 0, 0);
+    for (size_t i = 0; i < 3; ++i) {
+      const Vector3d candidate = cross(columns[i], columns[(i + 1) % 3]);
+      if (dot(candidate, candidate) > dot(t, t))
+        t = candidate;
+    }
+    t = normalized(t);
+
+    // Horn: cof(E) = t t^T R and [t]x E = (t t^T - I) R, the twisted pair follows from -t
+    const Vector3d rows[3] = { Vector3d(E.a00, E.a01, E.a02), Vector3d(E.a10, E.a11, E.a12), Vector3d(E.a20, E.a21, E.a22) };
+    const Vector3d c0 = cross(rows[1], rows[2]), c1 = cross(rows[2], rows[0]), c2 = cross(rows[0], rows[1]);
+    const Matrix3d cofactors(c0.x, c0.y, c0.z, c1.x, c1.y, c1.z, c2.x, c2.y, c2.z);
+    const Matrix3d tE = getCrossMatrix(t) * E;
+    const Matrix3d R[2] = { cofactors - tE, cofactors + tE };
+    for (size_t i = 0; i < 4; ++i) {
+      const Matrix3d Rt = transpose(R[i / 2]);
+      const Vector3d ti = (i & 1) ? t * -1.0 : t;
+      cameras[i] = getCameraMatrix(Rt, (Rt * ti) * -1.0);
+    }
+    return true;
+  }
+
+  //!\brief Right camera matrix [R | t] from E and the correspondences, picking the decomposition
+  //! with the most points in front of both cameras. Returns that number of points, 0 on failure.
+  inline size_t getRelativePose(const Matrix3d& E, const Vector2d* left, const Vector2d* right, size_t count, Matrix3x4d& camera)
+  {
+    Matrix3x4d cameras[4];
+    if (!decomposeEssential(E, cameras))
+      return 0;
+
+    size_t best = 0;
+    for (size_t c = 0; c < 4; ++c) {
+      const Matrix3x4d& P = cameras[c];
+      const Matrix3d R(P.a00, P.a01, P.a02, P.a10, P.a11, P.a12, P.a20, P.a21, P.a22);
+      const Vector3d t(P.a03, P.a13, P.a23);
+      size_t in_front = 0;
+      for (size_t i = 0; i < count; ++i) {
+        // Depths d0, d1 of the two view rays solving d1 b = d0 R a + t
+        const Vector3d Ra = R * Vector3d(left[i].x, left[i].y, 1.0);
+        const Vector3d b(right[i].x, right[i].y, 1.0);
+        const Vector3d bRa = cross(b, Ra), Rab = cross(Ra, b);
+        const double d0 = -dot(bRa, cross(b, t));
+        const double d1 = dot(Rab, cross(Ra, t));
+        in_front += d0 > 0 && d1 > 0;
+      }
+      if (in_front > best) {
+        best = in_front;
+        camera = P;
+      }
+    }
+    return best;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,235 @@
+#pragma once
+#include "Types.h"
+
+#include <stdexcept>
+#include <type_traits>
+
+namespace dry
+{
+  //!\brief Base of the lazy elementwise expressions over MatrixX and VectorX.
+  //! Operators on the containers build a tree of small nodes that is evaluated in one fused loop
+  //! when it is assigned, so a*s + b - c needs no temporaries. Nodes refer to the elements of
+  //! their operands, so an expression must be evaluated before the operands go away. Operands
+  //! other than scalars must have the same shape, building a node from operands of different
+  //! shapes throws std::invalid_argument.
+  template <typename E>
+  struct Expression
+  {
+    const E& derived() const { return static_cast<const E&>(*this); }
+  };
+
+  //!\brief Contiguous elements of a container
+  template <typename T>
+  class ArrayExpression : public Expression<ArrayExpression<T>>
+  {
+  public:
+    typedef T Scalar;
+    static const bool scalar = false;
+    ArrayExpression(const T* v, size_t rows, size_t cols) : v(v), rows(rows), cols(cols) {}
+
+    T operator[](size_t idx) const { return v[idx]; }
+    size_t getRows() const { return rows; }
+    size_t getCols() const { return cols; }
+
+  private:
+    const T* v;
+    size_t rows;
+    size_t cols;
+  };
+
+  //!\brief A scalar repeated over the shape of the other operand
+  template <typename T>
+  class ScalarExpression : public Expression<ScalarExpression<T>>
+  {
+  public:
+    typedef T Scalar;
+    static const bool scalar = true;   //!< Takes the shape of the other operand
+    explicit ScalarExpression(const T& value) : value(value) {}
+
+    T operator[](size_t) const { return value; }
+    size_t getRows() const { return 0; }
+    size_t getCols() const { return 0; }
+
+  private:
+    T value;
+  };
+
+  template <typename Op, typename E>
+  class UnaryExpression : public Expression<UnaryExpression<Op, E>>
+  {
+  public:
+    typedef decltype(Op::apply(typename E::Scalar())) Scalar;
+    static const bool scalar = E::scalar;
+    explicit UnaryExpression(const E& e) : e(e) {}
+
+    Scalar operator[](size_t idx) const { return Op::apply(e[idx]); }
+    size_t getRows() const { return e.getRows(); }
+    size_t getCols() const { return e.getCols(); }
+
+  private:
+    E e;
+  };
+
+  template <typename Op, typename L, typename R>
+  class BinaryExpression : public Expression<BinaryExpression<Op, L, R>>
+  {
+  public:
+    typedef decltype(Op::apply(typename L::Scalar(), typename R::Scalar())) Scalar;
+    static const bool scalar = L::scalar && R::scalar;
+    BinaryExpression(const L& l, const R& r) : l(l), r(r)
+    {
+      if (!L::scalar && !R::scalar && (l.getRows() != r.getRows() || l.getCols() != r.getCols()))
+        throw std::invalid_argument("operands of an elementwise expression differ in shape");
+    }
+
+    Scalar operator[](size_t idx) const { return Op::apply(l[idx], r[idx]); }
+    size_t getRows() const { return L::scalar ? r.getRows() : l.getRows(); }
+    size_t getCols() const { return L::scalar ? r.getCols() : l.getCols(); }
+
+  private:
+    L l;
+    R r;
+  };
+
+  struct AddOperation { template <typename A, typename B> static auto apply(A a, B b) { return a + b; } };
+  struct SubtractOperation { template <typename A, typename B> static auto apply(A a, B b) { return a - b; } };
+  struct MultiplyOperation { template <typename A, typename B> static auto apply(A a, B b) { return a * b; } };
+  struct DivideOperation { template <typename A, typename B> static auto apply(A a, B b) { return a / b; } };
+  struct NegateOperation { template <typename A> static auto apply(A a) { return -a; } };
+  struct SquareOperation { template <typename A> static auto apply(A a) { return a * a; } };
+
+  //!\brief Expression node of an operand, specialized for the containers next to their definitions
+  template <typename X, typename Enable = void>
+  struct ExpressionOperand
+  {
+    static const bool value = false;
+  };
+  template <typename E>
+  struct ExpressionOperand<E, typename std::enable_if<std::is_base_of<Expression<E>, E>::value>::type>
+  {
+    static const bool value = true;
+    typedef E Type;
+    static const E& get(const E& e) { return e; }
+  };
+
+  //!\brief Node of a binary operation between two operands or an operand and a scalar.
+  //! Scalars take the element type of the other operand so float expressions stay float.
+  template <typename Op, typename A, typename B, typename Enable = void>
+  struct BinaryOperands {};
+  template <typename Op, typename A, typename B>
+  struct BinaryOperands<Op, A, B, typename std::enable_if<ExpressionOperand<A>::value && ExpressionOperand<B>::value>::type>
+  {
+    typedef BinaryExpression<Op, typename ExpressionOperand<A>::Type, typename ExpressionOperand<B>::Type> Type;
+    static Type make(const A& a, const B& b) { return Type(ExpressionOperand<A>::get(a), ExpressionOperand<B>::get(b)); }
+  };
+  template <typename Op, typename A, typename B>
+  struct BinaryOperands<Op, A, B, typename std::enable_if<ExpressionOperand<A>::value && std::is_arithmetic<B>::value>::type>
+  {
+    typedef typename ExpressionOperand<A>::Type L;
+    typedef ScalarExpression<typename L::Scalar> R;
+    typedef BinaryExpression<Op, L, R> Type;
+    static Type make(const A& a, const B& b) { return Type(ExpressionOperand<A>::get(a), R(typename L::Scalar(b))); }
+  };
+  template <typename Op, typename A, typename B>
+  struct BinaryOperands<Op, A, B, typename std::enable_if<std::is_arithmetic<A>::value && ExpressionOperand<B>::value>::type>
+  {
+    typedef typename ExpressionOperand<B>::Type R;
+    typedef ScalarExpression<typename R::Scalar> L;
+    typedef BinaryExpression<Op, L, R> Type;
+    static Type make(const A& a, const B& b) { return Type(L(typename R::Scalar(a)), ExpressionOperand<B>::get(b)); }
+  };
+
+  template <typename A, typename B>
+  inline typename BinaryOperands<AddOperation, A, B>::Type operator+(const A& a, const B& b)
+  {
+    return BinaryOperands<AddOperation, A, B>::make(a, b);
+  }
+  template <typename A, typename B>
+  inline typename BinaryOperands<SubtractOperation, A, B>::Type operator-(const A& a, const B& b)
+  {
+    return BinaryOperands<SubtractOperation, A, B>::make(a, b);
+  }
+  // Products and quotients are only elementwise with a scalar, see multiplyElements
+  template <typename A, typename B>
+  inline typename std::enable_if<std::is_arithmetic<A>::value || std::is_arithmetic<B>::value,
+    typename BinaryOperands<MultiplyOperation, A, B>::Type>::type operator*(const A& a, const B& b)
+  {
+    return BinaryOperands<MultiplyOperation, A, B>::make(a, b);
+  }
+  template <typename A, typename B>
+  inline typename std::enable_if<std::is_arithmetic<B>::value,
+    typename BinaryOperands<DivideOperation, A, B>::Type>::type operator/(const A& a, const B& b)
+  {
+    return BinaryOperands<DivideOperation, A, B>::make(a, b);
+  }
+  template <typename A>
+  inline typename std::enable_if<ExpressionOperand<A>::value,
+    UnaryExpression<NegateOperation, typename ExpressionOperand<A>::Type>>::type operator-(const A& a)
+  {
+    return UnaryExpression<NegateOperation, typename ExpressionOperand<A>::Type>(ExpressionOperand<A>::get(a));
+  }
+
+  //!\brief Elementwise product of two operands of the same shape, checked like + and -
+  template <typename A, typename B>
+  inline typename std::enable_if<ExpressionOperand<A>::value && ExpressionOperand<B>::value,
+    typename BinaryOperands<MultiplyOperation, A, B>::Type>::type multiplyElements(const A& a, const B& b)
+  {
+    return BinaryOperands<MultiplyOperation, A, B>::make(a, b);
+  }
+  //!\brief Elementwise quotient of two operands of the same shape, checked like + and -
+  template <typename A, typename B>
+  inline typename std::enable_if<ExpressionOperand<A>::value && ExpressionOperand<B>::value,
+    typename BinaryOperands<DivideOperation, A, B>::Type>::type divideElements(const A& a, const B& b)
+  {
+    return BinaryOperands<DivideOperation, A, B>::make(a, b);
+  }
+
+  //!\brief Write the elements of an expression to out in one loop
+  template <typename E, typename T>
+  inline void evaluate(const Expression<E>& expression, T* out)
+  {
+    // The local copy keeps the node pointers in registers across the stores. out may be one
+    // of the operands, which is safe as element i of an operand is only read for out[i].
+    const E e = expression.derived();
+    const size_t n = e.getRows() * e.getCols();
+    for (size_t i = 0; i < n; ++i)
+      out[i] = T(e[i]);
+  }
+
+  //!\brief Sum of the elements, fused with the evaluation of the expression
+  template <typename A>
+  inline typename std::enable_if<ExpressionOperand<A>::value, typename ExpressionOperand<A>::Type::Scalar>::type sum(const A& a)
+  {
+    typedef typename ExpressionOperand<A>::Type E;
+    typedef typename E::Scalar T;
+    const E e = ExpressionOperand<A>::get(a);
+    const size_t n = e.getRows() * e.getCols();
+    // Independent partial sums vectorize without reassociating the additions of one lane
+    const size_t lanes = 8;
+    T partial[lanes] = {};
+    size_t i = 0;
+    for (; i + lanes <= n; i += lanes)
+      for (size_t k = 0; k < lanes; ++k)
+        partial[k] += e[i + k];
+    T total(0);
+    for (; i < n; ++i)
+      total += e[i];
+    for (size_t k = 0; k < lanes; ++k)
+      total += partial[k];
+    return total;
+  }
+
+  //!\brief Sum of the elementwise products of two operands of the same shape
+  template <typename A, typename B>
+  inline auto dot(const A& a, const B& b) -> decltype(sum(multiplyElements(a, b)))
+  {
+    return sum(multiplyElements(a, b));
+  }
+
+  //!\brief Sum of the squared elements
+  template <typename A>
+  inline auto norm2(const A& a) -> decltype(sum(UnaryExpression<SquareOperation, typename ExpressionOperand<A>::Type>(ExpressionOperand<A>::get(a))))
+  {
+    return sum(UnaryExpression<SquareOperation, typename ExpressionOperand<A>::Type>(ExpressionOperand<A>::get(a)));
+  }
+}
\ No newline at end of file
@@ -0,0 +1,446 @@
+#pragma once
+
+#include "Matrix.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace dry
+{
+  //!\brief Eigen decomposition of a symmetric matrix using cyclic Jacobi rotations.
+  //! Eigenvalues are sorted in ascending order, eigenvectors are the columns of V.
+  template <typename T, size_t N>
+  inline void symmetricEigen(MatrixN<T, N, N> A, VectorN<T, N>& values, MatrixN<T, N, N>& V, size_t max_sweeps = 32)
+  {
+    V = MatrixN<T, N, N>::Identity();
+
+    for (size_t sweep = 0; sweep < max_sweeps; ++sweep) {
+      // Stop when the off-diagonal part is negligible compared to the whole matrix
+      T off(0), total(0);
+      for (size_t p = 0; p < N; ++p) {
+        total += A(p, p) * A(p, p);
+        for (size_t q = p + 1; q < N; ++q)
+          off += A(p, q) * A(p, q);
+      }
+      total += 2 * off;
+      if (off <= std::numeric_limits<T>::epsilon() * std::numeric_limits<T>::epsilon() * total)
+        break;
+
+      for (size_t p = 0; p < N; ++p) {
+        for (size_t q = p + 1; q < N; ++q) {
+          T apq = A(p, q);
+          if (apq == T(0))
+            continue;
+
+          // Rotation angle that annihilates A(p, q)
+          T theta = (A(q, q) - A(p, p)) / (2 * apq);
+          T t = std::abs(theta) > T(1e150) ? T(0.5) / theta :
+            (theta >= 0 ? T(1) : T(-1)) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+          T c = 1 / std::sqrt(t * t + 1);
+          T s = t * c;
+
+          for (size_t k = 0; k < N; ++k) {
+            T akp = A(k, p), akq = A(k, q);
+            A(k, p) = c * akp - s * akq;
+            A(k, q) = s * akp + c * akq;
+          }
+          for (size_t k = 0; k < N; ++k) {
+            T apk = A(p, k), aqk = A(q, k);
+            A(p, k) = c * apk - s * aqk;
+            A(q, k) = s * apk + c * aqk;
+          }
+          for (size_t k = 0; k < N; ++k) {
+            T vkp = V(k, p), vkq = V(k, q);
+            V(k, p) = c * vkp - s * vkq;
+            V(k, q) = s * vkp + c * vkq;
+          }
+        }
+      }
+    }
+
+    for (size_t i = 0; i < N; ++i)
+      values[i] = A(i, i);
+
+    // Sort ascending, moving the eigenvectors along
+    for (size_t i = 0; i < N; ++i) {
+      size_t min_idx = i;
+      for (size_t j = i + 1; j < N; ++j)
+        if (values[j] < values[min_idx])
+          min_idx = j;
+      if (min_idx == i)
+        continue;
+      std::swap(values[i], values[min_idx]);
+      for (size_t k = 0; k < N; ++k)
+        std::swap(V(k, i), V(k, min_idx));
+    }
+  }
+
+  //!\brief Unit vector minimizing x^T A x for a symmetric positive semi-definite A.
+  //! Returns the corresponding (smallest) eigenvalue.
+  template <typename T, size_t N>
+  inline T getNullVector(const MatrixN<T, N, N>& A, VectorN<T, N>& x)
+  {
+    VectorN<T, N> values;
+    MatrixN<T, N, N> V;
+    symmetricEigen(A, values, V);
+    for (size_t i = 0; i < N; ++i)
+      x[i] = V(i, 0);
+    return values[0];
+  }
+  //!\brief Solve A x = b for a symmetric positive definite A using its Cholesky factor.
+  //! Only the upper triangle of A is read. Returns false if A is not positive definite.
+  template <typename T, size_t N>
+  inline bool choleskySolve(const MatrixN<T, N, N>& A, const VectorN<T, N>& b, VectorN<T, N>& x)
+  {
+    // A = L * L^T, L stored in the lower triangle
+    MatrixN<T, N, N> L;
+    for (size_t j = 0; j < N; ++j) {
+      T d = A(j, j);
+      for (size_t k = 0; k < j; ++k)
+        d -= L(j, k) * L(j, k);
+      if (!(d > T(0)))
+        return false;
+      L(j, j) = std::sqrt(d);
+      for (size_t i = j + 1; i < N; ++i) {
+        T sum = A(j, i);
+        for (size_t k = 0; k < j; ++k)
+          sum -= L(i, k) * L(j, k);
+        L(i, j) = sum / L(j, j);
+      }
+    }
+
+    // Forward and backward substitution
+    for (size_t i = 0; i < N; ++i) {
+      T sum = b[i];
+      for (size_t k = 0; k < i; ++k)
+        sum -= L(i, k) * x[k];
+      x[i] = sum / L(i, i);
+    }
+    for (size_t i = N; i-- > 0;) {
+      T sum = x[i];
+      for (size_t k = i + 1; k < N; ++k)
+        sum -= L(k, i) * x[k];
+      x[i] = sum / L(i, i);
+    }
+    return true;
+  }
+
+  //!\brief Least squares solution of the overdetermined system A x = b (M >= N) by Householder QR.
+  //! Returns false if A is rank deficient.
+  template <typename T, size_t M, size_t N>
+  inline bool leastSquares(MatrixN<T, M, N> A, VectorN<T, M> b, VectorN<T, N>& x)
+  {
+    for (size_t k = 0; k < N; ++k) {
+      // Householder vector annihilating column k below the diagonal
+      T norm(0);
+      for (size_t i = k; i < M; ++i)
+        norm += A(i, k) * A(i, k);
+      norm = std::sqrt(norm);
+      if (norm == T(0))
+        return false;
+      const T alpha = A(k, k) > 0 ? -norm : norm;
+      T v[M];
+      for (size_t i = k; i < M; ++i)
+        v[i] = A(i, k);
+      v[k] -= alpha;
+      T vv(0);
+      for (size_t i = k; i < M; ++i)
+        vv += v[i] * v[i];
+      if (vv == T(0))
+        continue;
+
+      for (size_t j = k; j < N; ++j) {
+        T dot(0);
+        for (size_t i = k; i < M; ++i)
+          dot += v[i] * A(i, j);
+        const T f = 2 * dot / vv;
+        for (size_t i = k; i < M; ++i)
+          A(i, j) -= f * v[i];
+      }
+      T dot(0);
+      for (size_t i = k; i < M; ++i)
+        dot += v[i] * b[i];
+      const T f = 2 * dot / vv;
+      for (size_t i = k; i < M; ++i)
+        b[i] -= f * v[i];
+    }
+
+    // Back substitution with R
+    for (size_t i = N; i-- > 0;) {
+      if (std::abs(A(i, i)) <= std::numeric_limits<T>::epsilon() * std::abs(A(0, 0)))
+        return false;
+      T sum = b[i];
+      for (size_t j = i + 1; j < N; ++j)
+        sum -= A(i, j) * x[j];
+      x[i] = sum / A(i, i);
+    }
+    return true;
+  }
+
+  //!\brief Largest real root of x^3 + a x^2 + b x + c
+  template <typename T>
+  inline T solveCubicLargest(T a, T b, T c)
+  {
+    // Depressed cubic t^3 + p t + q with x = t - a / 3
+    const T p = b - a * a / 3;
+    const T q = 2 * a * a * a / 27 - a * b / 3 + c;
+    const T disc = q * q / 4 + p * p * p / 27;
+    T t;
+    if (disc >= 0) {
+      const T sq = std::sqrt(disc);
+      t = std::cbrt(-q / 2 + sq) + std::cbrt(-q / 2 - sq);
+    }
+    else {
+      const T r = std::sqrt(-p / 3);
+      const T phi = std::acos(std::max(T(-1), std::min(T(1), -q / (2 * r * r * r))));
+      t = 2 * r * std::cos(phi / 3);
+    }
+    T x = t - a / 3;
+
+    // Polish
+    for (size_t i = 0; i < 2; ++i) {
+      const T f = ((x + a) * x + b) * x + c;
+      const T df = (3 * x + 2 * a) * x + b;
+      if (df == T(0))
+        break;
+      x -= f / df;
+    }
+    return x;
+  }
+
+  //!\brief Real roots of a4 x^4 + a3 x^3 + a2 x^2 + a1 x + a0 (Ferrari). Returns the number of roots.
+  template <typename T>
+  inline size_t solveQuartic(T a4, T a3, T a2, T a1, T a0, T (&roots)[4])
+  {
+    if (a4 == T(0))
+      return 0;
+    const T a = a3 / a4, b = a2 / a4, c = a1 / a4, d = a0 / a4;
+
+    // Depressed quartic y^4 + p y^2 + q y + r with x = y - a / 4
+    const T p = b - 3 * a * a / 8;
+    const T q = c - a * b / 2 + a * a * a / 8;
+    const T r = d - a * c / 4 + a * a * b / 16 - 3 * a * a * a * a / 256;
+
+    size_t n = 0;
+    T y[4];
+    const T eps = std::numeric_limits<T>::epsilon();
+    if (std::abs(q) <= eps * (std::abs(p) + std::abs(r) + 1)) {
+      // Biquadratic
+      const T disc = p * p - 4 * r;
+      if (disc >= 0) {
+        const T z[2] = { (-p + std::sqrt(disc)) / 2, (-p - std::sqrt(disc)) / 2 };
+        for (size_t i = 0; i < 2; ++i) {
+          if (z[i] >= 0) {
+            y[n++] = std::sqrt(z[i]);
+            y[n++] = -std::sqrt(z[i]);
+          }
+        }
+      }
+    }
+    else {
+      // Resolvent cubic m^3 + p m^2 + (p^2/4 - r) m - q^2/8, its largest root is positive
+      const T m = solveCubicLargest(p, p * p / 4 - r, -q * q / 8);
+      if (m > 0) {
+        const T s = std::sqrt(2 * m);
+        const T e = q / (2 * s);
+        const T d1 = s * s - 4 * (p / 2 + m + e);
+        const T d2 = s * s - 4 * (p / 2 + m - e);
+        if (d1 >= 0) {
+          y[n++] = (s + std::sqrt(d1)) / 2;
+          y[n++] = (s - std::sqrt(d1)) / 2;
+        }
+        if (d2 >= 0) {
+          y[n++] = (-s + std::sqrt(d2)) / 2;
+          y[n++] = (-s - std::sqrt(d2)) / 2;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      T x = y[i] - a / 4;
+      // Polish on the original polynomial
+      for (size_t k = 0; k < 2; ++k) {
+        const T f = (((x + a) * x + b) * x + c) * x + d;
+        const T df = ((4 * x + 3 * a) * x + 2 * b) * x + c;
+        if (df == T(0))
+          break;
+        x -= f / df;
+      }
+      roots[i] = x;
+    }
+    return n;
+  }
+
+  //!\brief Real roots of the polynomial sum coefficients[i] x^i of degree N, sorted ascending.
+  //! The roots of each derivative bracket those of the next lower one, which are then found
+  //! by safeguarded Newton iterations. Returns the number of roots, repeated roots may be missed.
+  template <typename T, size_t N>
+  inline size_t solvePolynomial(const T (&coefficients)[N + 1], T (&roots)[N])
+  {
+    T largest(0);
+    for (size_t i = 0; i <= N; ++i)
+      largest = std::max(largest, std::abs(coefficients[i]));
+    size_t degree = N;
+    while (degree > 0 && !(std::abs(coefficients[degree]) > std::numeric_limits<T>::epsilon() * largest))
+      --degree;
+    if (degree == 0)
+      return 0;
+
+    // Monic polynomial in row 0 and its derivatives in the following rows
+    T p[N][N + 1];
+    for (size_t i = 0; i <= degree; ++i)
+      p[0][i] = coefficients[i] / coefficients[degree];
+    // Fujiwara's bound on the magnitude of the roots
+    T bound(0);
+    for (size_t i = 0; i < degree; ++i)
+      bound = std::max(bound, T(std::pow(std::abs(p[0][i]) / (i == 0 ? 2 : 1), T(1) / T(degree - i))));
+    bound = bound > 0 ? 2 * bound : T(1);
+    for (size_t k = 1; k < degree; ++k)
+      for (size_t i = 0; i <= degree - k; ++i)
+        p[k][i] = p[k - 1][i + 1] * T(i + 1);
+
+    auto evaluate = [&](size_t k, T x, T& derivative) {
+      T f = p[k][degree - k];
+      derivative = T(0);
+      for (size_t i = degree - k; i-- > 0;) {
+        derivative = derivative * x + f;
+        f = f * x + p[k][i];
+      }
+      return f;
+    };
+
+    size_t count = 1;
+    roots[0] = -p[degree - 1][0] / p[degree - 1][1];
+    for (size_t k = degree - 1; k-- > 0;) {
+      // Every root of p[k] lies between neighbouring roots of p[k + 1], all of them within the bound
+      T edges[N + 1];
+      size_t edge_count = 0;
+      edges[edge_count++] = -bound;
+      for (size_t i = 0; i < count; ++i)
+        if (roots[i] > -bound && roots[i] < bound)
+          edges[edge_count++] = roots[i];
+      edges[edge_count++] = bound;
+
+      count = 0;
+      T derivative;
+      T lo = edges[0], flo = evaluate(k, lo, derivative);
+      for (size_t e = 1; e < edge_count; ++e) {
+        T hi = edges[e];
+        const T fhi = evaluate(k, hi, derivative);
+        const T next = hi, fnext = fhi;
+        if (flo == T(0))
+          roots[count++] = lo;
+        else if ((flo < 0) != (fhi < 0) && fhi != T(0)) {
+          T a = lo, fa = flo, x = lo - flo * (hi - lo) / (fhi - flo), step = hi - lo;
+          for (size_t iteration = 0; iteration < 100; ++iteration) {
+            const T f = evaluate(k, x, derivative);
+            if (f == T(0))
+              break;
+            if ((f < 0) == (fa < 0))
+              a = x;
+            else
+              hi = x;
+            // Newton step, bisection when it leaves the bracket or does not halve the previous step
+            const T tolerance = 4 * std::numeric_limits<T>::epsilon() * std::abs(x);
+            const bool newton = std::abs(2 * f) <= std::abs(step * derivative);
+            step = newton ? f / derivative : T(0);
+            if (newton && std::abs(step) <= tolerance) {
+              x -= step;
+              break;
+            }
+            T y = x - step;
+            if (!newton || !(y > std::min(a, hi) && y < std::max(a, hi))) {
+              y = (a + hi) / 2;
+              step = x - y;
+            }
+            x = y;
+            if (std::abs(step) <= tolerance)
+              break;
+          }
+          roots[count++] = x;
+        }
+        lo = next;
+        flo = fnext;
+      }
+      if (flo == T(0))
+        roots[count++] = lo;
+    }
+    return count;
+  }
+
+  //!\brief Lane batched null vectors of W symmetric positive semi-definite matrices.
+  //! Row i*N + j of A holds element (i, j) of every matrix, one lane per column, so the
+  //! Jacobi rotations of all lanes run as independent elementwise (vectorizable) updates.
+  template <typename T, size_t N, size_t W>
+  inline void getNullVectors(MatrixN<T, N*N, W> A, MatrixN<T, N, W>& x, size_t max_sweeps = 32)
+  {
+    MatrixN<T, N*N, W> V;
+    V.Set(T(0));
+    for (size_t i = 0; i < N; ++i)
+      for (size_t l = 0; l < W; ++l)
+        V(i*N + i, l) = T(1);
+
+    for (size_t sweep = 0; sweep < max_sweeps; ++sweep) {
+      bool converged = true;
+      for (size_t l = 0; l < W && converged; ++l) {
+        T off(0), total(0);
+        for (size_t p = 0; p < N; ++p) {
+          total += A(p*N + p, l) * A(p*N + p, l);
+          for (size_t q = p + 1; q < N; ++q)
+            off += A(p*N + q, l) * A(p*N + q, l);
+        }
+        total += 2 * off;
+        converged = off <= std::numeric_limits<T>::epsilon() * std::numeric_limits<T>::epsilon() * total;
+      }
+      if (converged)
+        break;
+
+      for (size_t p = 0; p < N; ++p) {
+        for (size_t q = p + 1; q < N; ++q) {
+          T c[W], s[W];
+          for (size_t l = 0; l < W; ++l) {
+            T apq = A(p*N + q, l);
+            bool zero = apq == T(0);
+            T theta = (A(q*N + q, l) - A(p*N + p, l)) / (2 * (zero ? T(1) : apq));
+            T t = (theta >= 0 ? T(1) : T(-1)) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+            t = zero ? T(0) : t;
+            c[l] = 1 / std::sqrt(t * t + 1);
+            s[l] = t * c[l];
+          }
+          for (size_t k = 0; k < N; ++k) {
+            for (size_t l = 0; l < W; ++l) {
+              T akp = A(k*N + p, l), akq = A(k*N + q, l);
+              A(k*N + p, l) = c[l] * akp - s[l] * akq;
+              A(k*N + q, l) = s[l] * akp + c[l] * akq;
+            }
+          }
+          for (size_t k = 0; k < N; ++k) {
+            for (size_t l = 0; l < W; ++l) {
+              T apk = A(p*N + k, l), aqk = A(q*N + k, l);
+              A(p*N + k, l) = c[l] * apk - s[l] * aqk;
+              A(q*N + k, l) = s[l] * apk + c[l] * aqk;
+            }
+          }
+          for (size_t k = 0; k < N; ++k) {
+            for (size_t l = 0; l < W; ++l) {
+              T vkp = V(k*N + p, l), vkq = V(k*N + q, l);
+              V(k*N + p, l) = c[l] * vkp - s[l] * vkq;
+              V(k*N + q, l) = s[l] * vkp + c[l] * vkq;
+            }
+          }
+        }
+      }
+    }
+
+    for (size_t l = 0; l < W; ++l) {
+      size_t min_idx = 0;
+      for (size_t i = 1; i < N; ++i)
+        if (A(i*N + i, l) < A(min_idx*N + min_idx, l))
+          min_idx = i;
+      for (size_t i = 0; i < N; ++i)
+        x(i, l) = V(i*N + min_idx, l);
+    }
+  }
+}
\ No newline at end of file
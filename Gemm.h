@@ -0,0 +1,469 @@
+#pragma once
+
+#include "Matrix.h"
+#include "Parallel.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+namespace dry
+{
+  struct GemmOptions
+  {
+    size_t threads = 0;   //!< 0 uses every available thread
+  };
+
+  //!\brief Register and cache block sizes of gemm.
+  //! The micro kernel keeps an mr x nr block of C in registers, nr spans two vector registers.
+  //! A kc deep sliver of packed B stays in L1 and an mc x kc block of packed A in L2.
+  template <typename T>
+  struct GemmBlocking
+  {
+#if defined(__AVX512F__)
+    static const size_t vector_bytes = 64;
+    static const size_t mr = 8;
+#elif defined(__AVX2__) && defined(__FMA__)
+    static const size_t vector_bytes = 32;
+    static const size_t mr = 6;
+#else
+    static const size_t vector_bytes = 16;
+    static const size_t mr = 4;
+#endif
+    static const size_t nr = 2 * vector_bytes / sizeof(T);
+    static const size_t kc = 256;
+    static const size_t mc = mr * (96 * 8 / sizeof(T) / mr);
+    static const size_t nc = 4096;
+  };
+  template <typename T> const size_t GemmBlocking<T>::vector_bytes;
+  template <typename T> const size_t GemmBlocking<T>::mr;
+  template <typename T> const size_t GemmBlocking<T>::nr;
+  template <typename T> const size_t GemmBlocking<T>::kc;
+  template <typename T> const size_t GemmBlocking<T>::mc;
+  template <typename T> const size_t GemmBlocking<T>::nc;
+
+  //!\brief Copy rows [i0, i0 + rows) and depth [p0, p0 + depth) of op(A) into slivers of mr rows,
+  //! each stored depth major. Rows past the end are zero.
+  template <typename T>
+  inline void packGemmA(const T* A, size_t lda, bool transpose, size_t i0, size_t rows, size_t p0, size_t depth, T* packed)
+  {
+    const size_t mr = GemmBlocking<T>::mr;
+    for (size_t i = 0; i < rows; i += mr) {
+      const size_t n = std::min(mr, rows - i);
+      for (size_t p = 0; p < depth; ++p) {
+        for (size_t r = 0; r < n; ++r)
+          packed[p*mr + r] = transpose ? A[(p0 + p)*lda + i0 + i + r] : A[(i0 + i + r)*lda + p0 + p];
+        for (size_t r = n; r < mr; ++r)
+          packed[p*mr + r] = T(0);
+      }
+      packed += mr * depth;
+    }
+  }
+
+  //!\brief Copy depth [p0, p0 + depth) and columns [j0, j0 + cols) of op(B) into slivers of nr
+  //! columns, each stored depth major. Columns past the end are zero.
+  template <typename T>
+  inline void packGemmB(const T* B, size_t ldb, bool transpose, size_t p0, size_t depth, size_t j0, size_t cols, T* packed)
+  {
+    const size_t nr = GemmBlocking<T>::nr;
+    for (size_t j = 0; j < cols; j += nr) {
+      const size_t n = std::min(nr, cols - j);
+      for (size_t p = 0; p < depth; ++p) {
+        if (transpose)
+          for (size_t c = 0; c < n; ++c)
+            packed[p*nr + c] = B[(j0 + j + c)*ldb + p0 + p];
+        else
+          for (size_t c = 0; c < n; ++c)
+            packed[p*nr + c] = B[(p0 + p)*ldb + j0 + j + c];
+        for (size_t c = n; c < nr; ++c)
+          packed[p*nr + c] = T(0);
+      }
+      packed += nr * depth;
+    }
+  }
+
+  //!\brief acc = a * b over depth steps of an mr tall sliver of packed A and an nr wide sliver
+  //! of packed B. Portable version, the compiler vectorizes it over the columns.
+  template <typename T>
+  inline void gemmAccumulate(size_t depth, const T* a, const T* b, T (&acc)[GemmBlocking<T>::mr][GemmBlocking<T>::nr])
+  {
+    const size_t mr = GemmBlocking<T>::mr;
+    const size_t nr = GemmBlocking<T>::nr;
+    // A local tile the compiler can keep in registers
+    T c[mr][nr] = {};
+    for (size_t p = 0; p < depth; ++p) {
+      T bp[nr];
+      for (size_t j = 0; j < nr; ++j)
+        bp[j] = b[p*nr + j];
+      for (size_t i = 0; i < mr; ++i) {
+        const T ai = a[p*mr + i];
+        for (size_t j = 0; j < nr; ++j)
+          c[i][j] += ai * bp[j];
+      }
+    }
+    for (size_t i = 0; i < mr; ++i)
+      for (size_t j = 0; j < nr; ++j)
+        acc[i][j] = c[i][j];
+  }
+
+#if defined(__AVX512F__)
+  // 8 x 2 registers of C, one broadcast of A is shared by two fused multiply adds
+  inline void gemmAccumulate(size_t depth, const double* a, const double* b, double (&acc)[8][16])
+  {
+    __m512d c[8][2];
+    for (size_t i = 0; i < 8; ++i)
+      c[i][0] = c[i][1] = _mm512_setzero_pd();
+    for (size_t p = 0; p < depth; ++p, a += 8, b += 16) {
+      const __m512d b0 = _mm512_loadu_pd(b), b1 = _mm512_loadu_pd(b + 8);
+      for (size_t i = 0; i < 8; ++i) {
+        const __m512d ai = _mm512_set1_pd(a[i]);
+        c[i][0] = _mm512_fmadd_pd(ai, b0, c[i][0]);
+        c[i][1] = _mm512_fmadd_pd(ai, b1, c[i][1]);
+      }
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      _mm512_storeu_pd(acc[i], c[i][0]);
+      _mm512_storeu_pd(acc[i] + 8, c[i][1]);
+    }
+  }
+  inline void gemmAccumulate(size_t depth, const float* a, const float* b, float (&acc)[8][32])
+  {
+    __m512 c[8][2];
+    for (size_t i = 0; i < 8; ++i)
+      c[i][0] = c[i][1] = _mm512_setzero_ps();
+    for (size_t p = 0; p < depth; ++p, a += 8, b += 32) {
+      const __m512 b0 = _mm512_loadu_ps(b), b1 = _mm512_loadu_ps(b + 16);
+      for (size_t i = 0; i < 8; ++i) {
+        const __m512 ai = _mm512_set1_ps(a[i]);
+        c[i][0] = _mm512_fmadd_ps(ai, b0, c[i][0]);
+        c[i][1] = _mm512_fmadd_ps(ai, b1, c[i][1]);
+      }
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      _mm512_storeu_ps(acc[i], c[i][0]);
+      _mm512_storeu_ps(acc[i] + 16, c[i][1]);
+    }
+  }
+#elif defined(__AVX2__) && defined(__FMA__)
+  // 6 x 2 registers of C, leaving registers for the two rows of B and the broadcast
+  inline void gemmAccumulate(size_t depth, const double* a, const double* b, double (&acc)[6][8])
+  {
+    __m256d c[6][2];
+    for (size_t i = 0; i < 6; ++i)
+      c[i][0] = c[i][1] = _mm256_setzero_pd();
+    for (size_t p = 0; p < depth; ++p, a += 6, b += 8) {
+      const __m256d b0 = _mm256_loadu_pd(b), b1 = _mm256_loadu_pd(b + 4);
+      for (size_t i = 0; i < 6; ++i) {
+        const __m256d ai = _mm256_broadcast_sd(a + i);
+        c[i][0] = _mm256_fmadd_pd(ai, b0, c[i][0]);
+        c[i][1] = _mm256_fmadd_pd(ai, b1, c[i][1]);
+      }
+    }
+    for (size_t i = 0; i < 6; ++i) {
+      _mm256_storeu_pd(acc[i], c[i][0]);
+      _mm256_storeu_pd(acc[i] + 4, c[i][1]);
+    }
+  }
+  inline void gemmAccumulate(size_t depth, const float* a, const float* b, float (&acc)[6][16])
+  {
+    __m256 c[6][2];
+    for (size_t i = 0; i < 6; ++i)
+      c[i][0] = c[i][1] = _mm256_setzero_ps();
+    for (size_t p = 0; p < depth; ++p, a += 6, b += 16) {
+      const __m256 b0 = _mm256_loadu_ps(b), b1 = _mm256_loadu_ps(b + 8);
+      for (size_t i = 0; i < 6; ++i) {
+        const __m256 ai = _mm256_broadcast_ss(a + i);
+        c[i][0] = _mm256_fmadd_ps(ai, b0, c[i][0]);
+        c[i][1] = _mm256_fmadd_ps(ai, b1, c[i][1]);
+      }
+    }
+    for (size_t i = 0; i < 6; ++i) {
+      _mm256_storeu_ps(acc[i], c[i][0]);
+      _mm256_storeu_ps(acc[i] + 8, c[i][1]);
+    }
+  }
+#endif
+
+  //!\brief C = alpha * a * b + beta * C for one mr x nr tile of packed slivers, of which the
+  //! first rows x cols elements are written. C is not read when beta is zero.
+  template <typename T>
+  inline void gemmMicroKernel(size_t depth, T alpha, const T* a, const T* b, T beta, T* C, size_t ldc, size_t rows, size_t cols)
+  {
+    const size_t mr = GemmBlocking<T>::mr;
+    const size_t nr = GemmBlocking<T>::nr;
+    T acc[mr][nr];
+    gemmAccumulate(depth, a, b, acc);
+
+    if (rows == mr && cols == nr) {
+      for (size_t i = 0; i < mr; ++i) {
+        T* c = C + i*ldc;
+        if (beta == T(0))
+          for (size_t j = 0; j < nr; ++j)
+            c[j] = alpha * acc[i][j];
+        else
+          for (size_t j = 0; j < nr; ++j)
+            c[j] = alpha * acc[i][j] + beta * c[j];
+      }
+      return;
+    }
+    for (size_t i = 0; i < rows; ++i)
+      for (size_t j = 0; j < cols; ++j)
+        C[i*ldc + j] = alpha * acc[i][j] + (beta == T(0) ? T(0) : beta * C[i*ldc + j]);
+  }
+
+  //!\brief Scratch buffer of gemm, one per thread and slot. It only grows, so repeated products
+  //! of similar sizes do not allocate.
+  template <typename T, size_t Slot>
+  inline T* getGemmBuffer(size_t count)
+  {
+    static thread_local VectorX<T> buffer;
+    if (buffer.size < count)
+      buffer.resize(count);
+    return buffer.v;
+  }
+
+  //!\brief Blocked product behind gemm and syrk. With upper set, tiles entirely below the
+  //! diagonal of C are skipped.
+  template <typename T>
+  inline void gemmBlocks(bool transpose_a, bool transpose_b, size_t m, size_t n, size_t k, T alpha,
+    const T* A, size_t lda, const T* B, size_t ldb, T beta, T* C, size_t ldc, bool upper, size_t threads)
+  {
+    typedef GemmBlocking<T> Blocking;
+    const size_t mr = Blocking::mr, nr = Blocking::nr;
+    if (m == 0 || n == 0)
+      return;
+    if (k == 0 || alpha == T(0)) {
+      for (size_t i = 0; i < m; ++i)
+        for (size_t j = upper ? i : 0; j < n; ++j)
+          C[i*ldc + j] = beta == T(0) ? T(0) : beta * C[i*ldc + j];
+      return;
+    }
+
+    // Small products are not worth spreading, the blocks of a thread should at least fill the cache
+    threads = std::max(size_t(1), std::min(threads, m * n * k / (size_t(1) << 18)));
+    const size_t row_blocks = (m + Blocking::mc - 1) / Blocking::mc;
+
+    // Too few rows to go around, such as the normal matrix of a tall least squares problem.
+    // Each thread multiplies a range of the depth into its own C and the results are summed.
+    // The partial results are kept per calling thread, so their total size is capped.
+    const size_t max_partial = size_t(1) << 20;
+    const size_t split = std::min(threads, max_partial / (m * n));
+    if (split > row_blocks && k >= split * Blocking::kc) {
+      T* partial = getGemmBuffer<T, 2>(split * m * n);
+      parallelFor(k, split, [&](size_t begin, size_t end, size_t chunk) {
+        gemmBlocks(transpose_a, transpose_b, m, n, end - begin, alpha,
+          transpose_a ? A + begin*lda : A + begin, lda,
+          transpose_b ? B + begin : B + begin*ldb, ldb, T(0), partial + chunk * m * n, n, upper, size_t(1));
+      });
+      for (size_t i = 0; i < m; ++i) {
+        T* c = C + i*ldc;
+        const size_t j0 = upper ? i : 0;
+        for (size_t j = j0; j < n; ++j)
+          c[j] = beta == T(0) ? T(0) : beta * c[j];
+        for (size_t t = 0; t < split; ++t) {
+          const T* p = partial + t * m * n + i*n;
+          for (size_t j = j0; j < n; ++j)
+            c[j] += p[j];
+        }
+      }
+      return;
+    }
+    threads = std::min(threads, row_blocks);
+
+    // B is packed by the calling thread and shared, each thread packs its own blocks of A
+    const size_t max_depth = std::min(k, Blocking::kc);
+    T* packed_b = getGemmBuffer<T, 0>(max_depth * ((std::min(n, Blocking::nc) + nr - 1) / nr) * nr);
+    const size_t packed_a_size = max_depth * ((std::min(m, Blocking::mc) + mr - 1) / mr) * mr;
+
+    for (size_t jc = 0; jc < n; jc += Blocking::nc) {
+      const size_t cols = std::min(Blocking::nc, n - jc);
+      for (size_t pc = 0; pc < k; pc += Blocking::kc) {
+        const size_t depth = std::min(Blocking::kc, k - pc);
+        const T block_beta = pc == 0 ? beta : T(1);
+        packGemmB(B, ldb, transpose_b, pc, depth, jc, cols, packed_b);
+
+        parallelFor(row_blocks, threads, [&](size_t begin, size_t end, size_t) {
+          T* a = getGemmBuffer<T, 1>(packed_a_size);
+          for (size_t block = begin; block < end; ++block) {
+            const size_t ic = block * Blocking::mc;
+            const size_t rows = std::min(Blocking::mc, m - ic);
+            if (upper && ic >= jc + cols)
+              continue;
+            packGemmA(A, lda, transpose_a, ic, rows, pc, depth, a);
+
+            for (size_t jr = 0; jr < cols; jr += nr) {
+              const T* b = packed_b + jr * depth;
+              for (size_t ir = 0; ir < rows; ir += mr) {
+                if (upper && ic + ir >= jc + jr + nr)
+                  break;
+                gemmMicroKernel(depth, alpha, a + ir * depth, b, block_beta, C + (ic + ir)*ldc + jc + jr, ldc,
+                  std::min(mr, rows - ir), std::min(nr, cols - jr));
+              }
+            }
+          }
+        });
+      }
+    }
+  }
+
+  //!\brief General matrix product C = alpha * op(A) * op(B) + beta * C of row major arrays,
+  //! op(X) is X or its transpose. op(A) is m x k, op(B) k x n and C m x n, lda, ldb and ldc are
+  //! the row strides. Both operands are packed in cache sized blocks, so transposed operands
+  //! cost nothing extra. Blocks of rows of C are spread over the thread pool. When the product
+  //! is A^T A or A A^T and beta is zero only the upper triangle is computed and then mirrored.
+  template <typename T>
+  inline void gemm(bool transpose_a, bool transpose_b, size_t m, size_t n, size_t k, T alpha,
+    const T* A, size_t lda, const T* B, size_t ldb, T beta, T* C, size_t ldc, const GemmOptions& options = GemmOptions())
+  {
+    const bool symmetric = beta == T(0) && m == n && A == B && lda == ldb && transpose_a != transpose_b;
+    const size_t threads = options.threads == 0 ? ThreadPool::global().getThreadCount() : options.threads;
+    gemmBlocks(transpose_a, transpose_b, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, symmetric, threads);
+
+    if (symmetric)
+      for (size_t i = 1; i < m; ++i)
+        for (size_t j = 0; j < i; ++j)
+          C[i*ldc + j] = C[j*ldc + i];
+  }
+
+  //!\brief Symmetric rank k update C = alpha * op(A) * op(A)^T + beta * C of the upper triangle
+  //! of a row major n x n array C, op(A) is n x k and is A or its transpose. Elements below the
+  //! diagonal may be partially updated and should be ignored.
+  template <typename T>
+  inline void syrk(bool transpose, size_t n, size_t k, T alpha, const T* A, size_t lda, T beta, T* C, size_t ldc,
+    const GemmOptions& options = GemmOptions())
+  {
+    const size_t threads = options.threads == 0 ? ThreadPool::global().getThreadCount() : options.threads;
+    gemmBlocks(transpose, !transpose, n, n, k, alpha, A, lda, A, lda, beta, C, ldc, true, threads);
+  }
+
+  //!\brief Matrix vector product y = alpha * op(A) * x + beta * y of a row major m x n array A,
+  //! op(A) is A or its transpose. y is not read when beta is zero.
+  template <typename T>
+  inline void gemv(bool transpose, size_t m, size_t n, T alpha, const T* A, size_t lda, const T* x, T beta, T* y,
+    const GemmOptions& options = GemmOptions())
+  {
+    const size_t outputs = transpose ? n : m;
+    size_t threads = options.threads == 0 ? ThreadPool::global().getThreadCount() : options.threads;
+    threads = std::max(size_t(1), std::min(std::min(threads, outputs / 64), m * n / (size_t(1) << 16)));
+
+    if (!transpose) {
+      // Rows of A are contiguous, each output is a dot product with partial sums that vectorize
+      parallelFor(m, threads, [&](size_t begin, size_t end, size_t) {
+        const size_t lanes = 8;
+        for (size_t i = begin; i < end; ++i) {
+          const T* a = A + i*lda;
+          T partial[lanes] = {};
+          size_t j = 0;
+          for (; j + lanes <= n; j += lanes)
+            for (size_t l = 0; l < lanes; ++l)
+              partial[l] += a[j + l] * x[j + l];
+          T sum(0);
+          for (; j < n; ++j)
+            sum += a[j] * x[j];
+          for (size_t l = 0; l < lanes; ++l)
+            sum += partial[l];
+          y[i] = alpha * sum + (beta == T(0) ? T(0) : beta * y[i]);
+        }
+      });
+      return;
+    }
+
+    // Each thread owns a range of outputs and streams the matching columns of every row
+    parallelFor(n, threads, [&](size_t begin, size_t end, size_t) {
+      const size_t width = end - begin;
+      T* out = y + begin;
+      for (size_t j = 0; j < width; ++j)
+        out[j] = beta == T(0) ? T(0) : beta * out[j];
+      for (size_t i = 0; i < m; ++i) {
+        const T s = alpha * x[i];
+        const T* a = A + i*lda + begin;
+        for (size_t j = 0; j < width; ++j)
+          out[j] += s * a[j];
+      }
+    });
+  }
+
+  // The products below throw std::invalid_argument if the inner dimensions differ. The result
+  // may be one of the operands, the product is then formed in a temporary that is swapped in.
+
+  //!\brief C = A * B
+  template <typename T>
+  inline void multiply(const MatrixX<T>& A, const MatrixX<T>& B, MatrixX<T>& C, const GemmOptions& options = GemmOptions())
+  {
+    if (A.cols != B.rows)
+      throw std::invalid_argument("multiply: the columns of A differ from the rows of B");
+    if (&C == &A || &C == &B) {
+      MatrixX<T> result = C.getArena() ? MatrixX<T>(*C.getArena()) : MatrixX<T>();
+      multiply(A, B, result, options);
+      C.swap(result);
+      return;
+    }
+    C.resize(A.rows, B.cols);
+    gemm(false, false, A.rows, B.cols, A.cols, T(1), A.v, A.cols, B.v, B.cols, T(0), C.v, C.cols, options);
+  }
+  //!\brief C = A^T * B without forming the transpose, multiplyTransposed(A, A, C) gives the
+  //! normal matrix of a least squares problem and only computes half of it
+  template <typename T>
+  inline void multiplyTransposed(const MatrixX<T>& A, const MatrixX<T>& B, MatrixX<T>& C, const GemmOptions& options = GemmOptions())
+  {
+    if (A.rows != B.rows)
+      throw std::invalid_argument("multiplyTransposed: the rows of A differ from the rows of B");
+    if (&C == &A || &C == &B) {
+      MatrixX<T> result = C.getArena() ? MatrixX<T>(*C.getArena()) : MatrixX<T>();
+      multiplyTransposed(A, B, result, options);
+      C.swap(result);
+      return;
+    }
+    C.resize(A.cols, B.cols);
+    gemm(true, false, A.cols, B.cols, A.rows, T(1), A.v, A.cols, B.v, B.cols, T(0), C.v, C.cols, options);
+  }
+  //!\brief y = A * x
+  template <typename T>
+  inline void multiply(const MatrixX<T>& A, const VectorX<T>& x, VectorX<T>& y, const GemmOptions& options = GemmOptions())
+  {
+    if (A.cols != x.size)
+      throw std::invalid_argument("multiply: the columns of A differ from the size of x");
+    if (&y == &x) {
+      VectorX<T> result = y.getArena() ? VectorX<T>(*y.getArena()) : VectorX<T>();
+      multiply(A, x, result, options);
+      y.swap(result);
+      return;
+    }
+    y.resize(A.rows);
+    gemv(false, A.rows, A.cols, T(1), A.v, A.cols, x.v, T(0), y.v, options);
+  }
+  //!\brief y = A^T * x without forming the transpose
+  template <typename T>
+  inline void multiplyTransposed(const MatrixX<T>& A, const VectorX<T>& x, VectorX<T>& y, const GemmOptions& options = GemmOptions())
+  {
+    if (A.rows != x.size)
+      throw std::invalid_argument("multiplyTransposed: the rows of A differ from the size of x");
+    if (&y == &x) {
+      VectorX<T> result = y.getArena() ? VectorX<T>(*y.getArena()) : VectorX<T>();
+      multiplyTransposed(A, x, result, options);
+      y.swap(result);
+      return;
+    }
+    y.resize(A.cols);
+    gemv(true, A.rows, A.cols, T(1), A.v, A.cols, x.v, T(0), y.v, options);
+  }
+
+  template <typename T>
+  inline MatrixX<T> operator*(const MatrixX<T>& A, const MatrixX<T>& B)
+  {
+    MatrixX<T> C;
+    multiply(A, B, C);
+    return C;
+  }
+  template <typename T>
+  inline VectorX<T> operator*(const MatrixX<T>& A, const VectorX<T>& x)
+  {
+    VectorX<T> y;
+    multiply(A, x, y);
+    return y;
+  }
+}
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "MatrixOperations.h"
 #include "VectorOperations.h"
+#include "FixedSolvers.h"
+#include "Parallel.h"
 
 #include <vector>
 #include <numeric>
@@ -9,73 +11,533 @@
 
 namespace dry
 {
-  void getHartleyNormalization(const std::vector<Vector2d>& data, Matrix3d& normalization)
+  //!\brief Running weighted mean and variance of 2D points (Welford).
+  //! Negative weights remove earlier contributions, scale() fades all of them.
+  struct PointStatistics
   {
-    // Calculate mean
-    Vector2d sum = std::accumulate(data.begin(), data.end(), Vector2d(0, 0));
-    Vector2d mean = sum / data.size();
+    PointStatistics() : weight(0), mean(0, 0), m2(0, 0) {}
 
-    // Calculate standard deviation
-    std::vector<Vector2d> diff(data.size());
-    std::transform(data.begin(), data.end(), diff.begin(), [mean](const Vector2d& x) { return x - mean; });
-    Vector2d sq_sum = std::inner_product(diff.begin(), diff.end(), diff.begin(), Vector2d(0, 0));
-    Vector2d stdev(std::sqrt(sq_sum.x / data.size()), std::sqrt(sq_sum.y / data.size()));
+    void add(const Vector2d& p, double w = 1.0)
+    {
+      weight += w;
+      if (weight <= 0) {
+        *this = PointStatistics();
+        return;
+      }
+      Vector2d delta = p - mean;
+      mean = mean + delta * (w / weight);
+      m2 = m2 + delta * (p - mean) * w;
+    }
+    void remove(const Vector2d& p, double w = 1.0) { add(p, -w); }
+    void scale(double factor)
+    {
+      weight *= factor;
+      m2 *= factor;
+    }
+    //!\brief Combine with the statistics of another set of points (Chan et al.)
+    void merge(const PointStatistics& other)
+    {
+      double total = weight + other.weight;
+      if (other.weight == 0 || total <= 0) {
+        if (total <= 0)
+          *this = PointStatistics();
+        return;
+      }
+      Vector2d delta = other.mean - mean;
+      mean = mean + delta * (other.weight / total);
+      m2 = m2 + other.m2 + delta * delta * (weight * other.weight / total);
+      weight = total;
+    }
+
+    Vector2d getStdev() const { return Vector2d(std::sqrt(m2.x / weight), std::sqrt(m2.y / weight)); }
+
+    double weight;
+    Vector2d mean;
+    Vector2d m2;
+  };
+
+  //!\brief Single pass statistics of a block of points
+  //! Points are summed relative to the first one, which vectorizes and stays accurate.
+  template <size_t Stride, typename T>
+  inline PointStatistics getBlockStatistics(const T* x, const T* y, size_t n, size_t stride)
+  {
+    if (Stride != 0)
+      stride = Stride;
+    const double kx = x[0], ky = y[0];
+    double sx = 0, sy = 0, qx = 0, qy = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const double dx = double(x[i*stride]) - kx;
+      const double dy = double(y[i*stride]) - ky;
+      sx += dx;
+      sy += dy;
+      qx += dx * dx;
+      qy += dy * dy;
+    }
+    PointStatistics partial;
+    partial.weight = double(n);
+    partial.mean = Vector2d(kx + sx / n, ky + sy / n);
+    partial.m2 = Vector2d(qx - sx * sx / n, qy - sy * sy / n);
+    return partial;
+  }
 
-    // Compose normalization
+  //!\brief Single pass statistics of a point buffer.
+  //! Block results are merged pairwise into the total.
+  template <typename T>
+  inline PointStatistics getPointStatistics(const Vector2View<T>& points)
+  {
+    const size_t block = 256;
+    PointStatistics total;
+    for (size_t begin = 0; begin < points.count; begin += block) {
+      const size_t n = std::min(block, points.count - begin);
+      const T* x = points.x + begin * points.stride;
+      const T* y = points.y + begin * points.stride;
+      // Dispatch the common layouts so their loops get a constant stride
+      if (points.stride == 1)
+        total.merge(getBlockStatistics<1>(x, y, n, 1));
+      else if (points.stride == 2)
+        total.merge(getBlockStatistics<2>(x, y, n, 2));
+      else
+        total.merge(getBlockStatistics<0>(x, y, n, points.stride));
+    }
+    return total;
+  }
+  inline PointStatistics getPointStatistics(const Vector2d* data, size_t count)
+  {
+    return count ? getPointStatistics(Vector2View<double>::Interleaved(&data[0].x, count)) : PointStatistics();
+  }
+
+  //!\brief As above, reducing large buffers in parallel (threads of 0 uses all available)
+  template <typename T>
+  inline PointStatistics getPointStatistics(const Vector2View<T>& points, size_t threads)
+  {
+    const size_t min_chunk = 1 << 15;
+    const size_t max_chunks = 64;
+    const size_t count = points.count;
+    const size_t chunks = std::min(std::min(threads == 0 ? ThreadPool::global().getThreadCount() : threads, count / min_chunk), max_chunks);
+    if (chunks <= 1)
+      return getPointStatistics(points);
+
+    // Partials are merged in chunk order so the result does not depend on scheduling
+    PointStatistics partial[max_chunks];
+    parallelFor(count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+      partial[chunk] = getPointStatistics(Vector2View<T>(
+        points.x + begin * points.stride, points.y + begin * points.stride, end - begin, points.stride));
+    });
+    for (size_t i = 1; i < chunks; ++i)
+      partial[0].merge(partial[i]);
+    return partial[0];
+  }
+  inline PointStatistics getPointStatistics(const Vector2d* data, size_t count, size_t threads)
+  {
+    return count ? getPointStatistics(Vector2View<double>::Interleaved(&data[0].x, count), threads) : PointStatistics();
+  }
+
+  inline void getHartleyNormalization(const Vector2d& mean, const Vector2d& stdev, Matrix3d& normalization)
+  {
+    const double sqrt2 = std::sqrt(2.0);
     normalization.Set(0.0);
-    normalization.a00 = std::sqrt(2) / stdev.x;
-    normalization.a11 = std::sqrt(2) / stdev.y;
+    normalization.a00 = sqrt2 / stdev.x;
+    normalization.a11 = sqrt2 / stdev.y;
     normalization.a22 = 1.0;
     normalization.a02 = -mean.x * normalization.a00;
     normalization.a12 = -mean.y * normalization.a11;
   }
+  inline void getHartleyNormalization(const PointStatistics& statistics, Matrix3d& normalization)
+  {
+    getHartleyNormalization(statistics.mean, statistics.getStdev(), normalization);
+  }
 
-  class Homography
+  inline void getHartleyNormalization(const Vector2d* data, size_t count, Matrix3d& normalization, size_t threads = 0)
+  {
+    getHartleyNormalization(getPointStatistics(data, count, threads), normalization);
+  }
+  inline void getHartleyNormalization(const std::vector<Vector2d>& data, Matrix3d& normalization, size_t threads = 0)
+  {
+    getHartleyNormalization(data.data(), data.size(), normalization, threads);
+  }
+  template <typename T>
+  inline void getHartleyNormalization(const Vector2View<T>& data, Matrix3d& normalization, size_t threads = 0)
+  {
+    getHartleyNormalization(getPointStatistics(data, threads), normalization);
+  }
+
+  //!\brief Add the two DLT equations of the correspondence l -> r to the normal matrix A^T A.
+  //! Only the upper triangle is updated, see solveHomography.
+  template <typename T>
+  inline void addHomographyEquations(const Vector2<T>& l, const Vector2<T>& r, MatrixN<T, 9>& ATA, T weight = T(1))
+  {
+    const T a[9] = { T(0), T(0), T(0), -l.x, -l.y, T(-1), r.y*l.x, r.y*l.y, r.y };
+    const T b[9] = { l.x, l.y, T(1), T(0), T(0), T(0), -r.x*l.x, -r.x*l.y, -r.x };
+    for (size_t i = 0; i < 9; ++i) {
+      const T wa = weight * a[i];
+      const T wb = weight * b[i];
+      for (size_t j = i; j < 9; ++j)
+        ATA(i, j) += wa * a[j] + wb * b[j];
+    }
+  }
+
+  //!\brief Undo the normalizations of the solution Hn, which maps normalized left points to normalized right points
+  template <typename T>
+  inline bool composeHomography(const Matrix3<T>& Hn, const Matrix3<T>& left_hartley, const Matrix3<T>& right_hartley, Matrix3<T>& H)
+  {
+    H = inverse(right_hartley) * Hn * left_hartley;
+    T scale = std::abs(H.a22) > std::numeric_limits<T>::epsilon() ? H.a22 :
+      std::sqrt(H.a00*H.a00 + H.a01*H.a01 + H.a02*H.a02 +
+                H.a10*H.a10 + H.a11*H.a11 + H.a12*H.a12 +
+                H.a20*H.a20 + H.a21*H.a21 + H.a22*H.a22);
+    H /= scale;
+
+    for (size_t i = 0; i < 9; ++i)
+      if (!std::isfinite(H[i]))
+        return false;
+    return true;
+  }
+
+  //!\brief Solve the normalized DLT system and undo the normalizations.
+  //! ATA holds the upper triangle of the normal matrix built from normalized points.
+  template <typename T>
+  inline bool solveHomography(MatrixN<T, 9> ATA, const Matrix3<T>& left_hartley, const Matrix3<T>& right_hartley, Matrix3<T>& H)
+  {
+    for (size_t i = 0; i < 9; ++i)
+      for (size_t j = 0; j < i; ++j)
+        ATA(i, j) = ATA(j, i);
+
+    VectorN<T, 9> h;
+    getNullVector(ATA, h);
+    return composeHomography(Matrix3<T>(h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], h[8]), left_hartley, right_hartley, H);
+  }
+
+  //!\brief Normalized DLT estimate of H such that right ~ H * left, for at least 4 points.
+  //! Works on the caller's buffers and does not allocate. Both views must have the same count.
+  template <typename T>
+  inline bool estimateHomography(const Vector2View<T>& left, const Vector2View<T>& right, Matrix3d& H)
+  {
+    const size_t count = left.count;
+    if (count < 4 || right.count != count)
+      return false;
+
+    // Calculate hartley normalization, applied on the fly below
+    Matrix3d right_hartley, left_hartley;
+    getHartleyNormalization(right, right_hartley);
+    getHartleyNormalization(left, left_hartley);
+
+    // Fill normal equations of the 2N x 9 system
+    MatrixN<double, 9> ATA;
+    ATA.Set(0.0);
+    for (size_t i = 0; i < count; ++i) {
+      const Vector2d l(left.x[i*left.stride], left.y[i*left.stride]);
+      const Vector2d r(right.x[i*right.stride], right.y[i*right.stride]);
+      addHomographyEquations(
+        toInhomogeneous(left_hartley*l),
+        toInhomogeneous(right_hartley*r), ATA);
+    }
+
+    return solveHomography(ATA, left_hartley, right_hartley, H);
+  }
+  inline bool estimateHomography(const Vector2d* left, const Vector2d* right, size_t count, Matrix3d& H)
+  {
+    if (count < 4)
+      return false;
+    return estimateHomography(
+      Vector2View<double>::Interleaved(&left[0].x, count),
+      Vector2View<double>::Interleaved(&right[0].x, count), H);
+  }
+
+  //!\brief Estimate one homography per correspondence set, set i being points [offsets[i], offsets[i + 1]).
+  //! Sets are spread over threads, and within a thread groups of sets share one lane batched
+  //! 9x9 solve. valid (optional) receives one flag per set. Returns the number of sets solved.
+  inline size_t estimateHomographies(const Vector2d* left, const Vector2d* right, const size_t* offsets, size_t set_count,
+    Matrix3d* H, uint8* valid = nullptr, size_t threads = 0)
+  {
+    const size_t lanes = 4;
+    const size_t groups = (set_count + lanes - 1) / lanes;
+    std::atomic<size_t> solved(0);
+
+    parallelFor(groups, threads, [&](size_t begin, size_t end, size_t) {
+      MatrixN<double, 81, lanes> ATA;
+      MatrixN<double, 9, lanes> h;
+      Matrix3d left_hartley[lanes], right_hartley[lanes];
+      size_t local_solved = 0;
+
+      for (size_t group = begin; group < end; ++group) {
+        const size_t first = group * lanes;
+        ATA.Set(0.0);
+        for (size_t l = 0; l < lanes; ++l) {
+          const size_t set = first + l;
+          const size_t count = set < set_count ? offsets[set + 1] - offsets[set] : 0;
+          if (count < 4) {
+            // Keep unused lanes well conditioned, their result is discarded
+            for (size_t i = 0; i < 9; ++i)
+              ATA(i*9 + i, l) = 1.0;
+            continue;
+          }
+          const Vector2d* l_pts = left + offsets[set];
+          const Vector2d* r_pts = right + offsets[set];
+          getHartleyNormalization(l_pts, count, left_hartley[l]);
+          getHartleyNormalization(r_pts, count, right_hartley[l]);
+
+          MatrixN<double, 9> lane;
+          lane.Set(0.0);
+          for (size_t i = 0; i < count; ++i)
+            addHomographyEquations(
+              toInhomogeneous(left_hartley[l]*l_pts[i]),
+              toInhomogeneous(right_hartley[l]*r_pts[i]), lane);
+          for (size_t i = 0; i < 9; ++i)
+            for (size_t j = 0; j < 9; ++j)
+              ATA(i*9 + j, l) = i <= j ? lane(i, j) : lane(j, i);
+        }
+
+        getNullVectors(ATA, h);
+
+        for (size_t l = 0; l < lanes && first + l < set_count; ++l) {
+          const size_t set = first + l;
+          bool ok = offsets[set + 1] - offsets[set] >= 4 && composeHomography(Matrix3d(
+            h(0, l), h(1, l), h(2, l), h(3, l), h(4, l), h(5, l), h(6, l), h(7, l), h(8, l)),
+            left_hartley[l], right_hartley[l], H[set]);
+          if (valid)
+            valid[set] = ok;
+          local_solved += ok;
+        }
+      }
+      solved += local_solved;
+    });
+    return solved;
+  }
+
+  //!\brief Streaming normal equations of the normalized DLT.
+  //! Correspondences are folded into running point statistics and two 9x9 moment matrices
+  //! of the raw equations. As the Hartley normalized equations are a fixed linear change of
+  //! variables (and a per-row scale) of the raw ones, estimate() rebuilds the normalized
+  //! system from these in constant time, independent of how many points were added.
+  class HomographyAccumulator
   {
   public:
-    Homography() {};
+    HomographyAccumulator() { clear(); }
 
-    void clear() {
-      left.clear();
-      right.clear();
+    void clear()
+    {
+      left_statistics = PointStatistics();
+      right_statistics = PointStatistics();
+      first_row.Set(0.0);
+      second_row.Set(0.0);
+      count = 0;
     }
 
-    template <typename T>
-    void addCorrespondence(const Vector2<T>& l, const Vector2<T>& r)
+    void add(const Vector2d& l, const Vector2d& r, double weight = 1.0)
     {
-      left.push_back(l);
-      right.push_back(r);
+      if (count == 0) {
+        // Accumulate relative to the first correspondence to keep the moments well scaled
+        left_origin = l;
+        right_origin = r;
+      }
+      const Vector2d lc = l - left_origin;
+      const Vector2d rc = r - right_origin;
+      left_statistics.add(lc, weight);
+      right_statistics.add(rc, weight);
+
+      const double a[9] = { 0, 0, 0, -lc.x, -lc.y, -1, rc.y*lc.x, rc.y*lc.y, rc.y };
+      const double b[9] = { lc.x, lc.y, 1, 0, 0, 0, -rc.x*lc.x, -rc.x*lc.y, -rc.x };
+      for (size_t i = 0; i < 9; ++i) {
+        const double wa = weight * a[i];
+        const double wb = weight * b[i];
+        for (size_t j = i; j < 9; ++j) {
+          first_row(i, j) += wa * a[j];
+          second_row(i, j) += wb * b[j];
+        }
+      }
+      count += weight > 0 ? 1 : -1;
+      if (count == 0)
+        clear();
     }
-    size_t getCorrespondenceCount() const { return left.size(); }
+    //!\brief Remove a correspondence added earlier with the same weight
+    void remove(const Vector2d& l, const Vector2d& r, double weight = 1.0) { add(l, r, -weight); }
+
+    //!\brief Scale the weight of everything accumulated so far, e.g. 0.9 per frame for exponential forgetting
+    void scale(double factor)
+    {
+      left_statistics.scale(factor);
+      right_statistics.scale(factor);
+      for (size_t i = 0; i < first_row.size; ++i) {
+        first_row[i] *= factor;
+        second_row[i] *= factor;
+      }
+    }
+
+    size_t getCount() const { return size_t(std::max<ptrdiff_t>(count, 0)); }
+    double getWeight() const { return left_statistics.weight; }
 
-    bool estimate(Matrix3d& H)
+    //!\brief Estimate H such that right ~ H * left from everything accumulated
+    bool estimate(Matrix3d& H) const
     {
-      if (left.size() < 4)
+      if (count < 4 || left_statistics.weight <= 0)
         return false;
 
-      // Calculate and apply hartley normalization
-      dry::Matrix3d right_hartley, left_hartley;
-      dry::getHartleyNormalization(right, right_hartley);
-      dry::getHartleyNormalization(left, left_hartley);
-      for (size_t i = 0; i < 30; ++i) {
-        right[i] = dry::toInhomogeneous(right_hartley*right[i]);
-        left[i] = dry::toInhomogeneous(left_hartley*left[i]);
+      // Normalizations of the origin relative points
+      Matrix3d left_hartley, right_hartley;
+      getHartleyNormalization(left_statistics, left_hartley);
+      getHartleyNormalization(right_statistics, right_hartley);
+      const Matrix3d right_inverse = inverse(right_hartley);
+
+      // Residuals of the normalized rows are the raw ones scaled by the other axis' scale
+      MatrixN<double, 9> M;
+      const double sx2 = right_hartley.a00 * right_hartley.a00;
+      const double sy2 = right_hartley.a11 * right_hartley.a11;
+      for (size_t i = 0; i < 9; ++i)
+        for (size_t j = i; j < 9; ++j)
+          M(i, j) = M(j, i) = sy2 * first_row(i, j) + sx2 * second_row(i, j);
+
+      // h = K * hn for H = right_hartley^-1 * Hn * left_hartley (row major vec)
+      MatrixN<double, 9> K;
+      for (size_t i = 0; i < 3; ++i)
+        for (size_t j = 0; j < 3; ++j)
+          for (size_t k = 0; k < 3; ++k)
+            for (size_t m = 0; m < 3; ++m)
+              K(i*3 + j, k*3 + m) = right_inverse(i, k) * left_hartley(m, j);
+
+      // Normal matrix of the normalized system, K^T * M * K
+      MatrixN<double, 9> MK, ATA;
+      MK.Set(0.0);
+      for (size_t i = 0; i < 9; ++i)
+        for (size_t k = 0; k < 9; ++k)
+          if (M(i, k) != 0)
+            for (size_t j = 0; j < 9; ++j)
+              MK(i, j) += M(i, k) * K(k, j);
+      for (size_t i = 0; i < 9; ++i) {
+        for (size_t j = i; j < 9; ++j) {
+          double sum = 0;
+          for (size_t k = 0; k < 9; ++k)
+            sum += K(k, i) * MK(k, j);
+          ATA(i, j) = sum;
+        }
       }
 
-      // Create matrix for homography estimation
-      MatrixXd A(left.size(), 6);
+      // Express the normalizations in terms of the original coordinates
+      left_hartley.a02 -= left_hartley.a00 * left_origin.x;
+      left_hartley.a12 -= left_hartley.a11 * left_origin.y;
+      right_hartley.a02 -= right_hartley.a00 * right_origin.x;
+      right_hartley.a12 -= right_hartley.a11 * right_origin.y;
+      return solveHomography(ATA, left_hartley, right_hartley, H);
+    }
+
+  private:
+    PointStatistics left_statistics;
+    PointStatistics right_statistics;
+    Vector2d left_origin;
+    Vector2d right_origin;
+    MatrixN<double, 9> first_row;
+    MatrixN<double, 9> second_row;
+    ptrdiff_t count;
+  };
+
+  class Homography
+  {
+  public:
+    Homography() : streaming(false) {};
 
-      // Fill it according to equations
+    //!\brief In streaming mode correspondences are folded into a HomographyAccumulator
+    //! instead of being stored, so estimate() costs the same for any number of points.
+    void setStreaming(bool enable)
+    {
+      clear();
+      streaming = enable;
+    }
+    bool isStreaming() const { return streaming; }
 
-      // Solve using SVD
+    void clear() {
+      left_x.clear();
+      left_y.clear();
+      right_x.clear();
+      right_y.clear();
+      external_float[0] = external_float[1] = Vector2View<float>();
+      external_double[0] = external_double[1] = Vector2View<double>();
+      accumulator.clear();
+    }
+    void reserve(size_t count)
+    {
+      left_x.reserve(count);
+      left_y.reserve(count);
+      right_x.reserve(count);
+      right_y.reserve(count);
+    }
 
-      // Set Homography matrix from h
-      return true;
+    template <typename T>
+    void addCorrespondence(const Vector2<T>& l, const Vector2<T>& r, double weight = 1.0)
+    {
+      if (streaming) {
+        accumulator.add(Vector2d(l.x, l.y), Vector2d(r.x, r.y), weight);
+        return;
+      }
+      left_x.push_back(l.x);
+      left_y.push_back(l.y);
+      right_x.push_back(r.x);
+      right_y.push_back(r.y);
+    }
+    //!\brief Streaming mode only, remove a correspondence added earlier with the same weight.
+    //! Does nothing otherwise.
+    template <typename T>
+    void removeCorrespondence(const Vector2<T>& l, const Vector2<T>& r, double weight = 1.0)
+    {
+      if (streaming)
+        accumulator.remove(Vector2d(l.x, l.y), Vector2d(r.x, r.y), weight);
+    }
+    //!\brief Streaming mode only, scale the weight of all correspondences added so far.
+    //! Does nothing otherwise.
+    void decay(double factor)
+    {
+      if (streaming)
+        accumulator.scale(factor);
+    }
+
+    //!\brief Use the caller's point buffers as the correspondences, without copying.
+    //! Replaces any stored correspondences and leaves streaming mode. The buffers must stay
+    //! valid until clear().
+    void setCorrespondences(const Vector2View<float>& l, const Vector2View<float>& r)
+    {
+      setStreaming(false);
+      external_float[0] = l;
+      external_float[1] = r;
+    }
+    void setCorrespondences(const Vector2View<double>& l, const Vector2View<double>& r)
+    {
+      setStreaming(false);
+      external_double[0] = l;
+      external_double[1] = r;
+    }
+
+    size_t getCorrespondenceCount() const
+    {
+      if (streaming)
+        return accumulator.getCount();
+      if (external_float[0].count)
+        return std::min(external_float[0].count, external_float[1].count);
+      if (external_double[0].count)
+        return std::min(external_double[0].count, external_double[1].count);
+      return left_x.size();
+    }
+
+    //!\brief Estimate H such that right ~ H * left
+    bool estimate(Matrix3d& H) const
+    {
+      if (streaming)
+        return accumulator.estimate(H);
+      if (external_float[0].count)
+        return estimateHomography(external_float[0], external_float[1], H);
+      if (external_double[0].count)
+        return estimateHomography(external_double[0], external_double[1], H);
+      return estimateHomography(
+        Vector2View<double>(left_x.data(), left_y.data(), left_x.size()),
+        Vector2View<double>(right_x.data(), right_y.data(), right_x.size()), H);
     }
 
   private:
 
-    std::vector<Vector2d> left;
-    std::vector<Vector2d> right;
+    std::vector<double> left_x;
+    std::vector<double> left_y;
+    std::vector<double> right_x;
+    std::vector<double> right_y;
+    Vector2View<float> external_float[2];
+    Vector2View<double> external_double[2];
+    HomographyAccumulator accumulator;
+    bool streaming;
   };
 }
\ No newline at end of file
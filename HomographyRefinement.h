@@ -0,0 +1,185 @@
+#pragma once
+
+#include "Homography.h"
+
+#include <cmath>
+#include <limits>
+
+namespace dry
+{
+  struct RefinementOptions
+  {
+    size_t max_iterations = 20;
+    double tolerance = 1e-10;   //!< Stop when the relative decrease of the cost falls below this
+    double lambda = 1e-3;       //!< Initial Levenberg-Marquardt damping
+  };
+
+  //!\brief Symmetric transfer error of H over the correspondences (optionally masked).
+  //! If JTJ and JTf are given, the upper triangle of J^T J and J^T f are filled as well.
+  //! The parameters are the first eight entries of H (row major) with H.a22 fixed to 1.
+  //! Correspondences are processed in blocks of lanes so the residual and Jacobian
+  //! evaluation is branch free and vectorizes over correspondences.
+  template <typename T>
+  inline double getTransferError(const Matrix3d& H, const Vector2View<T>& left, const Vector2View<T>& right,
+    const uint8* mask = nullptr, MatrixN<double, 8>* JTJ = nullptr, VectorN<double, 8>* JTf = nullptr)
+  {
+    const size_t W = 8;
+    const size_t count = std::min(left.count, right.count);
+    const Matrix3d G = inverse(H);
+    if (JTJ) {
+      JTJ->Set(0.0);
+      JTf->Set(0.0);
+    }
+
+    double cost = 0;
+    double lx[W], ly[W], rx[W], ry[W], w[W];
+    double f[4][W];
+    double J[4][8][W];
+    size_t i = 0;
+    while (i < count) {
+      // Gather the next block of (unmasked) correspondences, padding with weight zero
+      size_t n = 0;
+      for (; i < count && n < W; ++i) {
+        if (mask && !mask[i])
+          continue;
+        lx[n] = double(left.x[i*left.stride]);
+        ly[n] = double(left.y[i*left.stride]);
+        rx[n] = double(right.x[i*right.stride]);
+        ry[n] = double(right.y[i*right.stride]);
+        w[n] = 1.0;
+        ++n;
+      }
+      if (n == 0)
+        break;
+      for (size_t l = n; l < W; ++l) {
+        lx[l] = lx[0]; ly[l] = ly[0];
+        rx[l] = rx[0]; ry[l] = ry[0];
+        w[l] = 0.0;
+      }
+
+      for (size_t l = 0; l < W; ++l) {
+        // Forward transfer, left through H against right
+        const double p1 = H.a00*lx[l] + H.a01*ly[l] + H.a02;
+        const double p2 = H.a10*lx[l] + H.a11*ly[l] + H.a12;
+        const double p3 = H.a20*lx[l] + H.a21*ly[l] + H.a22;
+        const double iz = 1.0 / p3;
+        const double u = p1 * iz, v = p2 * iz;
+        f[0][l] = u - rx[l];
+        f[1][l] = v - ry[l];
+
+        J[0][0][l] = lx[l] * iz;  J[0][1][l] = ly[l] * iz;  J[0][2][l] = iz;
+        J[0][3][l] = 0;           J[0][4][l] = 0;           J[0][5][l] = 0;
+        J[0][6][l] = -u * lx[l] * iz;  J[0][7][l] = -u * ly[l] * iz;
+        J[1][0][l] = 0;           J[1][1][l] = 0;           J[1][2][l] = 0;
+        J[1][3][l] = lx[l] * iz;  J[1][4][l] = ly[l] * iz;  J[1][5][l] = iz;
+        J[1][6][l] = -v * lx[l] * iz;  J[1][7][l] = -v * ly[l] * iz;
+
+        // Backward transfer, right through G = H^-1 against left
+        const double q[3] = {
+          G.a00*rx[l] + G.a01*ry[l] + G.a02,
+          G.a10*rx[l] + G.a11*ry[l] + G.a12,
+          G.a20*rx[l] + G.a21*ry[l] + G.a22 };
+        const double jz = 1.0 / q[2];
+        const double s = q[0] * jz, t = q[1] * jz;
+        f[2][l] = s - lx[l];
+        f[3][l] = t - ly[l];
+
+        // dG/dh_k = -G E_k G, so dq/dh_k = -q_j * G(:, i) for k = 3i + j
+        for (size_t gi = 0; gi < 3; ++gi) {
+          const double cx = jz * (G(0, gi) - s * G(2, gi));
+          const double cy = jz * (G(1, gi) - t * G(2, gi));
+          for (size_t gj = 0; gj < 3 && 3 * gi + gj < 8; ++gj) {
+            J[2][3 * gi + gj][l] = -q[gj] * cx;
+            J[3][3 * gi + gj][l] = -q[gj] * cy;
+          }
+        }
+      }
+
+      for (size_t r = 0; r < 4; ++r)
+        for (size_t l = 0; l < W; ++l)
+          cost += w[l] * f[r][l] * f[r][l];
+
+      if (!JTJ)
+        continue;
+      for (size_t a = 0; a < 8; ++a) {
+        for (size_t b = a; b < 8; ++b) {
+          double sum = 0;
+          for (size_t r = 0; r < 4; ++r)
+            for (size_t l = 0; l < W; ++l)
+              sum += w[l] * J[r][a][l] * J[r][b][l];
+          (*JTJ)(a, b) += sum;
+        }
+        double sum = 0;
+        for (size_t r = 0; r < 4; ++r)
+          for (size_t l = 0; l < W; ++l)
+            sum += w[l] * J[r][a][l] * f[r][l];
+        (*JTf)[a] += sum;
+      }
+    }
+    return cost;
+  }
+
+  //!\brief Levenberg-Marquardt refinement of H minimizing the symmetric transfer error.
+  //! Only correspondences with a non-zero mask entry are used when a mask is given.
+  //! Returns false, leaving H untouched, if no improvement could be made.
+  template <typename T>
+  inline bool refineHomography(const Vector2View<T>& left, const Vector2View<T>& right, Matrix3d& H,
+    const uint8* mask = nullptr, const RefinementOptions& options = RefinementOptions())
+  {
+    if (std::abs(H.a22) <= std::numeric_limits<double>::epsilon())
+      return false;
+    Matrix3d current = H / H.a22;
+
+    MatrixN<double, 8> JTJ;
+    VectorN<double, 8> JTf;
+    double cost = getTransferError(current, left, right, mask, &JTJ, &JTf);
+    if (!std::isfinite(cost))
+      return false;
+    const double initial_cost = cost;
+
+    double lambda = options.lambda;
+    for (size_t iteration = 0; iteration < options.max_iterations && lambda < 1e10; ++iteration) {
+      MatrixN<double, 8> A = JTJ;
+      VectorN<double, 8> b, delta;
+      for (size_t i = 0; i < 8; ++i) {
+        A(i, i) += lambda * std::max(JTJ(i, i), 1e-12);
+        b[i] = -JTf[i];
+      }
+      if (!choleskySolve(A, b, delta)) {
+        lambda *= 10;
+        continue;
+      }
+
+      Matrix3d candidate = current;
+      for (size_t i = 0; i < 8; ++i)
+        candidate[i] += delta[i];
+      double candidate_cost = getTransferError(candidate, left, right, mask);
+      if (!(candidate_cost < cost)) {
+        lambda *= 10;
+        continue;
+      }
+
+      const double decrease = (cost - candidate_cost) / cost;
+      current = candidate;
+      cost = candidate_cost;
+      lambda = std::max(lambda * 0.1, 1e-12);
+      if (decrease < options.tolerance)
+        break;
+      cost = getTransferError(current, left, right, mask, &JTJ, &JTf);
+    }
+
+    if (!(cost < initial_cost))
+      return false;
+    H = current;
+    return true;
+  }
+  inline bool refineHomography(const Vector2d* left, const Vector2d* right, size_t count, Matrix3d& H,
+    const uint8* mask = nullptr, const RefinementOptions& options = RefinementOptions())
+  {
+    if (count == 0)
+      return false;
+    return refineHomography(
+      Vector2View<double>::Interleaved(&left[0].x, count),
+      Vector2View<double>::Interleaved(&right[0].x, count), H, mask, options);
+  }
+}
\ No newline at end of file
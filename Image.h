@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Types.h"
+
+namespace dry
+{
+  //!\brief Non-owning view of an interleaved image.
+  //! stride is the distance between rows in elements, 0 means tightly packed rows.
+  template <typename T>
+  class ImageView
+  {
+  public:
+    ImageView() : data(nullptr), width(0), height(0), channels(1), stride(0) {}
+    ImageView(T* data, size_t width, size_t height, size_t channels = 1, size_t stride = 0)
+      : data(data), width(width), height(height), channels(channels), stride(stride ? stride : width * channels) {}
+
+    T* row(size_t y) const { return data + y * stride; }
+    T& operator()(size_t x, size_t y, size_t c = 0) const { return data[y * stride + x * channels + c]; }
+
+    T* data;
+    size_t width;
+    size_t height;
+    size_t channels;
+    size_t stride;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Image.h"
+#include "MatrixOperations.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <type_traits>
+
+namespace dry
+{
+  enum class Interpolation
+  {
+    Nearest,
+    Bilinear
+  };
+
+  //!\brief Bilinear interpolation with 11 bit fixed point weights wx, wy in [0, 2048]
+  inline void interpolateBilinear(const uint8* p00, const uint8* p01, const uint8* p10, const uint8* p11,
+    int32 wx, int32 wy, size_t channels, uint8* out)
+  {
+    // The products stay within 32 bits
+    for (size_t c = 0; c < channels; ++c) {
+      const int32 top = p00[c] * (2048 - wx) + p01[c] * wx;
+      const int32 bottom = p10[c] * (2048 - wx) + p11[c] * wx;
+      out[c] = uint8((top * (2048 - wy) + bottom * wy + (1 << 21)) >> 22);
+    }
+  }
+  inline void interpolateBilinear(const uint8* p00, const uint8* p01, const uint8* p10, const uint8* p11,
+    float fx, float fy, size_t channels, uint8* out)
+  {
+    interpolateBilinear(p00, p01, p10, p11, int32(fx * 2048.0f + 0.5f), int32(fy * 2048.0f + 0.5f), channels, out);
+  }
+  inline void interpolateBilinear(const float32* p00, const float32* p01, const float32* p10, const float32* p11,
+    int32 wx, int32 wy, size_t channels, float32* out)
+  {
+    const float32 scale = 1.0f / 2048.0f;
+    for (size_t c = 0; c < channels; ++c) {
+      const float32 top = p00[c] + (p01[c] - p00[c]) * (float32(wx) * scale);
+      const float32 bottom = p10[c] + (p11[c] - p10[c]) * (float32(wx) * scale);
+      out[c] = top + (bottom - top) * (float32(wy) * scale);
+    }
+  }
+  inline void interpolateBilinear(const float32* p00, const float32* p01, const float32* p10, const float32* p11,
+    float fx, float fy, size_t channels, float32* out)
+  {
+    for (size_t c = 0; c < channels; ++c) {
+      const float32 top = p00[c] + (p01[c] - p00[c]) * fx;
+      const float32 bottom = p10[c] + (p11[c] - p10[c]) * fx;
+      out[c] = top + (bottom - top) * fy;
+    }
+  }
+
+  //!\brief Resample src into dst through the homography H, which maps src pixels to dst pixels.
+  //! dst is processed in tiles on the thread pool (threads of 0 uses all available). Along each
+  //! tile row the source position is updated incrementally, so a pixel costs three additions
+  //! and a divide. Pixels that map outside src, or behind the plane, are set to border.
+  //! Does nothing if src and dst differ in their number of channels.
+  template <typename T, typename S, typename P>
+  inline void warpPerspective(const ImageView<S>& src, const ImageView<P>& dst, const Matrix3<T>& H,
+    Interpolation interpolation = Interpolation::Bilinear, P border = P(0), size_t threads = 0)
+  {
+    static_assert(std::is_same<typename std::remove_const<S>::type, P>::value, "source and destination pixel types differ");
+    if (dst.width == 0 || dst.height == 0 || src.channels != dst.channels)
+      return;
+
+    const Matrix3<T> Hi = inverse(H);
+    const size_t channels = dst.channels;
+    const size_t tile_width = 256;
+    const size_t tile_height = 16;
+    const size_t tiles_x = (dst.width + tile_width - 1) / tile_width;
+    const size_t tiles_y = (dst.height + tile_height - 1) / tile_height;
+    const T max_x = T(src.width) - 1;
+    const T max_y = T(src.height) - 1;
+
+    ThreadPool::global().run(tiles_x * tiles_y, threads, [&](size_t tile) {
+      const size_t x_begin = (tile % tiles_x) * tile_width;
+      const size_t x_end = std::min(x_begin + tile_width, dst.width);
+      const size_t y_begin = (tile / tiles_x) * tile_height;
+      const size_t y_end = std::min(y_begin + tile_height, dst.height);
+
+      for (size_t y = y_begin; y < y_end; ++y) {
+        P* out = dst.row(y) + x_begin * channels;
+        T u = Hi.a00 * T(x_begin) + Hi.a01 * T(y) + Hi.a02;
+        T v = Hi.a10 * T(x_begin) + Hi.a11 * T(y) + Hi.a12;
+        T w = Hi.a20 * T(x_begin) + Hi.a21 * T(y) + Hi.a22;
+
+        for (size_t x = x_begin; x < x_end; ++x, out += channels, u += Hi.a00, v += Hi.a10, w += Hi.a20) {
+          const T iw = T(1) / w;
+          const T sx = u * iw;
+          const T sy = v * iw;
+          if (!(w > T(0) && sx >= T(-0.5) && sy >= T(-0.5) && sx < max_x + T(0.5) && sy < max_y + T(0.5))) {
+            for (size_t c = 0; c < channels; ++c)
+              out[c] = border;
+            continue;
+          }
+
+          if (interpolation == Interpolation::Nearest) {
+            const S* p = &src(size_t(sx + T(0.5)), size_t(sy + T(0.5)));
+            for (size_t c = 0; c < channels; ++c)
+              out[c] = p[c];
+            continue;
+          }
+
+          // Clamp to the image so the half pixel border replicates the edge
+          const T cx = std::min(std::max(sx, T(0)), max_x);
+          const T cy = std::min(std::max(sy, T(0)), max_y);
+          const size_t x0 = size_t(cx), y0 = size_t(cy);
+          const size_t x1 = std::min(x0 + 1, src.width - 1), y1 = std::min(y0 + 1, src.height - 1);
+          const S* r0 = src.row(y0);
+          const S* r1 = src.row(y1);
+          interpolateBilinear(
+            r0 + x0 * channels, r0 + x1 * channels, r1 + x0 * channels, r1 + x1 * channels,
+            float(cx - T(x0)), float(cy - T(y0)), channels, out);
+        }
+      }
+    });
+  }
+}
\ No newline at end of file
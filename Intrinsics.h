@@ -0,0 +1,372 @@
+#pragma once
+
+#include "Image.h"
+#include "ImageWarp.h"
+#include "Matrix.h"
+#include "Parallel.h"
+#include "Vector.h"
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace dry
+{
+  //!\brief Pinhole intrinsics with radial (k1, k2, k3) and tangential (p1, p2) lens distortion.
+  //! The constructor takes the distortion in the common k1, k2, p1, p2, k3 order.
+  template <typename T>
+  class Intrinsics
+  {
+  public:
+    Intrinsics() : fx(1), fy(1), cx(0), cy(0), k1(0), k2(0), k3(0), p1(0), p2(0) {}
+    Intrinsics(const T& fx, const T& fy, const T& cx, const T& cy,
+      const T& k1 = T(0), const T& k2 = T(0), const T& p1 = T(0), const T& p2 = T(0), const T& k3 = T(0))
+      : fx(fx), fy(fy), cx(cx), cy(cy), k1(k1), k2(k2), k3(k3), p1(p1), p2(p2) {}
+
+    template <typename U>
+    Intrinsics(const Intrinsics<U>& other)
+      : fx(T(other.fx)), fy(T(other.fy)), cx(T(other.cx)), cy(T(other.cy))
+      , k1(T(other.k1)), k2(T(other.k2)), k3(T(other.k3)), p1(T(other.p1)), p2(T(other.p2)) {}
+
+    bool hasDistortion() const { return k1 != T(0) || k2 != T(0) || k3 != T(0) || p1 != T(0) || p2 != T(0); }
+
+    template <typename U>
+    bool operator==(const Intrinsics<U>& other) const
+    {
+      return fx == other.fx && fy == other.fy && cx == other.cx && cy == other.cy &&
+        k1 == other.k1 && k2 == other.k2 && k3 == other.k3 && p1 == other.p1 && p2 == other.p2;
+    }
+    template <typename U>
+    bool operator!=(const Intrinsics<U>& other) const { return !(*this == other); }
+
+    T fx;  T fy;
+    T cx;  T cy;
+    T k1;  T k2;  T k3;
+    T p1;  T p2;
+  };
+
+  typedef Intrinsics<float32> Intrinsicsf;
+  typedef Intrinsics<float64> Intrinsicsd;
+
+  template <typename T>
+  inline Matrix3<T> getCalibrationMatrix(const Intrinsics<T>& K)
+  {
+    return Matrix3<T>(
+      K.fx, 0, K.cx,
+      0, K.fy, K.cy,
+      0, 0, 1);
+  }
+
+  //!\brief Apply the lens distortion to a normalized image point
+  template <typename T>
+  inline Vector2<T> distort(const Intrinsics<T>& K, const Vector2<T>& p)
+  {
+    const T x2 = p.x * p.x, y2 = p.y * p.y, xy = p.x * p.y, r2 = x2 + y2;
+    const T radial = 1 + r2 * (K.k1 + r2 * (K.k2 + r2 * K.k3));
+    return Vector2<T>(
+      p.x * radial + 2 * K.p1 * xy + K.p2 * (r2 + 2 * x2),
+      p.y * radial + K.p1 * (r2 + 2 * y2) + 2 * K.p2 * xy);
+  }
+
+  //!\brief Remove the lens distortion from a normalized image point (Newton's method)
+  template <typename T>
+  inline Vector2<T> undistort(const Intrinsics<T>& K, const Vector2<T>& d, size_t iterations = 5)
+  {
+    const T eps2 = std::numeric_limits<T>::epsilon() * std::numeric_limits<T>::epsilon();
+    T x = d.x, y = d.y;
+    for (size_t i = 0; i < iterations; ++i) {
+      const T x2 = x * x, y2 = y * y, xy = x * y, r2 = x2 + y2;
+      const T radial = 1 + r2 * (K.k1 + r2 * (K.k2 + r2 * K.k3));
+      const T dradial = 2 * K.k1 + r2 * (4 * K.k2 + 6 * K.k3 * r2);
+      const T ex = x * radial + 2 * K.p1 * xy + K.p2 * (r2 + 2 * x2) - d.x;
+      const T ey = y * radial + K.p1 * (r2 + 2 * y2) + 2 * K.p2 * xy - d.y;
+      // The Jacobian of the distortion is symmetric
+      const T j00 = radial + dradial * x2 + 2 * K.p1 * y + 6 * K.p2 * x;
+      const T j01 = dradial * xy + 2 * K.p1 * x + 2 * K.p2 * y;
+      const T j11 = radial + dradial * y2 + 6 * K.p1 * y + 2 * K.p2 * x;
+      const T det = j00 * j11 - j01 * j01;
+      if (det == T(0))
+        break;
+      const T sx = (j11 * ex - j01 * ey) / det;
+      const T sy = (j00 * ey - j01 * ex) / det;
+      x -= sx;
+      y -= sy;
+      if (sx * sx + sy * sy <= eps2 * (x * x + y * y + 1))
+        break;
+    }
+    return Vector2<T>(x, y);
+  }
+
+  //!\brief Distorted pixel positions of normalized image points, dst may alias src.
+  //! Large batches are split over the thread pool (threads of 0 uses all available).
+  template <typename T>
+  inline void distortPoints(const Intrinsics<T>& K, const Vector2<T>* normalized, Vector2<T>* pixels, size_t count, size_t threads = 0)
+  {
+    const size_t min_chunk = 1 << 14;
+    const size_t chunks = std::max(size_t(1), std::min(threads == 0 ? ThreadPool::global().getThreadCount() : threads, count / min_chunk));
+    parallelFor(count, chunks, [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i) {
+        const Vector2<T> d = distort(K, normalized[i]);
+        pixels[i] = Vector2<T>(K.fx * d.x + K.cx, K.fy * d.y + K.cy);
+      }
+    });
+  }
+
+  //!\brief Normalized undistorted image points of distorted pixel positions, dst may alias src
+  template <typename T>
+  inline void undistortPoints(const Intrinsics<T>& K, const Vector2<T>* pixels, Vector2<T>* normalized, size_t count,
+    size_t iterations = 5, size_t threads = 0)
+  {
+    const T ifx = T(1) / K.fx, ify = T(1) / K.fy;
+    const size_t min_chunk = 1 << 12;
+    const size_t chunks = std::max(size_t(1), std::min(threads == 0 ? ThreadPool::global().getThreadCount() : threads, count / min_chunk));
+    parallelFor(count, chunks, [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i)
+        normalized[i] = undistort(K, Vector2<T>((pixels[i].x - K.cx) * ifx, (pixels[i].y - K.cy) * ify), iterations);
+    });
+  }
+
+  //!\brief Per-pixel undistortion tables of one camera, built once and reused across frames.
+  //! The point table holds the normalized undistorted position of every pixel, so undistorting
+  //! a point is a bilinear lookup instead of an iterative solve. The image table holds, for every
+  //! pixel of the undistorted image, its source position in the distorted image, either as floats
+  //! or as integer pixels with 11 bit fixed point bilinear weights.
+  class UndistortionMap
+  {
+  public:
+    enum class Storage
+    {
+      Float,
+      Fixed
+    };
+
+    UndistortionMap() : width(0), height(0), storage(Storage::Float) {}
+
+    //!\brief Tabulate the distortion of camera over a width x height image.
+    //! The undistorted image uses the pinhole camera target, which defaults to camera without
+    //! distortion. Fixed storage is limited to images of at most 32767 pixels per side.
+    template <typename T>
+    bool build(const Intrinsics<T>& camera, size_t width, size_t height, Storage storage = Storage::Float, size_t threads = 0)
+    {
+      Intrinsicsd target(camera.fx, camera.fy, camera.cx, camera.cy);
+      return build(camera, target, width, height, storage, threads);
+    }
+    template <typename T, typename U>
+    bool build(const Intrinsics<T>& camera, const Intrinsics<U>& target, size_t width, size_t height,
+      Storage storage = Storage::Float, size_t threads = 0)
+    {
+      if (storage == Storage::Fixed && (width > 32767 || height > 32767))
+        return false;
+      this->camera = camera;
+      this->target = Intrinsicsd(target.fx, target.fy, target.cx, target.cy);
+      this->width = width;
+      this->height = height;
+      this->storage = storage;
+
+      const size_t count = width * height;
+      points.resize(count);
+      if (storage == Storage::Float) {
+        map_x.resize(count);
+        map_y.resize(count);
+        fixed.clear();
+      }
+      else {
+        fixed.resize(count);
+        map_x.clear();
+        map_y.clear();
+      }
+
+      const Intrinsicsd& K = this->camera;
+      const double ifx = 1.0 / K.fx, ify = 1.0 / K.fy;
+      const double itfx = 1.0 / this->target.fx, itfy = 1.0 / this->target.fy;
+      parallelFor(height, threads == 0 ? ThreadPool::global().getThreadCount() : threads, [&](size_t begin, size_t end, size_t) {
+        for (size_t y = begin; y < end; ++y) {
+          for (size_t x = 0; x < width; ++x) {
+            const size_t i = y * width + x;
+            // Distorted pixel to normalized undistorted position, solved once per pixel
+            const Vector2d p = undistort(K, Vector2d((double(x) - K.cx) * ifx, (double(y) - K.cy) * ify), 20);
+            points[i] = Vector2f(float32(p.x), float32(p.y));
+
+            // Undistorted target pixel to its distorted source position
+            const Vector2d d = distort(K, Vector2d((double(x) - this->target.cx) * itfx, (double(y) - this->target.cy) * itfy));
+            const double sx = K.fx * d.x + K.cx, sy = K.fy * d.y + K.cy;
+            if (storage == Storage::Float) {
+              map_x[i] = float32(sx);
+              map_y[i] = float32(sy);
+            }
+            else
+              fixed[i] = getFixedEntry(sx, sy);
+          }
+        }
+      });
+      return true;
+    }
+
+    //!\brief Whether the tables were built for the given camera, target and image size
+    template <typename T, typename U>
+    bool matches(const Intrinsics<T>& camera, const Intrinsics<U>& target, size_t width, size_t height) const
+    {
+      return this->width == width && this->height == height && Intrinsicsd(camera) == this->camera &&
+        Intrinsicsd(target.fx, target.fy, target.cx, target.cy) == this->target;
+    }
+    //!\brief Whether the tables were built for the given camera and image size with the default
+    //! target, the camera without distortion
+    template <typename T>
+    bool matches(const Intrinsics<T>& camera, size_t width, size_t height) const
+    {
+      return matches(camera, Intrinsicsd(camera.fx, camera.fy, camera.cx, camera.cy), width, height);
+    }
+
+    size_t getWidth() const { return width; }
+    size_t getHeight() const { return height; }
+    Storage getStorage() const { return storage; }
+
+    //!\brief Normalized undistorted image point of a distorted pixel position.
+    //! Positions outside the image fall back to the iterative solve.
+    template <typename T>
+    Vector2<T> undistortPoint(const Vector2<T>& pixel) const
+    {
+      if (!(pixel.x >= T(0) && pixel.y >= T(0) && pixel.x <= T(width - 1) && pixel.y <= T(height - 1)) || width < 2 || height < 2) {
+        const Intrinsics<T> K(camera);
+        return undistort(K, Vector2<T>((pixel.x - K.cx) / K.fx, (pixel.y - K.cy) / K.fy), 20);
+      }
+      const size_t x0 = std::min(size_t(pixel.x), width - 2), y0 = std::min(size_t(pixel.y), height - 2);
+      const float32 fx = float32(pixel.x - T(x0)), fy = float32(pixel.y - T(y0));
+      const Vector2f* p0 = &points[y0 * width + x0];
+      const Vector2f* p1 = p0 + width;
+      const float32 top_x = p0[0].x + (p0[1].x - p0[0].x) * fx;
+      const float32 top_y = p0[0].y + (p0[1].y - p0[0].y) * fx;
+      const float32 bottom_x = p1[0].x + (p1[1].x - p1[0].x) * fx;
+      const float32 bottom_y = p1[0].y + (p1[1].y - p1[0].y) * fx;
+      return Vector2<T>(T(top_x + (bottom_x - top_x) * fy), T(top_y + (bottom_y - top_y) * fy));
+    }
+
+    //!\brief Batched undistortPoint, dst may alias src
+    template <typename T>
+    void undistortPoints(const Vector2<T>* pixels, Vector2<T>* normalized, size_t count, size_t threads = 0) const
+    {
+      const size_t min_chunk = 1 << 14;
+      const size_t chunks = std::max(size_t(1), std::min(threads == 0 ? ThreadPool::global().getThreadCount() : threads, count / min_chunk));
+      parallelFor(count, chunks, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+          normalized[i] = undistortPoint(pixels[i]);
+      });
+    }
+
+    //!\brief Resample the distorted image src into the undistorted image dst.
+    //! Both images must have the size of the map and the same number of channels, otherwise
+    //! nothing is done. Pixels whose source lies outside src are set to border.
+    template <typename S, typename P>
+    void undistortImage(const ImageView<S>& src, const ImageView<P>& dst,
+      Interpolation interpolation = Interpolation::Bilinear, P border = P(0), size_t threads = 0) const
+    {
+      static_assert(std::is_same<typename std::remove_const<S>::type, P>::value, "source and destination pixel types differ");
+      if (dst.width != width || dst.height != height || src.width != width || src.height != height || width == 0 ||
+        src.channels != dst.channels)
+        return;
+
+      const size_t channels = dst.channels;
+      const size_t step_x = src.width > 1 ? channels : 0;
+      const size_t step_y = src.height > 1 ? src.stride : 0;
+      const float32 max_x = float32(src.width) - 1, max_y = float32(src.height) - 1;
+      const size_t rows_per_task = 16;
+      const size_t tasks = (height + rows_per_task - 1) / rows_per_task;
+      ThreadPool::global().run(tasks, threads, [&](size_t task) {
+        const size_t y_end = std::min(height, (task + 1) * rows_per_task);
+        for (size_t y = task * rows_per_task; y < y_end; ++y) {
+          P* out = dst.row(y);
+          for (size_t x = 0; x < width; ++x, out += channels) {
+            const size_t i = y * width + x;
+            if (storage == Storage::Fixed) {
+              const FixedEntry& e = fixed[i];
+              if (e.x < 0) {
+                for (size_t c = 0; c < channels; ++c)
+                  out[c] = border;
+                continue;
+              }
+              const S* p = &src(size_t(e.x), size_t(e.y));
+              if (interpolation == Interpolation::Nearest) {
+                const S* q = p + (e.wx >= 1024 ? step_x : 0) + (e.wy >= 1024 ? step_y : 0);
+                for (size_t c = 0; c < channels; ++c)
+                  out[c] = q[c];
+              }
+              else
+                interpolateBilinear(p, p + step_x, p + step_y, p + step_x + step_y, int32(e.wx), int32(e.wy), channels, out);
+              continue;
+            }
+
+            const float32 sx = map_x[i], sy = map_y[i];
+            if (!(sx >= -0.5f && sy >= -0.5f && sx < max_x + 0.5f && sy < max_y + 0.5f)) {
+              for (size_t c = 0; c < channels; ++c)
+                out[c] = border;
+              continue;
+            }
+            if (interpolation == Interpolation::Nearest) {
+              const S* p = &src(size_t(sx + 0.5f), size_t(sy + 0.5f));
+              for (size_t c = 0; c < channels; ++c)
+                out[c] = p[c];
+              continue;
+            }
+            // Clamp to the image so the half pixel border replicates the edge
+            const float32 cx = std::min(std::max(sx, 0.0f), max_x);
+            const float32 cy = std::min(std::max(sy, 0.0f), max_y);
+            const size_t x0 = size_t(cx), y0 = size_t(cy);
+            const size_t x1 = std::min(x0 + 1, src.width - 1), y1 = std::min(y0 + 1, src.height - 1);
+            const S* r0 = src.row(y0);
+            const S* r1 = src.row(y1);
+            interpolateBilinear(
+              r0 + x0 * channels, r0 + x1 * channels, r1 + x0 * channels, r1 + x1 * channels,
+              cx - float32(x0), cy - float32(y0), channels, out);
+          }
+        }
+      });
+    }
+
+  private:
+    //!\brief Top left source pixel and 11 bit bilinear weights, x of -1 marks a pixel outside the image
+    struct FixedEntry
+    {
+      int16 x;
+      int16 y;
+      uint16 wx;
+      uint16 wy;
+    };
+
+    FixedEntry getFixedEntry(double sx, double sy) const
+    {
+      FixedEntry e = { -1, -1, 0, 0 };
+      const double max_x = double(width) - 1, max_y = double(height) - 1;
+      if (!(sx >= -0.5 && sy >= -0.5 && sx < max_x + 0.5 && sy < max_y + 0.5))
+        return e;
+      // Clamp so the half pixel border replicates the edge, and keep x + 1 inside the image
+      const double cx = std::min(std::max(sx, 0.0), max_x);
+      const double cy = std::min(std::max(sy, 0.0), max_y);
+      size_t x0 = size_t(cx), y0 = size_t(cy);
+      int32 wx = int32((cx - double(x0)) * 2048.0 + 0.5);
+      int32 wy = int32((cy - double(y0)) * 2048.0 + 0.5);
+      if (x0 + 1 >= width && width > 1) {
+        x0 = width - 2;
+        wx = 2048;
+      }
+      if (y0 + 1 >= height && height > 1) {
+        y0 = height - 2;
+        wy = 2048;
+      }
+      e.x = int16(x0);
+      e.y = int16(y0);
+      e.wx = uint16(wx);
+      e.wy = uint16(wy);
+      return e;
+    }
+
+    Intrinsicsd camera;
+    Intrinsicsd target;
+    size_t width;
+    size_t height;
+    Storage storage;
+    std::vector<Vector2f> points;
+    std::vector<float32> map_x, map_y;
+    std::vector<FixedEntry> fixed;
+  };
+}
\ No newline at end of file
@@ -1,49 +1,111 @@
 #pragma once
+#include "Expression.h"
+#include "Storage.h"
 #include "Types.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
 namespace dry
 {
   //!\brief General data container
   template <typename T>
-  class MatrixX
+  class MatrixX : public DynamicStorage<T>
   {
   public:
-    MatrixX(size_t N, size_t M) 
-      : rows(N), cols(M), size(N*M)
+    using DynamicStorage<T>::v;
+    using DynamicStorage<T>::size;
+
+    MatrixX() : rows(0), cols(0) {}
+    MatrixX(size_t N, size_t M)
+      : DynamicStorage<T>(N*M), rows(N), cols(M) {}
+    //!\brief Elements in an arena, as are the buffers of later resizes.
+    //! The matrix must not be used after the arena is reset or rewound past it.
+    MatrixX(size_t N, size_t M, Arena& arena)
+      : DynamicStorage<T>(N*M, arena), rows(N), cols(M) {}
+    explicit MatrixX(Arena& arena)
+      : DynamicStorage<T>(0, arena), rows(0), cols(0) {}
+
+    MatrixX(const MatrixX& other) = default;
+    MatrixX(MatrixX&& other) noexcept
+      : DynamicStorage<T>(static_cast<DynamicStorage<T>&&>(other)), rows(other.rows), cols(other.cols)
     {
-      v = new T[size];
+      other.rows = 0;
+      other.cols = 0;
     }
 
     template <typename U>
     MatrixX(const MatrixX<U>& other)
-      : rows(other.rows), cols(other.cols), size(other.size)
+      : DynamicStorage<T>(other.size), rows(other.rows), cols(other.cols)
     {
-      v = new T[size];
-      T* ptr = v;
-      T* ptr_end = v + size;
-      U* ptr_other = other.v;
-      while (ptr != ptr_end)
-        *ptr++ *= T(*ptr_other++);
+      for (size_t i = 0; i < size; ++i)
+        v[i] = T(other.v[i]);
+    }
+
+    //!\brief Evaluate an elementwise expression such as a*s + b - c
+    template <typename E>
+    MatrixX(const Expression<E>& e)
+      : DynamicStorage<T>(e.derived().getRows() * e.derived().getCols()), rows(e.derived().getRows()), cols(e.derived().getCols())
+    {
+      evaluate(e, v);
+    }
+
+    MatrixX& operator=(const MatrixX& other) = default;
+    MatrixX& operator=(MatrixX&& other) noexcept
+    {
+      DynamicStorage<T>::operator=(static_cast<DynamicStorage<T>&&>(other));
+      rows = other.rows;
+      cols = other.cols;
+      other.rows = 0;
+      other.cols = 0;
       return *this;
     }
+    //!\brief Evaluate an expression, which may refer to this matrix, without a temporary.
+    //! Only a result that outgrows the buffer is written to a new one, as the old one may
+    //! still be read by the expression.
+    template <typename E>
+    MatrixX& operator=(const Expression<E>& e)
+    {
+      const size_t N = e.derived().getRows(), M = e.derived().getCols();
+      if (N*M > this->getCapacity()) {
+        MatrixX result = this->getArena() ? MatrixX(N, M, *this->getArena()) : MatrixX(N, M);
+        evaluate(e, result.v);
+        swap(result);
+      }
+      else {
+        resize(N, M);
+        evaluate(e, v);
+      }
+      return *this;
+    }
+
+    void swap(MatrixX& other) noexcept
+    {
+      this->swapStorage(other);
+      std::swap(rows, other.rows);
+      std::swap(cols, other.cols);
+    }
 
-    ~MatrixX()
+    //!\brief Change the shape, the elements are unspecified afterwards.
+    //! Keeps the buffer when it is large enough so workspaces can be reused.
+    void resize(size_t N, size_t M)
     {
-      delete[] v;
+      this->allocate(N*M);
+      rows = N;
+      cols = M;
     }
 
-    T& operator()(size_t r, size_t c) { return v[r*N + c]; }
-    const T& operator()(size_t r, size_t c) const { return v[r*N + c]; }
+    T& operator()(size_t r, size_t c) { return v[r*cols + c]; }
+    const T& operator()(size_t r, size_t c) const { return v[r*cols + c]; }
 
     T& operator[](size_t idx) { return v[idx]; }
     const T& operator[](size_t idx) const { return v[idx]; }
 
-    T* v;
     size_t rows;
     size_t cols;
-    size_t size;
 
     template <typename U>
-    MatrixX operator*=(U f)
+    MatrixX& operator*=(U f)
     {
       T* ptr = v;
       T* ptr_end = v + size;
@@ -52,7 +114,7 @@ namespace dry
       return *this;
     }
     template <typename U>
-    MatrixX operator/=(U f)
+    MatrixX& operator/=(U f)
     {
       T* ptr = v;
       T* ptr_end = v + size;
@@ -61,7 +123,7 @@ namespace dry
       return *this;
     }
     template <typename U>
-    MatrixX operator+=(U f)
+    typename std::enable_if<!ExpressionOperand<U>::value, MatrixX&>::type operator+=(U f)
     {
       T* ptr = v;
       T* ptr_end = v + size;
@@ -70,7 +132,7 @@ namespace dry
       return *this;
     }
     template <typename U>
-    MatrixX operator-=(U f)
+    typename std::enable_if<!ExpressionOperand<U>::value, MatrixX&>::type operator-=(U f)
     {
       T* ptr = v;
       T* ptr_end = v + size;
@@ -79,8 +141,20 @@ namespace dry
       return *this;
     }
     template <typename U>
+    typename std::enable_if<ExpressionOperand<U>::value, MatrixX&>::type operator+=(const U& other)
+    {
+      return *this = *this + other;
+    }
+    template <typename U>
+    typename std::enable_if<ExpressionOperand<U>::value, MatrixX&>::type operator-=(const U& other)
+    {
+      return *this = *this - other;
+    }
+    template <typename U>
     bool operator==(const MatrixX<U>& other) const
     {
+      if (rows != other.rows || cols != other.cols)
+        return false;
       const T* ptr = v;
       const T* ptr_end = v + size;
       const U* ptr_other = other.v;
@@ -95,9 +169,9 @@ namespace dry
       return !(*this == other);
     }
 
-    static MatrixX Identity() {
-      MatrixX m;
-      std::memset(&m, 0, sizeof(T)*size);
+    static MatrixX Identity(size_t N, size_t M) {
+      MatrixX m(N, M);
+      m.Set(T(0));
       for (size_t i = 0; i < std::min(N, M); ++i)
         m(i, i) = T(1);
       return m;
@@ -109,6 +183,20 @@ namespace dry
     }
   };
 
+  template <typename T>
+  inline void swap(MatrixX<T>& a, MatrixX<T>& b) noexcept
+  {
+    a.swap(b);
+  }
+
+  template <typename T>
+  struct ExpressionOperand<MatrixX<T>>
+  {
+    static const bool value = true;
+    typedef ArrayExpression<T> Type;
+    static Type get(const MatrixX<T>& m) { return Type(m.v, m.rows, m.cols); }
+  };
+
   //!\brief Fix size containers
   template <typename T>
   class Matrix2
@@ -240,7 +328,7 @@ namespace dry
       return *this;
     }
     template <typename U>
-    bool operator==(const Matrix2<U>& other) const
+    bool operator==(const Matrix3<U>& other) const
     {
       return a00 == other.a00 && a01 == other.a01 && a02 == other.a02 &&
              a10 == other.a10 && a11 == other.a11 && a12 == other.a12 &&
@@ -340,6 +428,39 @@ namespace dry
     }
   };
 
+  //!\brief Fix size container for the larger systems used by the solvers
+  template <typename T, size_t R, size_t C = R>
+  class MatrixN
+  {
+  public:
+    MatrixN() {}
+
+    T& operator()(size_t r, size_t c) { return v[r*C + c]; }
+    const T& operator()(size_t r, size_t c) const { return v[r*C + c]; }
+
+    T& operator[](size_t idx) { return v[idx]; }
+    const T& operator[](size_t idx) const { return v[idx]; }
+
+    T v[R*C];
+
+    static const size_t rows = R;
+    static const size_t cols = C;
+    static const size_t size = R*C;
+
+    static MatrixN Identity() {
+      MatrixN m;
+      m.Set(T(0));
+      for (size_t i = 0; i < std::min(R, C); ++i)
+        m(i, i) = T(1);
+      return m;
+    }
+    MatrixN& Set(const T& value)
+    {
+      std::fill_n(v, size, value);
+      return *this;
+    }
+  };
+
   typedef MatrixX<float32> MatrixXf;
   typedef Matrix2<float32> Matrix2f;
   typedef Matrix3<float32> Matrix3f;
@@ -56,21 +56,47 @@ namespace dry
       -vec.y, vec.x, 0);
   }
 
+  //!\brief Rotation by the angle |w| around the axis w (Rodrigues' formula)
+  template <typename T>
+  inline Matrix3<T> getRotationRodrigues(const Vector3<T>& w)
+  {
+    const T theta2 = w.x*w.x + w.y*w.y + w.z*w.z;
+    T a, b;
+    if (theta2 < T(1e-8)) {
+      // Series of sin(t)/t and (1 - cos(t))/t^2
+      a = 1 - theta2 / 6;
+      b = T(0.5) - theta2 / 24;
+    }
+    else {
+      const T theta = sqrt(theta2);
+      a = sin(theta) / theta;
+      b = (1 - cos(theta)) / theta2;
+    }
+    const T c = 1 - b * theta2;
+    return Matrix3<T>(
+      c + b*w.x*w.x, b*w.x*w.y - a*w.z, b*w.x*w.z + a*w.y,
+      b*w.x*w.y + a*w.z, c + b*w.y*w.y, b*w.y*w.z - a*w.x,
+      b*w.x*w.z - a*w.y, b*w.y*w.z + a*w.x, c + b*w.z*w.z);
+  }
+
   template <typename T>
   inline Matrix3<T> getRotationEuler(const T& phi, const T& theta, const T& psi)
   {
+    const T cphi = cos(phi), sphi = sin(phi);
+    const T ctheta = cos(theta), stheta = sin(theta);
+    const T cpsi = cos(psi), spsi = sin(psi);
     return Matrix3<T>(
-      cos(psi)*cos(phi) - cos(theta)*sin(phi)*sin(psi),
-      cos(psi)*sin(phi) + cos(theta)*cos(phi)*sin(psi),
-      sin(psi)*sin(theta),
+      cpsi*cphi - ctheta*sphi*spsi,
+      cpsi*sphi + ctheta*cphi*spsi,
+      spsi*stheta,
 
-      -sin(psi)*cos(phi) - cos(theta)*sin(phi)*cos(psi),
-      -sin(psi)*sin(phi) + cos(theta)*cos(phi)*cos(psi),
-      cos(psi)*sin(theta),
+      -spsi*cphi - ctheta*sphi*cpsi,
+      -spsi*sphi + ctheta*cphi*cpsi,
+      cpsi*stheta,
 
-      sin(theta)*sin(phi),
-      -sin(theta)*cos(phi),
-      cos(theta));
+      stheta*sphi,
+      -stheta*cphi,
+      ctheta);
   }
 
   template <typename T>
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "Types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dry
+{
+  //!\brief Persistent worker threads shared by the parallel kernels.
+  //! The calling thread always takes part in the work. Calls made from inside a
+  //! job, or while another job is running, fall back to running serially.
+  class ThreadPool
+  {
+  public:
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency())
+      : generation(0), helpers(0), busy(0), next(0), total(0), stop(false)
+    {
+      for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back([this, i] { work(i - 1); });
+    }
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+      }
+      wake.notify_all();
+      for (std::thread& worker : workers)
+        worker.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    //!\brief Number of threads available including the calling thread
+    size_t getThreadCount() const { return workers.size() + 1; }
+
+    //!\brief Call fn(task) for every task in [0, tasks) on up to max_threads threads.
+    //! A max_threads of 0 uses every available thread. Blocks until all tasks are done.
+    template <typename F>
+    void run(size_t tasks, size_t max_threads, const F& fn)
+    {
+      if (max_threads == 0)
+        max_threads = getThreadCount();
+      size_t extra = std::min(std::min(workers.size(), max_threads - 1), tasks > 0 ? tasks - 1 : 0);
+      if (extra == 0 || insideJob() || !job_mutex.try_lock()) {
+        for (size_t task = 0; task < tasks; ++task)
+          fn(task);
+        return;
+      }
+      std::lock_guard<std::mutex> job_lock(job_mutex, std::adopt_lock);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = [&fn](size_t task) { fn(task); };
+        next = 0;
+        total = tasks;
+        helpers = extra;
+        busy = extra;
+        ++generation;
+      }
+      wake.notify_all();
+
+      insideJob() = true;
+      process();
+      insideJob() = false;
+
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [this] { return busy == 0; });
+      job = nullptr;
+    }
+
+    //!\brief Pool shared by all kernels of the library
+    static ThreadPool& global()
+    {
+      static ThreadPool pool;
+      return pool;
+    }
+
+  private:
+    static bool& insideJob()
+    {
+      static thread_local bool inside = false;
+      return inside;
+    }
+
+    void process()
+    {
+      for (size_t task = next++; task < total; task = next++)
+        job(task);
+    }
+
+    void work(size_t index)
+    {
+      insideJob() = true;
+      size_t seen = 0;
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          wake.wait(lock, [&] { return stop || (generation != seen && index < helpers); });
+          if (stop)
+            return;
+          seen = generation;
+        }
+        process();
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (--busy == 0)
+            done.notify_one();
+        }
+      }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex job_mutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(size_t)> job;
+    size_t generation;
+    size_t helpers;
+    size_t busy;
+    std::atomic<size_t> next;
+    size_t total;
+    bool stop;
+  };
+
+  //!\brief Split [0, count) into contiguous chunks and call fn(begin, end, chunk) for each.
+  //! A threads value of 0 uses every available thread.
+  template <typename F>
+  inline void parallelFor(size_t count, size_t threads, const F& fn)
+  {
+    ThreadPool& pool = ThreadPool::global();
+    size_t chunks = std::min(count, threads == 0 ? pool.getThreadCount() : threads);
+    if (chunks <= 1) {
+      if (count > 0)
+        fn(size_t(0), count, size_t(0));
+      return;
+    }
+    pool.run(chunks, chunks, [&](size_t chunk) {
+      fn(count * chunk / chunks, count * (chunk + 1) / chunks, chunk);
+    });
+  }
+}
\ No newline at end of file
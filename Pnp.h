@@ -0,0 +1,486 @@
+#pragma once
+
+#include "Camera.h"
+#include "FixedSolvers.h"
+#include "MatrixOperations.h"
+#include "Parallel.h"
+#include "Ransac.h"
+#include "VectorOperations.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace dry
+{
+  //!\brief Rotation R minimizing sum |(b - mean_b) - R (a - mean_a)|^2 given the cross covariance
+  //! S = sum (a - mean_a)(b - mean_b)^T (Horn's quaternion method)
+  inline void getAbsoluteOrientation(const Matrix3d& S, Matrix3d& R)
+  {
+    MatrixN<double, 4> N;
+    N(0, 0) = S(0, 0) + S(1, 1) + S(2, 2);
+    N(0, 1) = S(1, 2) - S(2, 1);
+    N(0, 2) = S(2, 0) - S(0, 2);
+    N(0, 3) = S(0, 1) - S(1, 0);
+    N(1, 1) = S(0, 0) - S(1, 1) - S(2, 2);
+    N(1, 2) = S(0, 1) + S(1, 0);
+    N(1, 3) = S(2, 0) + S(0, 2);
+    N(2, 2) = -S(0, 0) + S(1, 1) - S(2, 2);
+    N(2, 3) = S(1, 2) + S(2, 1);
+    N(3, 3) = -S(0, 0) - S(1, 1) + S(2, 2);
+    for (size_t i = 0; i < 4; ++i)
+      for (size_t j = 0; j < i; ++j)
+        N(i, j) = N(j, i);
+
+    // The rotation is the unit quaternion of the largest eigenvalue
+    VectorN<double, 4> values;
+    MatrixN<double, 4> V;
+    symmetricEigen(N, values, V);
+    const double w = V(0, 3), x = V(1, 3), y = V(2, 3), z = V(3, 3);
+    R = Matrix3d(
+      1 - 2*(y*y + z*z), 2*(x*y - w*z), 2*(x*z + w*y),
+      2*(x*y + w*z), 1 - 2*(x*x + z*z), 2*(y*z - w*x),
+      2*(x*z - w*y), 2*(y*z + w*x), 1 - 2*(x*x + y*y));
+  }
+
+  //!\brief Rigid transform with to ~ R * from + t in the least squares sense
+  inline void getAbsoluteOrientation(const Vector3d* from, const Vector3d* to, size_t count, Matrix3d& R, Vector3d& t)
+  {
+    Vector3d mean_from(0, 0, 0), mean_to(0, 0, 0);
+    for (size_t i = 0; i < count; ++i) {
+      mean_from = mean_from + from[i];
+      mean_to = mean_to + to[i];
+    }
+    mean_from = mean_from / double(count);
+    mean_to = mean_to / double(count);
+
+    Matrix3d S(0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (size_t i = 0; i < count; ++i) {
+      const Vector3d a = from[i] - mean_from, b = to[i] - mean_to;
+      for (size_t r = 0; r < 3; ++r)
+        for (size_t c = 0; c < 3; ++c)
+          S(r, c) += a[r] * b[c];
+    }
+    getAbsoluteOrientation(S, R);
+    t = mean_to - R * mean_from;
+  }
+
+  //!\brief Camera matrix [R | t] of a pose mapping world points to camera coordinates
+  inline Matrix3x4d getCameraMatrixFromPose(const Matrix3d& R, const Vector3d& t)
+  {
+    const Matrix3d Rt = transpose(R);
+    return getCameraMatrix(Rt, (Rt * t) * -1.0);
+  }
+
+  //!\brief Squared distance between the image point m and the projection of X through the camera C.
+  //! Points behind the camera get the largest representable error.
+  inline double getReprojectionError2(const Matrix3x4d& C, const Vector3d& X, const Vector2d& m)
+  {
+    const double z = C.a20*X.x + C.a21*X.y + C.a22*X.z + C.a23;
+    if (!(z > 0))
+      return std::numeric_limits<double>::max();
+    const double dx = (C.a00*X.x + C.a01*X.y + C.a02*X.z + C.a03) / z - m.x;
+    const double dy = (C.a10*X.x + C.a11*X.y + C.a12*X.z + C.a13) / z - m.y;
+    return dx*dx + dy*dy;
+  }
+
+  //!\brief Pose from coplanar world points through the homography between the plane and the image.
+  //! c0 is the centroid of the selected points and the last two columns of axes span their plane.
+  template <typename F>
+  inline bool solvePlanarPnPIf(const Vector3d* world, const Vector2d* image, size_t count, const F& selected,
+    const Vector3d& c0, const MatrixN<double, 3>& axes, Matrix3x4d& camera)
+  {
+    const Vector3d e1(axes(0, 1), axes(1, 1), axes(2, 1));
+    const Vector3d e2(axes(0, 2), axes(1, 2), axes(2, 2));
+    HomographyAccumulator accumulator;
+    for (size_t i = 0; i < count; ++i) {
+      if (selected(i)) {
+        const Vector3d d = world[i] - c0;
+        accumulator.add(Vector2d(dot(d, e1), dot(d, e2)), image[i]);
+      }
+    }
+    Matrix3d H;
+    if (!accumulator.estimate(H))
+      return false;
+
+    // H ~ [r1 r2 t] in the plane frame, scaled so the plane is in front of the camera
+    const Vector3d h1(H.a00, H.a10, H.a20), h2(H.a01, H.a11, H.a21), h3(H.a02, H.a12, H.a22);
+    const double norm = 0.5 * (h1.norm() + h2.norm());
+    if (!(norm > 0))
+      return false;
+    const double s = (h3.z < 0 ? -1.0 : 1.0) / norm;
+    const Vector3d r1 = h1 * s, r2 = h2 * s, r3 = cross(r1, r2);
+
+    // Nearest rotation to [r1 r2 r3], mapping the plane frame [e1 e2 e1 x e2] to the camera
+    Matrix3d S(
+      r1.x, r1.y, r1.z,
+      r2.x, r2.y, r2.z,
+      r3.x, r3.y, r3.z);
+    Matrix3d Rp;
+    getAbsoluteOrientation(S, Rp);
+    const Vector3d e3 = cross(e1, e2);
+    const Matrix3d B(
+      e1.x, e2.x, e3.x,
+      e1.y, e2.y, e3.y,
+      e1.z, e2.z, e3.z);
+    const Matrix3d R = Rp * transpose(B);
+    camera = getCameraMatrixFromPose(R, h3 * s - R * c0);
+    return true;
+  }
+
+  //!\brief EPnP over the correspondences i for which selected(i) is true.
+  //! Image points are normalized camera coordinates (x/z, y/z). Nothing is allocated: the
+  //! world points are expressed in four control points, the 12x12 system M^T M is accumulated
+  //! in place and the pose is recovered from the control points alone.
+  template <typename F>
+  inline bool solvePnPIf(const Vector3d* world, const Vector2d* image, size_t count, const F& selected, Matrix3x4d& camera)
+  {
+    // Control points are the centroid and the principal axes of the world points
+    size_t n = 0;
+    Vector3d c0(0, 0, 0);
+    for (size_t i = 0; i < count; ++i) {
+      if (selected(i)) {
+        c0 = c0 + world[i];
+        ++n;
+      }
+    }
+    if (n < 4)
+      return false;
+    c0 = c0 / double(n);
+
+    MatrixN<double, 3> cov;
+    cov.Set(0.0);
+    for (size_t i = 0; i < count; ++i) {
+      if (!selected(i))
+        continue;
+      const Vector3d d = world[i] - c0;
+      for (size_t r = 0; r < 3; ++r)
+        for (size_t c = 0; c < 3; ++c)
+          cov(r, c) += d[r] * d[c];
+    }
+    VectorN<double, 3> lambda;
+    MatrixN<double, 3> axes;
+    symmetricEigen(cov, lambda, axes);
+    if (!(lambda[1] > 0))
+      return false;
+    if (lambda[0] <= 1e-10 * lambda[2])
+      return solvePlanarPnPIf(world, image, count, selected, c0, axes, camera);
+
+    Vector3d cw[4], e[3];
+    double scale[3];
+    cw[0] = c0;
+    for (size_t k = 0; k < 3; ++k) {
+      e[k] = Vector3d(axes(0, k), axes(1, k), axes(2, k));
+      scale[k] = std::sqrt(lambda[k] / double(n));
+      cw[k + 1] = c0 + e[k] * scale[k];
+    }
+
+    // Rows [a_j, 0, -a_j u] and [0, a_j, -a_j v] of M, accumulated into the upper triangle of M^T M
+    MatrixN<double, 12> MTM;
+    MTM.Set(0.0);
+    for (size_t i = 0; i < count; ++i) {
+      if (!selected(i))
+        continue;
+      const Vector3d d = world[i] - c0;
+      double a[4];
+      a[1] = dot(d, e[0]) / scale[0];
+      a[2] = dot(d, e[1]) / scale[1];
+      a[3] = dot(d, e[2]) / scale[2];
+      a[0] = 1 - a[1] - a[2] - a[3];
+      double r1[12], r2[12];
+      for (size_t j = 0; j < 4; ++j) {
+        r1[3*j] = a[j];  r1[3*j + 1] = 0;     r1[3*j + 2] = -a[j] * image[i].x;
+        r2[3*j] = 0;     r2[3*j + 1] = a[j];  r2[3*j + 2] = -a[j] * image[i].y;
+      }
+      for (size_t r = 0; r < 12; ++r)
+        for (size_t c = r; c < 12; ++c)
+          MTM(r, c) += r1[r] * r1[c] + r2[r] * r2[c];
+    }
+    for (size_t r = 0; r < 12; ++r)
+      for (size_t c = 0; c < r; ++c)
+        MTM(r, c) = MTM(c, r);
+
+    VectorN<double, 12> values;
+    MatrixN<double, 12> V;
+    symmetricEigen(MTM, values, V);
+
+    // L betas = rho relates the products of the betas of the four smallest null vectors
+    // to the squared distances between the control points
+    static const size_t pairs[6][2] = { { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 2 }, { 1, 3 }, { 2, 3 } };
+    MatrixN<double, 6, 10> L;
+    VectorN<double, 6> rho;
+    for (size_t p = 0; p < 6; ++p) {
+      const size_t a = pairs[p][0], b = pairs[p][1];
+      Vector3d dv[4];
+      for (size_t k = 0; k < 4; ++k)
+        dv[k] = Vector3d(V(3*a, k) - V(3*b, k), V(3*a + 1, k) - V(3*b + 1, k), V(3*a + 2, k) - V(3*b + 2, k));
+      L(p, 0) = dot(dv[0], dv[0]);
+      L(p, 1) = 2 * dot(dv[0], dv[1]);
+      L(p, 2) = dot(dv[1], dv[1]);
+      L(p, 3) = 2 * dot(dv[0], dv[2]);
+      L(p, 4) = 2 * dot(dv[1], dv[2]);
+      L(p, 5) = dot(dv[2], dv[2]);
+      L(p, 6) = 2 * dot(dv[0], dv[3]);
+      L(p, 7) = 2 * dot(dv[1], dv[3]);
+      L(p, 8) = 2 * dot(dv[2], dv[3]);
+      L(p, 9) = dot(dv[3], dv[3]);
+      rho[p] = (cw[a] - cw[b]).norm2();
+    }
+
+    double best_error = std::numeric_limits<double>::max();
+    for (size_t dimension = 1; dimension <= 3; ++dimension) {
+      // Linearized initial betas for a null space of the given dimension
+      double betas[4] = { 0, 0, 0, 0 };
+      if (dimension == 1) {
+        static const size_t columns[4] = { 0, 1, 3, 6 };
+        MatrixN<double, 6, 4> A;
+        VectorN<double, 4> b;
+        for (size_t p = 0; p < 6; ++p)
+          for (size_t k = 0; k < 4; ++k)
+            A(p, k) = L(p, columns[k]);
+        if (!leastSquares(A, rho, b))
+          continue;
+        betas[0] = std::sqrt(std::abs(b[0]));
+        if (betas[0] == 0)
+          continue;
+        const double sign = b[0] < 0 ? -1 : 1;
+        for (size_t k = 1; k < 4; ++k)
+          betas[k] = sign * b[k] / betas[0];
+      }
+      else {
+        const size_t unknowns = dimension == 2 ? 3 : 5;
+        MatrixN<double, 6, 5> A;
+        VectorN<double, 5> b;
+        if (dimension == 2) {
+          MatrixN<double, 6, 3> A3;
+          VectorN<double, 3> b3;
+          for (size_t p = 0; p < 6; ++p)
+            for (size_t k = 0; k < 3; ++k)
+              A3(p, k) = L(p, k);
+          if (!leastSquares(A3, rho, b3))
+            continue;
+          for (size_t k = 0; k < 3; ++k)
+            b[k] = b3[k];
+        }
+        else {
+          for (size_t p = 0; p < 6; ++p)
+            for (size_t k = 0; k < unknowns; ++k)
+              A(p, k) = L(p, k);
+          if (!leastSquares(A, rho, b))
+            continue;
+        }
+        if (b[0] < 0) {
+          betas[0] = std::sqrt(-b[0]);
+          betas[1] = b[2] < 0 ? std::sqrt(-b[2]) : 0.0;
+        }
+        else {
+          betas[0] = std::sqrt(b[0]);
+          betas[1] = b[2] > 0 ? std::sqrt(b[2]) : 0.0;
+        }
+        if (b[1] < 0)
+          betas[0] = -betas[0];
+        if (dimension == 3 && betas[0] != 0)
+          betas[2] = b[3] / betas[0];
+      }
+
+      // Gauss-Newton on the distance constraints
+      for (size_t iteration = 0; iteration < 10; ++iteration) {
+        const double b0 = betas[0], b1 = betas[1], b2 = betas[2], b3 = betas[3];
+        const double B[10] = { b0*b0, b0*b1, b1*b1, b0*b2, b1*b2, b2*b2, b0*b3, b1*b3, b2*b3, b3*b3 };
+        MatrixN<double, 6, 4> J;
+        VectorN<double, 6> r;
+        for (size_t p = 0; p < 6; ++p) {
+          const double* l = &L(p, 0);
+          J(p, 0) = 2*l[0]*b0 + l[1]*b1 + l[3]*b2 + l[6]*b3;
+          J(p, 1) = l[1]*b0 + 2*l[2]*b1 + l[4]*b2 + l[7]*b3;
+          J(p, 2) = l[3]*b0 + l[4]*b1 + 2*l[5]*b2 + l[8]*b3;
+          J(p, 3) = l[6]*b0 + l[7]*b1 + l[8]*b2 + 2*l[9]*b3;
+          double sum = 0;
+          for (size_t k = 0; k < 10; ++k)
+            sum += l[k] * B[k];
+          r[p] = rho[p] - sum;
+        }
+        VectorN<double, 4> delta;
+        if (!leastSquares(J, r, delta))
+          break;
+        for (size_t k = 0; k < 4; ++k)
+          betas[k] += delta[k];
+      }
+
+      // Control points in the camera frame, in front of the camera
+      Vector3d cc[4];
+      for (size_t j = 0; j < 4; ++j) {
+        cc[j] = Vector3d(0, 0, 0);
+        for (size_t k = 0; k < 4; ++k)
+          cc[j] = cc[j] + Vector3d(V(3*j, k), V(3*j + 1, k), V(3*j + 2, k)) * betas[k];
+      }
+      if (cc[0].z < 0)
+        for (size_t j = 0; j < 4; ++j)
+          cc[j] = cc[j] * -1.0;
+
+      // sum_i (X_i - c0) x_i^T collapses onto the control points since the barycentric
+      // coordinates of the axes are projections on the principal directions
+      Matrix3d S(0, 0, 0, 0, 0, 0, 0, 0, 0);
+      for (size_t k = 0; k < 3; ++k) {
+        const double w = lambda[k] / scale[k];
+        const Vector3d d = cc[k + 1] - cc[0];
+        for (size_t r = 0; r < 3; ++r)
+          for (size_t c = 0; c < 3; ++c)
+            S(r, c) += w * e[k][r] * d[c];
+      }
+      Matrix3d R;
+      getAbsoluteOrientation(S, R);
+      const Matrix3x4d candidate = getCameraMatrixFromPose(R, cc[0] - R * c0);
+
+      double error = 0;
+      for (size_t i = 0; i < count && error < best_error; ++i)
+        if (selected(i))
+          error += getReprojectionError2(candidate, world[i], image[i]);
+      if (error < best_error) {
+        best_error = error;
+        camera = candidate;
+      }
+    }
+    return best_error < std::numeric_limits<double>::max();
+  }
+
+  //!\brief Camera pose [R | t] from n >= 4 correspondences between world points and normalized
+  //! image points (EPnP, or the plane homography for coplanar points). When a mask is given only
+  //! correspondences with a non-zero mask entry are used.
+  inline bool solvePnP(const Vector3d* world, const Vector2d* image, size_t count, Matrix3x4d& camera, const uint8* mask = nullptr)
+  {
+    return solvePnPIf(world, image, count, [mask](size_t i) { return !mask || mask[i] != 0; }, camera);
+  }
+
+  //!\brief Up to four camera poses from three correspondences (Grunert's P3P).
+  //! Image points are normalized camera coordinates. Returns the number of solutions.
+  inline size_t solveP3P(const Vector3d* world, const Vector2d* image, Matrix3x4d (&cameras)[4])
+  {
+    Vector3d j[3];
+    for (size_t i = 0; i < 3; ++i)
+      j[i] = normalized(Vector3d(image[i].x, image[i].y, 1.0));
+
+    // Side lengths of the world triangle and the angles between the viewing rays
+    const double a2 = (world[1] - world[2]).norm2();
+    const double b2 = (world[0] - world[2]).norm2();
+    const double c2 = (world[0] - world[1]).norm2();
+    if (a2 == 0 || b2 == 0 || c2 == 0)
+      return 0;
+    const double ca = dot(j[1], j[2]), cb = dot(j[0], j[2]), cg = dot(j[0], j[1]);
+
+    // Quartic in v = s3 / s1
+    const double amc = (a2 - c2) / b2, apc = (a2 + c2) / b2;
+    const double bmc = (b2 - c2) / b2, bma = (b2 - a2) / b2;
+    const double A4 = (amc - 1) * (amc - 1) - 4 * c2 / b2 * ca * ca;
+    const double A3 = 4 * (amc * (1 - amc) * cb - (1 - apc) * ca * cg + 2 * c2 / b2 * ca * ca * cb);
+    const double A2 = 2 * (amc * amc - 1 + 2 * amc * amc * cb * cb + 2 * bmc * ca * ca - 4 * apc * ca * cb * cg + 2 * bma * cg * cg);
+    const double A1 = 4 * (-amc * (1 + amc) * cb + 2 * a2 / b2 * cg * cg * cb - (1 - apc) * ca * cg);
+    const double A0 = (1 + amc) * (1 + amc) - 4 * a2 / b2 * cg * cg;
+
+    double roots[4];
+    const size_t root_count = solveQuartic(A4, A3, A2, A1, A0, roots);
+    size_t solutions = 0;
+    for (size_t k = 0; k < root_count; ++k) {
+      const double v = roots[k];
+      const double denominator = 2 * (cg - v * ca);
+      if (v <= 0 || denominator == 0)
+        continue;
+      const double u = ((amc - 1) * v * v - 2 * amc * cb * v + 1 + amc) / denominator;
+      const double s12 = c2 / (1 + u * u - 2 * u * cg);
+      if (u <= 0 || !(s12 > 0))
+        continue;
+      const double s1 = std::sqrt(s12);
+      const Vector3d points[3] = { j[0] * s1, j[1] * (u * s1), j[2] * (v * s1) };
+
+      Matrix3d R;
+      Vector3d t;
+      getAbsoluteOrientation(world, points, 3, R, t);
+      cameras[solutions++] = getCameraMatrixFromPose(R, t);
+    }
+    return solutions;
+  }
+
+  struct RansacPnpOptions : public RansacOptions
+  {
+    RansacPnpOptions() { threshold = 0.005; }
+    bool minimal_p3p = true;   //!< Hypotheses from P3P on three points, disambiguated by a fourth, rather than EPnP on four
+  };
+
+  //!\brief Robust camera pose from correspondences between world points and normalized image points.
+  //! The threshold is in the units of the image points, divide a pixel threshold by the focal length.
+  //! Hypotheses are generated and scored in parallel batches, see RansacDriver. Nothing is
+  //! allocated: the refit selects its inliers on the fly.
+  class RansacPnp
+  {
+  public:
+    RansacPnp(const RansacPnpOptions& options = RansacPnpOptions()) : options(options), inlier_count(0) {}
+
+    RansacPnpOptions options;
+
+    //!\brief Estimate the camera [R | t], refitted with EPnP on the inliers of the best hypothesis.
+    //! If inliers is given it receives one inlier flag per correspondence.
+    bool estimate(const Vector3d* world, const Vector2d* image, size_t count, Matrix3x4d& camera, uint8* inliers = nullptr)
+    {
+      inlier_count = 0;
+      const Problem problem = { world, image, count, options.minimal_p3p };
+      if (!driver.estimate(options, problem, camera))
+        return false;
+      inlier_count = driver.countInliers(problem, camera, options.threshold * options.threshold, inliers);
+      return inlier_count >= 4;
+    }
+
+    size_t getInlierCount() const { return inlier_count; }
+    size_t getIterationCount() const { return driver.getIterationCount(); }
+
+  private:
+    struct Problem
+    {
+      // Both kinds of hypothesis draw four correspondences, P3P needs the fourth to pick a solution
+      static const size_t sample_size = 4;
+
+      size_t getCount() const { return count; }
+      bool sample(SplitMix64& random, Matrix3x4d& camera) const
+      {
+        size_t idx[4];
+        drawSample(random, count, idx);
+        Vector3d X[4];
+        Vector2d m[4];
+        for (size_t i = 0; i < 4; ++i) {
+          X[i] = world[idx[i]];
+          m[i] = image[idx[i]];
+        }
+        if (cross(X[1] - X[0], X[2] - X[0]).norm2() <= 1e-18 * (X[1] - X[0]).norm2() * (X[2] - X[0]).norm2())
+          return false;
+
+        if (!minimal_p3p)
+          return solvePnP(X, m, 4, camera);
+
+        // The fourth point picks among the P3P solutions
+        Matrix3x4d cameras[4];
+        size_t solutions = solveP3P(X, m, cameras);
+        double best_error = std::numeric_limits<double>::max();
+        for (size_t k = 0; k < solutions; ++k) {
+          double error = getReprojectionError2(cameras[k], X[3], m[3]);
+          if (error < best_error) {
+            best_error = error;
+            camera = cameras[k];
+          }
+        }
+        return best_error < std::numeric_limits<double>::max();
+      }
+      double getError2(const Matrix3x4d& camera, size_t i) const { return getReprojectionError2(camera, world[i], image[i]); }
+      bool refit(const Matrix3x4d& camera, double threshold2, Matrix3x4d& refined) const
+      {
+        return solvePnPIf(world, image, count, [&](size_t i) { return getError2(camera, i) < threshold2; }, refined);
+      }
+
+      const Vector3d* world;
+      const Vector2d* image;
+      size_t count;
+      bool minimal_p3p;
+    };
+
+    RansacDriver<Matrix3x4d> driver;
+    size_t inlier_count;
+  };
+}
\ No newline at end of file
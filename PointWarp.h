@@ -0,0 +1,163 @@
+#pragma once
+
+#include "MatrixOperations.h"
+#include "VectorOperations.h"
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+namespace dry
+{
+  inline size_t countBits(uint32 mask)
+  {
+    size_t count = 0;
+    for (; mask; mask &= mask - 1)
+      ++count;
+    return count;
+  }
+
+  //!\brief Map n points through the homography H, dst may alias src.
+  //! If behind is given, behind[i] is set when point i lands at w <= 0 (behind the plane).
+  //! Returns the number of points behind the plane.
+  template <typename T>
+  inline size_t warpPoints(const Matrix3<T>& H, const Vector2<T>* src, Vector2<T>* dst, size_t n, uint8* behind = nullptr)
+  {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const T x = src[i].x, y = src[i].y;
+      const T u = H.a00*x + H.a01*y + H.a02;
+      const T v = H.a10*x + H.a11*y + H.a12;
+      const T w = H.a20*x + H.a21*y + H.a22;
+      dst[i].x = u / w;
+      dst[i].y = v / w;
+      const bool back = !(w > T(0));
+      count += back;
+      if (behind)
+        behind[i] = back;
+    }
+    return count;
+  }
+
+  inline size_t warpPoints(const Matrix3d& H, const Vector2d* src, Vector2d* dst, size_t n, uint8* behind = nullptr)
+  {
+    size_t i = 0;
+    size_t count = 0;
+#if defined(__AVX512F__)
+    {
+      // 8 points per iteration, deinterleaved into x and y registers with two-source permutes
+      const __m512i even = _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14);
+      const __m512i odd = _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15);
+      const __m512i lo = _mm512_setr_epi64(0, 8, 1, 9, 2, 10, 3, 11);
+      const __m512i hi = _mm512_setr_epi64(4, 12, 5, 13, 6, 14, 7, 15);
+      const __m512d h00 = _mm512_set1_pd(H.a00), h01 = _mm512_set1_pd(H.a01), h02 = _mm512_set1_pd(H.a02);
+      const __m512d h10 = _mm512_set1_pd(H.a10), h11 = _mm512_set1_pd(H.a11), h12 = _mm512_set1_pd(H.a12);
+      const __m512d h20 = _mm512_set1_pd(H.a20), h21 = _mm512_set1_pd(H.a21), h22 = _mm512_set1_pd(H.a22);
+      for (; i + 8 <= n; i += 8) {
+        const __m512d a = _mm512_loadu_pd(&src[i].x);
+        const __m512d b = _mm512_loadu_pd(&src[i + 4].x);
+        const __m512d x = _mm512_permutex2var_pd(a, even, b);
+        const __m512d y = _mm512_permutex2var_pd(a, odd, b);
+        const __m512d w = _mm512_fmadd_pd(h20, x, _mm512_fmadd_pd(h21, y, h22));
+        const __m512d u = _mm512_div_pd(_mm512_fmadd_pd(h00, x, _mm512_fmadd_pd(h01, y, h02)), w);
+        const __m512d v = _mm512_div_pd(_mm512_fmadd_pd(h10, x, _mm512_fmadd_pd(h11, y, h12)), w);
+        _mm512_storeu_pd(&dst[i].x, _mm512_permutex2var_pd(u, lo, v));
+        _mm512_storeu_pd(&dst[i + 4].x, _mm512_permutex2var_pd(u, hi, v));
+        const __mmask8 back = _mm512_cmp_pd_mask(w, _mm512_setzero_pd(), _CMP_NGT_UQ);
+        count += countBits(back);
+        if (behind)
+          for (size_t k = 0; k < 8; ++k)
+            behind[i + k] = (back >> k) & 1;
+      }
+    }
+#elif defined(__AVX2__) && defined(__FMA__)
+    {
+      // 4 points per iteration, unpack gives x and y in the order 0 2 1 3 which unpack restores
+      const __m256d h00 = _mm256_set1_pd(H.a00), h01 = _mm256_set1_pd(H.a01), h02 = _mm256_set1_pd(H.a02);
+      const __m256d h10 = _mm256_set1_pd(H.a10), h11 = _mm256_set1_pd(H.a11), h12 = _mm256_set1_pd(H.a12);
+      const __m256d h20 = _mm256_set1_pd(H.a20), h21 = _mm256_set1_pd(H.a21), h22 = _mm256_set1_pd(H.a22);
+      for (; i + 4 <= n; i += 4) {
+        const __m256d a = _mm256_loadu_pd(&src[i].x);
+        const __m256d b = _mm256_loadu_pd(&src[i + 2].x);
+        const __m256d x = _mm256_unpacklo_pd(a, b);
+        const __m256d y = _mm256_unpackhi_pd(a, b);
+        const __m256d w = _mm256_fmadd_pd(h20, x, _mm256_fmadd_pd(h21, y, h22));
+        const __m256d u = _mm256_div_pd(_mm256_fmadd_pd(h00, x, _mm256_fmadd_pd(h01, y, h02)), w);
+        const __m256d v = _mm256_div_pd(_mm256_fmadd_pd(h10, x, _mm256_fmadd_pd(h11, y, h12)), w);
+        _mm256_storeu_pd(&dst[i].x, _mm256_unpacklo_pd(u, v));
+        _mm256_storeu_pd(&dst[i + 2].x, _mm256_unpackhi_pd(u, v));
+        // Lanes hold points 0 2 1 3
+        const int back = _mm256_movemask_pd(_mm256_cmp_pd(w, _mm256_setzero_pd(), _CMP_NGT_UQ));
+        count += countBits(back);
+        if (behind) {
+          behind[i] = back & 1;
+          behind[i + 1] = (back >> 2) & 1;
+          behind[i + 2] = (back >> 1) & 1;
+          behind[i + 3] = (back >> 3) & 1;
+        }
+      }
+    }
+#endif
+    return count + warpPoints<double>(H, src + i, dst + i, n - i, behind ? behind + i : nullptr);
+  }
+
+  inline size_t warpPoints(const Matrix3f& H, const Vector2f* src, Vector2f* dst, size_t n, uint8* behind = nullptr)
+  {
+    size_t i = 0;
+    size_t count = 0;
+#if defined(__AVX512F__)
+    {
+      // 16 points per iteration
+      const __m512i even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+      const __m512i odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+      const __m512i lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+      const __m512i hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+      const __m512 h00 = _mm512_set1_ps(H.a00), h01 = _mm512_set1_ps(H.a01), h02 = _mm512_set1_ps(H.a02);
+      const __m512 h10 = _mm512_set1_ps(H.a10), h11 = _mm512_set1_ps(H.a11), h12 = _mm512_set1_ps(H.a12);
+      const __m512 h20 = _mm512_set1_ps(H.a20), h21 = _mm512_set1_ps(H.a21), h22 = _mm512_set1_ps(H.a22);
+      for (; i + 16 <= n; i += 16) {
+        const __m512 a = _mm512_loadu_ps(&src[i].x);
+        const __m512 b = _mm512_loadu_ps(&src[i + 8].x);
+        const __m512 x = _mm512_permutex2var_ps(a, even, b);
+        const __m512 y = _mm512_permutex2var_ps(a, odd, b);
+        const __m512 w = _mm512_fmadd_ps(h20, x, _mm512_fmadd_ps(h21, y, h22));
+        const __m512 u = _mm512_div_ps(_mm512_fmadd_ps(h00, x, _mm512_fmadd_ps(h01, y, h02)), w);
+        const __m512 v = _mm512_div_ps(_mm512_fmadd_ps(h10, x, _mm512_fmadd_ps(h11, y, h12)), w);
+        _mm512_storeu_ps(&dst[i].x, _mm512_permutex2var_ps(u, lo, v));
+        _mm512_storeu_ps(&dst[i + 8].x, _mm512_permutex2var_ps(u, hi, v));
+        const __mmask16 back = _mm512_cmp_ps_mask(w, _mm512_setzero_ps(), _CMP_NGT_UQ);
+        count += countBits(back);
+        if (behind)
+          for (size_t k = 0; k < 16; ++k)
+            behind[i + k] = (back >> k) & 1;
+      }
+    }
+#elif defined(__AVX2__) && defined(__FMA__)
+    {
+      // 8 points per iteration, the in-lane shuffles give x and y in the order 0 1 4 5 2 3 6 7
+      const __m256 h00 = _mm256_set1_ps(H.a00), h01 = _mm256_set1_ps(H.a01), h02 = _mm256_set1_ps(H.a02);
+      const __m256 h10 = _mm256_set1_ps(H.a10), h11 = _mm256_set1_ps(H.a11), h12 = _mm256_set1_ps(H.a12);
+      const __m256 h20 = _mm256_set1_ps(H.a20), h21 = _mm256_set1_ps(H.a21), h22 = _mm256_set1_ps(H.a22);
+      for (; i + 8 <= n; i += 8) {
+        const __m256 a = _mm256_loadu_ps(&src[i].x);
+        const __m256 b = _mm256_loadu_ps(&src[i + 4].x);
+        const __m256 x = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 y = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        const __m256 w = _mm256_fmadd_ps(h20, x, _mm256_fmadd_ps(h21, y, h22));
+        const __m256 u = _mm256_div_ps(_mm256_fmadd_ps(h00, x, _mm256_fmadd_ps(h01, y, h02)), w);
+        const __m256 v = _mm256_div_ps(_mm256_fmadd_ps(h10, x, _mm256_fmadd_ps(h11, y, h12)), w);
+        _mm256_storeu_ps(&dst[i].x, _mm256_unpacklo_ps(u, v));
+        _mm256_storeu_ps(&dst[i + 4].x, _mm256_unpackhi_ps(u, v));
+        const int back = _mm256_movemask_ps(_mm256_cmp_ps(w, _mm256_setzero_ps(), _CMP_NGT_UQ));
+        count += countBits(back);
+        if (behind) {
+          static const uint8 order[8] = { 0, 1, 4, 5, 2, 3, 6, 7 };
+          for (size_t k = 0; k < 8; ++k)
+            behind[i + order[k]] = (back >> k) & 1;
+        }
+      }
+    }
+#endif
+    return count + warpPoints<float>(H, src + i, dst + i, n - i, behind ? behind + i : nullptr);
+  }
+}
\ No newline at end of file
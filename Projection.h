@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Matrix.h"
+#include "Vector.h"
+#include "Parallel.h"
+
+namespace dry
+{
+  //!\brief Project points [begin, end) of a view through P, see projectPoints.
+  //! Works in blocks so every loop is branch free and vectorizes over points.
+  template <size_t Stride, typename T>
+  inline size_t projectPointRange(const Matrix3x4<T>& P, const Vector3View<T>& points, size_t begin, size_t end,
+    T* u, T* v, T* depth, uint8* valid, T min_depth)
+  {
+    const size_t block = 256;
+    const size_t stride = Stride ? Stride : points.stride;
+    T w[block];
+    size_t visible = 0;
+    for (size_t first = begin; first < end; first += block) {
+      const size_t n = std::min(block, end - first);
+      const T* x = points.x + first * stride;
+      const T* y = points.y + first * stride;
+      const T* z = points.z + first * stride;
+      T* uo = u + first;
+      T* vo = v + first;
+
+      size_t block_visible = 0;
+      for (size_t i = 0; i < n; ++i) {
+        const T px = x[i*stride], py = y[i*stride], pz = z[i*stride];
+        const T pw = P.a20*px + P.a21*py + P.a22*pz + P.a23;
+        const T iw = T(1) / pw;
+        uo[i] = (P.a00*px + P.a01*py + P.a02*pz + P.a03) * iw;
+        vo[i] = (P.a10*px + P.a11*py + P.a12*pz + P.a13) * iw;
+        w[i] = pw;
+        block_visible += pw > min_depth;
+      }
+
+      if (depth)
+        for (size_t i = 0; i < n; ++i)
+          depth[first + i] = w[i];
+      if (valid)
+        for (size_t i = 0; i < n; ++i)
+          valid[first + i] = w[i] > min_depth;
+      visible += block_visible;
+    }
+    return visible;
+  }
+
+  //!\brief Project a point cloud through the camera P.
+  //! Writes pixel coordinates u, v and, if given, the depth (third row of P times the point)
+  //! and a valid flag for points in front of the camera (depth > min_depth). u and v of points
+  //! behind the camera are still written but meaningless. Large clouds are split over the
+  //! thread pool (threads of 0 uses all available). Returns the number of valid points.
+  template <typename T>
+  inline size_t projectPoints(const Matrix3x4<T>& P, const Vector3View<T>& points, T* u, T* v,
+    T* depth = nullptr, uint8* valid = nullptr, T min_depth = T(0), size_t threads = 0)
+  {
+    const size_t min_chunk = 1 << 14;
+    const size_t max_chunks = 64;
+    const size_t count = points.count;
+    const size_t chunks = std::max(size_t(1), std::min(std::min(
+      threads == 0 ? ThreadPool::global().getThreadCount() : threads, count / min_chunk), max_chunks));
+
+    size_t visible[max_chunks] = { 0 };
+    parallelFor(count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+      // Dispatch the common layouts so their loops get a constant stride
+      if (points.stride == 1)
+        visible[chunk] = projectPointRange<1>(P, points, begin, end, u, v, depth, valid, min_depth);
+      else if (points.stride == 3)
+        visible[chunk] = projectPointRange<3>(P, points, begin, end, u, v, depth, valid, min_depth);
+      else
+        visible[chunk] = projectPointRange<0>(P, points, begin, end, u, v, depth, valid, min_depth);
+    });
+
+    size_t total = 0;
+    for (size_t i = 0; i < chunks; ++i)
+      total += visible[i];
+    return total;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "Homography.h"
+#include "HomographyRefinement.h"
+#include "Parallel.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace dry
+{
+  struct RansacOptions
+  {
+    double threshold = 3.0;        //!< Inlier threshold on the reprojection error (pixels)
+    double confidence = 0.99;      //!< Probability of drawing at least one outlier free sample
+    size_t max_iterations = 10000;
+    size_t threads = 0;            //!< 0 uses every available thread
+    bool deterministic = false;    //!< Use seed so results do not depend on timing or thread count
+    uint64 seed = 0;
+    bool refine = false;           //!< Finish with a Levenberg-Marquardt refinement on the inliers
+  };
+
+  //!\brief Counter based random stream, hypothesis i of a run always sees the same numbers
+  class SplitMix64
+  {
+  public:
+    explicit SplitMix64(uint64 state) : state(state) {}
+    uint64 operator()()
+    {
+      uint64 z = (state += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+    }
+    //!\brief Uniform integer in [0, n)
+    size_t operator()(size_t n) { return size_t(((*this)() >> 11) * (1.0 / 9007199254740992.0) * n); }
+  private:
+    uint64 state;
+  };
+
+  //!\brief Number of iterations needed to draw an outlier free sample with the given confidence
+  inline size_t getRansacIterations(double inlier_ratio, size_t sample_size, double confidence, size_t max_iterations)
+  {
+    double p_good = std::pow(inlier_ratio, double(sample_size));
+    if (p_good <= std::numeric_limits<double>::epsilon())
+      return max_iterations;
+    if (p_good >= 1.0)
+      return 1;
+    double n = std::log(1.0 - confidence) / std::log(1.0 - p_good);
+    return n >= double(max_iterations) ? max_iterations : std::max(size_t(1), size_t(std::ceil(n)));
+  }
+
+  //!\brief Draw N distinct indices in [0, count), count must be at least N
+  template <size_t N>
+  inline void drawSample(SplitMix64& random, size_t count, size_t (&indices)[N])
+  {
+    for (size_t i = 0; i < N; ++i) {
+      bool unique;
+      do {
+        indices[i] = random(count);
+        unique = true;
+        for (size_t j = 0; j < i; ++j)
+          unique = unique && indices[j] != indices[i];
+      } while (!unique);
+    }
+  }
+
+  //!\brief Hypothesize and verify loop shared by the robust estimators.
+  //! The Problem describes the correspondences and how a Model is fitted to them:
+  //!   static const size_t sample_size                    correspondences drawn per hypothesis
+  //!   size_t getCount() const
+  //!   bool sample(SplitMix64& random, Model& model) const  solve a random minimal sample
+  //!   double getError2(const Model& model, size_t i) const squared residual of correspondence i
+  //!   bool refit(const Model& model, double threshold2, Model& refined) const
+  //!                                                      fit to the inliers of model
+  //! sample and getError2 are called from several threads at once. Hypotheses are generated and
+  //! scored with the MSAC cost in batches across threads, and sampling stops once the adaptive
+  //! bound for the best inlier ratio found so far has been reached. Nothing is allocated, the
+  //! hypotheses of a batch live in a fixed buffer.
+  template <typename Model>
+  class RansacDriver
+  {
+  public:
+    RansacDriver() : iterations(0) {}
+
+    //!\brief Best hypothesis refitted on its inliers. Returns false if it has fewer inliers than
+    //! a sample has correspondences.
+    template <typename Problem>
+    bool estimate(const RansacOptions& options, const Problem& problem, Model& model)
+    {
+      iterations = 0;
+      const size_t count = problem.getCount();
+      if (count < Problem::sample_size)
+        return false;
+
+      const double threshold2 = options.threshold * options.threshold;
+      const uint64 seed = options.deterministic ? options.seed : (uint64(std::random_device()()) << 32) ^ std::random_device()();
+      ThreadPool& pool = ThreadPool::global();
+      const size_t threads = options.threads == 0 ? pool.getThreadCount() : options.threads;
+      // A fixed batch keeps the termination points, and so the result, independent of the thread count
+      const size_t batch = options.deterministic ? 32 : std::min(size_t(max_batch), std::max(size_t(1), threads) * 4);
+
+      Hypothesis best;
+      size_t required = options.max_iterations;
+      while (iterations < required) {
+        const size_t tasks = std::min(batch, required - iterations);
+        const size_t first = iterations;
+        pool.run(tasks, threads, [&](size_t task) {
+          Hypothesis& hypothesis = hypotheses[task];
+          hypothesis.valid = false;
+          SplitMix64 random(seed ^ (uint64(first + task) * 0xD1B54A32D192ED03ull));
+          if (!problem.sample(random, hypothesis.model))
+            return;
+          hypothesis.valid = true;
+          score(hypothesis, problem, count, threshold2);
+        });
+        iterations += tasks;
+
+        // Reduce in hypothesis order so the outcome does not depend on scheduling
+        for (size_t i = 0; i < tasks; ++i)
+          if (hypotheses[i].valid && hypotheses[i].isBetterThan(best))
+            best = hypotheses[i];
+        if (best.valid)
+          required = std::min(required, std::max(iterations, getRansacIterations(
+            double(best.inliers) / count, Problem::sample_size, options.confidence, options.max_iterations)));
+      }
+      if (!best.valid || best.inliers < Problem::sample_size)
+        return false;
+
+      // Refit on the inliers of the current model, keeping a refit unless it loses inliers
+      model = best.model;
+      for (size_t refit = 0; refit < 2; ++refit) {
+        Model refined;
+        if (!problem.refit(model, threshold2, refined))
+          break;
+        if (countInliers(problem, refined, threshold2) < countInliers(problem, model, threshold2))
+          break;
+        model = refined;
+      }
+      return true;
+    }
+
+    //!\brief Number of correspondences with a squared error below threshold2.
+    //! inliers, if given, receives one flag per correspondence.
+    template <typename Problem>
+    static size_t countInliers(const Problem& problem, const Model& model, double threshold2, uint8* inliers = nullptr)
+    {
+      size_t n = 0;
+      for (size_t i = 0, count = problem.getCount(); i < count; ++i) {
+        const bool inlier = problem.getError2(model, i) < threshold2;
+        n += inlier;
+        if (inliers)
+          inliers[i] = inlier;
+      }
+      return n;
+    }
+
+    size_t getIterationCount() const { return iterations; }
+
+  private:
+    static const size_t max_batch = 64;
+
+    struct Hypothesis
+    {
+      Hypothesis() : valid(false), inliers(0), cost(std::numeric_limits<double>::max()) {}
+      bool isBetterThan(const Hypothesis& other) const
+      {
+        if (!other.valid)
+          return true;
+        return inliers > other.inliers || (inliers == other.inliers && cost < other.cost);
+      }
+      Model model;
+      bool valid;
+      size_t inliers;
+      double cost;
+    };
+
+    template <typename Problem>
+    static void score(Hypothesis& hypothesis, const Problem& problem, size_t count, double threshold2)
+    {
+      // MSAC cost, truncated squared error breaks ties between equal inlier counts
+      size_t n = 0;
+      double cost = 0;
+      for (size_t i = 0; i < count; ++i) {
+        const double e2 = problem.getError2(hypothesis.model, i);
+        if (e2 < threshold2) {
+          ++n;
+          cost += e2;
+        }
+        else
+          cost += threshold2;
+      }
+      hypothesis.inliers = n;
+      hypothesis.cost = cost;
+    }
+
+    Hypothesis hypotheses[max_batch];
+    size_t iterations;
+  };
+
+  //!\brief Squared distance between r and the projection of l through H
+  template <typename T>
+  inline T getReprojectionError2(const Matrix3<T>& H, const Vector2<T>& l, const Vector2<T>& r)
+  {
+    Vector3<T> p = H * l;
+    if (p.z == T(0))
+      return std::numeric_limits<T>::max();
+    T dx = p.x / p.z - r.x;
+    T dy = p.y / p.z - r.y;
+    return dx*dx + dy*dy;
+  }
+
+  //!\brief Robust homography estimation from minimal 4 point samples, see RansacDriver
+  class RansacHomography
+  {
+  public:
+    RansacHomography(const RansacOptions& options = RansacOptions()) : options(options), inlier_count(0) {}
+
+    RansacOptions options;
+
+    //!\brief Estimate H such that right ~ H * left, refitted on all inliers of the best hypothesis
+    bool estimate(const Vector2d* left, const Vector2d* right, size_t count, Matrix3d& H)
+    {
+      inlier_count = 0;
+      inliers.assign(count, 0);
+      const Problem problem = { left, right, count, &inlier_left, &inlier_right };
+      if (!driver.estimate(options, problem, H))
+        return false;
+
+      const double threshold2 = options.threshold * options.threshold;
+      if (options.refine && driver.countInliers(problem, H, threshold2, inliers.data()) >= 4)
+        refineHomography(left, right, count, H, inliers.data());
+      inlier_count = driver.countInliers(problem, H, threshold2, inliers.data());
+      return inlier_count >= 4;
+    }
+    bool estimate(const std::vector<Vector2d>& left, const std::vector<Vector2d>& right, Matrix3d& H)
+    {
+      return estimate(left.data(), right.data(), std::min(left.size(), right.size()), H);
+    }
+
+    //!\brief Inlier flags of the last estimate, one per correspondence
+    const std::vector<uint8>& getInliers() const { return inliers; }
+    size_t getInlierCount() const { return inlier_count; }
+    size_t getIterationCount() const { return driver.getIterationCount(); }
+
+  private:
+    //!\brief Correspondences left -> right, the refit gathers the inliers into the scratch buffers
+    struct Problem
+    {
+      static const size_t sample_size = 4;
+
+      size_t getCount() const { return count; }
+      bool sample(SplitMix64& random, Matrix3d& H) const
+      {
+        size_t idx[4];
+        drawSample(random, count, idx);
+        Vector2d l[4], r[4];
+        for (size_t i = 0; i < 4; ++i) {
+          l[i] = left[idx[i]];
+          r[i] = right[idx[i]];
+        }
+        if (isDegenerate(l) || isDegenerate(r))
+          return false;
+        return estimateHomography(l, r, 4, H);
+      }
+      double getError2(const Matrix3d& H, size_t i) const { return getReprojectionError2(H, left[i], right[i]); }
+      bool refit(const Matrix3d& H, double threshold2, Matrix3d& refined) const
+      {
+        inlier_left->clear();
+        inlier_right->clear();
+        for (size_t i = 0; i < count; ++i) {
+          if (getError2(H, i) < threshold2) {
+            inlier_left->push_back(left[i]);
+            inlier_right->push_back(right[i]);
+          }
+        }
+        return estimateHomography(inlier_left->data(), inlier_right->data(), inlier_left->size(), refined);
+      }
+
+      const Vector2d* left;
+      const Vector2d* right;
+      size_t count;
+      std::vector<Vector2d>* inlier_left;
+      std::vector<Vector2d>* inlier_right;
+    };
+
+    static bool isCollinear(const Vector2d& a, const Vector2d& b, const Vector2d& c)
+    {
+      double area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+      double scale = (b - a).norm2() + (c - a).norm2();
+      return std::abs(area) <= 1e-9 * scale;
+    }
+    static bool isDegenerate(const Vector2d* p)
+    {
+      return isCollinear(p[0], p[1], p[2]) || isCollinear(p[0], p[1], p[3]) ||
+             isCollinear(p[0], p[2], p[3]) || isCollinear(p[1], p[2], p[3]);
+    }
+
+    RansacDriver<Matrix3d> driver;
+    std::vector<uint8> inliers;
+    std::vector<Vector2d> inlier_left;
+    std::vector<Vector2d> inlier_right;
+    size_t inlier_count;
+  };
+}
\ No newline at end of file
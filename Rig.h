@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Camera.h"
+#include "Matrix.h"
+#include "Parallel.h"
+#include "Projection.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace dry
+{
+  //!\brief Per camera outputs of CameraRig::projectPoints, laid out as for projectPoints.
+  //! depth and valid are optional.
+  template <typename T>
+  struct RigProjection
+  {
+    T* u = nullptr;
+    T* v = nullptr;
+    T* depth = nullptr;
+    uint8* valid = nullptr;
+  };
+
+  //!\brief Cameras mounted on a moving body.
+  //! Each camera has a fixed offset, a Matrix3x4 mapping body coordinates to the camera
+  //! (optionally including its intrinsics). For a body pose B, the world to body transform as
+  //! returned by getCameraMatrix, camera k is compose(offset[k], B).
+  template <typename T>
+  class CameraRig
+  {
+  public:
+    //!\brief Add a camera, returns its index
+    size_t addCamera(const Matrix3x4<T>& offset)
+    {
+      offsets.push_back(offset);
+      return offsets.size() - 1;
+    }
+
+    size_t size() const { return offsets.size(); }
+    const Matrix3x4<T>& getOffset(size_t camera) const { return offsets[camera]; }
+    void setOffset(size_t camera, const Matrix3x4<T>& offset) { offsets[camera] = offset; }
+
+    //!\brief World to camera matrices of every camera at the body pose
+    void getCameras(const Matrix3x4<T>& body, Matrix3x4<T>* cameras) const
+    {
+      for (size_t k = 0; k < offsets.size(); ++k)
+        cameras[k] = compose(offsets[k], body);
+    }
+
+    //!\brief Project a point cloud into every camera at the body pose.
+    //! outputs holds one entry per camera, see projectPoints. The cameras are composed once and
+    //! the points are streamed in blocks that stay in cache while every camera projects them, so
+    //! the cloud is read from memory once. visible, if given, receives the number of valid points
+    //! per camera. Returns the total over the cameras.
+    size_t projectPoints(const Matrix3x4<T>& body, const Vector3View<T>& points, const RigProjection<T>* outputs,
+      size_t* visible = nullptr, T min_depth = T(0), size_t threads = 0) const
+    {
+      const size_t count = points.count;
+      const size_t camera_count = offsets.size();
+      std::vector<Matrix3x4<T>> cameras(camera_count);
+      getCameras(body, cameras.data());
+
+      const size_t min_chunk = 1 << 14;
+      const size_t max_chunks = 64;
+      const size_t chunks = std::max(size_t(1), std::min(std::min(
+        threads == 0 ? ThreadPool::global().getThreadCount() : threads, count / min_chunk), max_chunks));
+
+      std::vector<size_t> counts(chunks * camera_count, 0);
+      parallelFor(count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+        size_t* chunk_counts = counts.data() + chunk * camera_count;
+        if (points.stride == 1)
+          projectRange<1>(cameras.data(), points, begin, end, outputs, chunk_counts, min_depth);
+        else if (points.stride == 3)
+          projectRange<3>(cameras.data(), points, begin, end, outputs, chunk_counts, min_depth);
+        else
+          projectRange<0>(cameras.data(), points, begin, end, outputs, chunk_counts, min_depth);
+      });
+
+      size_t total = 0;
+      for (size_t k = 0; k < camera_count; ++k) {
+        size_t n = 0;
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+          n += counts[chunk * camera_count + k];
+        if (visible)
+          visible[k] = n;
+        total += n;
+      }
+      return total;
+    }
+
+  private:
+    //!\brief Projects tiles of points small enough to stay in cache through every camera in
+    //! turn, so each camera only writes its own outputs while the tile is reused.
+    template <size_t Stride>
+    void projectRange(const Matrix3x4<T>* cameras, const Vector3View<T>& points, size_t begin, size_t end,
+      const RigProjection<T>* outputs, size_t* visible, T min_depth) const
+    {
+      const size_t tile = 4096;
+      for (size_t first = begin; first < end; first += tile) {
+        const size_t last = std::min(first + tile, end);
+        for (size_t k = 0; k < offsets.size(); ++k) {
+          const RigProjection<T>& out = outputs[k];
+          visible[k] += projectPointRange<Stride>(cameras[k], points, first, last, out.u, out.v, out.depth, out.valid, min_depth);
+        }
+      }
+    }
+
+    std::vector<Matrix3x4<T>> offsets;
+  };
+
+  typedef CameraRig<float32> CameraRigf;
+  typedef CameraRig<float64> CameraRigd;
+}
\ No newline at end of file
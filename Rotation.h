@@ -0,0 +1,312 @@
+#pragma once
+
+#include "Matrix.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dry
+{
+  //!\brief Rotation quaternion w + xi + yj + zk. Composition follows the matrices,
+  //! so getRotation(a * b) == getRotation(a) * getRotation(b).
+  template <typename T>
+  class Quaternion
+  {
+  public:
+    Quaternion() {};
+    Quaternion(const T& w, const T& x, const T& y, const T& z) : w(w), x(x), y(y), z(z) {}
+
+    template <typename U>
+    explicit Quaternion(const Quaternion<U>& other) : w(T(other.w)), x(T(other.x)), y(T(other.y)), z(T(other.z)) {}
+
+    static Quaternion Identity() { return Quaternion(1, 0, 0, 0); }
+
+    T w;
+    T x;
+    T y;
+    T z;
+  };
+
+  typedef Quaternion<float32> Quaternionf;
+  typedef Quaternion<float64> Quaterniond;
+
+  //!\brief Rotation by angle radians around a unit axis
+  template <typename T>
+  class AxisAngle
+  {
+  public:
+    AxisAngle() {};
+    AxisAngle(const Vector3<T>& axis, const T& angle) : axis(axis), angle(angle) {}
+
+    Vector3<T> axis;
+    T angle;
+  };
+
+  typedef AxisAngle<float32> AxisAnglef;
+  typedef AxisAngle<float64> AxisAngled;
+
+  //!\brief Hamilton product, the rotation b followed by a
+  template <typename T>
+  inline Quaternion<T> operator*(const Quaternion<T>& a, const Quaternion<T>& b)
+  {
+    return Quaternion<T>(
+      a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z,
+      a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y,
+      a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x,
+      a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w);
+  }
+
+  //!\brief Rotate a point, cheaper than building the matrix for a single point
+  template <typename T>
+  inline Vector3<T> operator*(const Quaternion<T>& q, const Vector3<T>& v)
+  {
+    // v + w t + u x t with t = 2 u x v
+    const T tx = 2 * (q.y*v.z - q.z*v.y);
+    const T ty = 2 * (q.z*v.x - q.x*v.z);
+    const T tz = 2 * (q.x*v.y - q.y*v.x);
+    return Vector3<T>(
+      v.x + q.w*tx + q.y*tz - q.z*ty,
+      v.y + q.w*ty + q.z*tx - q.x*tz,
+      v.z + q.w*tz + q.x*ty - q.y*tx);
+  }
+
+  template <typename T>
+  inline T dot(const Quaternion<T>& a, const Quaternion<T>& b)
+  {
+    return a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z;
+  }
+
+  template <typename T>
+  inline T norm(const Quaternion<T>& q)
+  {
+    return sqrt(dot(q, q));
+  }
+
+  template <typename T>
+  inline Quaternion<T> normalized(const Quaternion<T>& q)
+  {
+    const T s = 1 / norm(q);
+    return Quaternion<T>(q.w * s, q.x * s, q.y * s, q.z * s);
+  }
+
+  //!\brief Inverse rotation of a unit quaternion
+  template <typename T>
+  inline Quaternion<T> conjugate(const Quaternion<T>& q)
+  {
+    return Quaternion<T>(q.w, -q.x, -q.y, -q.z);
+  }
+
+  template <typename T>
+  inline Quaternion<T> inverse(const Quaternion<T>& q)
+  {
+    const T s = 1 / dot(q, q);
+    return Quaternion<T>(q.w * s, -q.x * s, -q.y * s, -q.z * s);
+  }
+
+  //!\brief Rotation matrix of a unit quaternion
+  template <typename T>
+  inline Matrix3<T> getRotation(const Quaternion<T>& q)
+  {
+    const T xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+    const T xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+    const T wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+    return Matrix3<T>(
+      1 - 2*(yy + zz), 2*(xy - wz), 2*(xz + wy),
+      2*(xy + wz), 1 - 2*(xx + zz), 2*(yz - wx),
+      2*(xz - wy), 2*(yz + wx), 1 - 2*(xx + yy));
+  }
+
+  template <typename T>
+  inline Matrix3<T> getRotation(const AxisAngle<T>& r)
+  {
+    const T s = sin(r.angle), c = cos(r.angle), b = 1 - c;
+    const Vector3<T>& a = r.axis;
+    return Matrix3<T>(
+      c + b*a.x*a.x, b*a.x*a.y - s*a.z, b*a.x*a.z + s*a.y,
+      b*a.x*a.y + s*a.z, c + b*a.y*a.y, b*a.y*a.z - s*a.x,
+      b*a.x*a.z - s*a.y, b*a.y*a.z + s*a.x, c + b*a.z*a.z);
+  }
+
+  //!\brief Unit quaternion of a rotation matrix with w >= 0 (Shepperd's method)
+  template <typename T>
+  inline Quaternion<T> getQuaternion(const Matrix3<T>& R)
+  {
+    // Take the square root of the largest of 4w^2, 4x^2, 4y^2 and 4z^2
+    const T trace = R.a00 + R.a11 + R.a22;
+    Quaternion<T> q;
+    if (trace >= R.a00 && trace >= R.a11 && trace >= R.a22) {
+      const T s = sqrt(1 + trace) * 2;
+      q = Quaternion<T>(s / 4, (R.a21 - R.a12) / s, (R.a02 - R.a20) / s, (R.a10 - R.a01) / s);
+    }
+    else if (R.a00 >= R.a11 && R.a00 >= R.a22) {
+      const T s = sqrt(1 + R.a00 - R.a11 - R.a22) * 2;
+      q = Quaternion<T>((R.a21 - R.a12) / s, s / 4, (R.a01 + R.a10) / s, (R.a02 + R.a20) / s);
+    }
+    else if (R.a11 >= R.a22) {
+      const T s = sqrt(1 - R.a00 + R.a11 - R.a22) * 2;
+      q = Quaternion<T>((R.a02 - R.a20) / s, (R.a01 + R.a10) / s, s / 4, (R.a12 + R.a21) / s);
+    }
+    else {
+      const T s = sqrt(1 - R.a00 - R.a11 + R.a22) * 2;
+      q = Quaternion<T>((R.a10 - R.a01) / s, (R.a02 + R.a20) / s, (R.a12 + R.a21) / s, s / 4);
+    }
+    return q.w < 0 ? Quaternion<T>(-q.w, -q.x, -q.y, -q.z) : q;
+  }
+
+  template <typename T>
+  inline Quaternion<T> getQuaternion(const AxisAngle<T>& r)
+  {
+    const T s = sin(r.angle / 2);
+    return Quaternion<T>(cos(r.angle / 2), r.axis.x * s, r.axis.y * s, r.axis.z * s);
+  }
+
+  //!\brief Quaternion of the rotation by the angle |w| around the axis w
+  template <typename T>
+  inline Quaternion<T> getQuaternion(const Vector3<T>& w)
+  {
+    const T theta2 = w.x*w.x + w.y*w.y + w.z*w.z;
+    T c, s;
+    if (theta2 < T(1e-8)) {
+      // Series of cos(t/2) and sin(t/2)/t
+      c = 1 - theta2 / 8;
+      s = T(0.5) - theta2 / 48;
+    }
+    else {
+      const T theta = sqrt(theta2);
+      c = cos(theta / 2);
+      s = sin(theta / 2) / theta;
+    }
+    return Quaternion<T>(c, w.x * s, w.y * s, w.z * s);
+  }
+
+  //!\brief Quaternion matching getRotationEuler(phi, theta, psi)
+  template <typename T>
+  inline Quaternion<T> getQuaternionEuler(const T& phi, const T& theta, const T& psi)
+  {
+    // Rz(-psi) Rx(-theta) Rz(-phi) with the two z rotations merged
+    const T ct = cos(theta / 2), st = sin(theta / 2);
+    const T sum = (phi + psi) / 2, difference = (phi - psi) / 2;
+    return Quaternion<T>(
+      ct * cos(sum), -st * cos(difference), -st * sin(difference), -ct * sin(sum));
+  }
+
+  //!\brief Axis and angle in [0, pi] of a unit quaternion
+  template <typename T>
+  inline AxisAngle<T> getAxisAngle(const Quaternion<T>& q)
+  {
+    const T s = sqrt(q.x*q.x + q.y*q.y + q.z*q.z);
+    if (s == 0)
+      return AxisAngle<T>(Vector3<T>(1, 0, 0), 0);
+    const T sign = q.w < 0 ? T(-1) : T(1);
+    return AxisAngle<T>(Vector3<T>(sign * q.x / s, sign * q.y / s, sign * q.z / s), 2 * atan2(s, sign * q.w));
+  }
+
+  //!\brief Spherical linear interpolation along the shortest arc, a at t = 0 and b at t = 1
+  template <typename T>
+  inline Quaternion<T> slerp(const Quaternion<T>& a, const Quaternion<T>& b, const T& t)
+  {
+    T d = dot(a, b);
+    const T sign = d < 0 ? T(-1) : T(1);
+    d *= sign;
+    T s0, s1;
+    if (d > T(0.9995)) {
+      // Nearly parallel, normalized lerp
+      s0 = 1 - t;
+      s1 = t;
+    }
+    else {
+      const T angle = acos(d), s = 1 / sin(angle);
+      s0 = sin((1 - t) * angle) * s;
+      s1 = sin(t * angle) * s;
+    }
+    s1 *= sign;
+    const Quaternion<T> q(
+      s0*a.w + s1*b.w, s0*a.x + s1*b.x, s0*a.y + s1*b.y, s0*a.z + s1*b.z);
+    return normalized(q);
+  }
+
+  //!\brief Batched composition out[i] = a[i] * b[i]. out may alias a or b.
+  template <typename T>
+  inline void compose(const Quaternion<T>* a, const Quaternion<T>* b, Quaternion<T>* out, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = a[i] * b[i];
+  }
+
+  //!\brief Batched point rotation out[i] = q * points[i]
+  template <typename T>
+  inline void rotatePoints(const Quaternion<T>& q, const Vector3<T>* points, Vector3<T>* out, size_t count)
+  {
+    for (size_t i = 0; i < count; ++i)
+      out[i] = q * points[i];
+  }
+
+  //!\brief Batched SLERP of unit quaternions out[i] = slerp(a[i], b[i], t[i]), t in [0, 1].
+  //! Accurate to about 1e-15 in double and to rounding in float. out may alias a or b.
+  template <typename T>
+  inline void slerp(const Quaternion<T>* a, const Quaternion<T>* b, const T* t, Quaternion<T>* out, size_t count)
+  {
+    // The interval is first halved at the normalized midpoint m of a and b, which leaves
+    // angles h of at most 45 degrees. There sin(u h) / sin(h) is a fast converging series
+    // in (cos(h) - 1) with coefficients c_0 = u and c_k = c_(k-1) (u^2 - k^2) / (k (2k + 1)).
+    // Blocks are processed in structure of arrays form and without branches so that the
+    // compiler vectorizes every pass except the square roots.
+    const int terms = sizeof(T) > 4 ? 16 : 8;
+    const size_t block = 16;
+    T p[4][block], q[4][block], x[block], scale[block], u[block], first[block];
+    for (size_t offset = 0; offset < count; offset += block) {
+      const size_t n = std::min(block, count - offset);
+      for (size_t j = 0; j < n; ++j) {
+        const Quaternion<T>& qa = a[offset + j];
+        const Quaternion<T>& qb = b[offset + j];
+        p[0][j] = qa.w; p[1][j] = qa.x; p[2][j] = qa.y; p[3][j] = qa.z;
+        q[0][j] = qb.w; q[1][j] = qb.x; q[2][j] = qb.y; q[3][j] = qb.z;
+        u[j] = t[offset + j];
+      }
+      for (size_t j = n; j < block; ++j) {
+        for (size_t c = 0; c < 4; ++c)
+          p[c][j] = q[c][j] = c == 0;
+        u[j] = 0;
+      }
+
+      // Shortest arc, then cos(h) = sqrt((1 + d) / 2) and |p + q| = sqrt(2 + 2d)
+      for (size_t j = 0; j < block; ++j) {
+        const T d = p[0][j]*q[0][j] + p[1][j]*q[1][j] + p[2][j]*q[2][j] + p[3][j]*q[3][j];
+        const T sign = d < 0 ? T(-1) : T(1);
+        for (size_t c = 0; c < 4; ++c)
+          q[c][j] *= sign;
+        x[j] = 2 + 2 * d * sign;
+      }
+      for (size_t j = 0; j < block; ++j)
+        scale[j] = 1 / std::sqrt(x[j]);
+      for (size_t j = 0; j < block; ++j) {
+        x[j] = x[j] * scale[j] / 2 - 1;
+        first[j] = u[j] < T(0.5);
+        u[j] = 2 * u[j] - (1 - first[j]);
+      }
+
+      for (size_t j = 0; j < block; ++j) {
+        const T v = 1 - u[j];
+        T cu = u[j], cv = v, su = u[j], sv = v, power = 1;
+        for (int k = 1; k < terms; ++k) {
+          const T k2 = T(k * k), divisor = T(1) / T(k * (2 * k + 1));
+          cu *= (u[j] * u[j] - k2) * divisor;
+          cv *= (v * v - k2) * divisor;
+          power *= x[j];
+          su += cu * power;
+          sv += cv * power;
+        }
+        // Weights of p and q for the half of the interval the sample falls in
+        const T mp = sv * scale[j], mq = su * scale[j];
+        const T wp = mp + first[j] * (sv + mq - mp);
+        const T wq = su + mp + first[j] * (mq - su - mp);
+        for (size_t c = 0; c < 4; ++c)
+          p[c][j] = wp * p[c][j] + wq * q[c][j];
+      }
+
+      for (size_t j = 0; j < n; ++j)
+        out[offset + j] = Quaternion<T>(p[0][j], p[1][j], p[2][j], p[3][j]);
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+#pragma once
+#include "Arena.h"
+#include "Types.h"
+
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+namespace dry
+{
+  //!\brief Element storage of the dynamic containers MatrixX and VectorX.
+  //! Up to inline_capacity elements live inside the object so small temporaries never allocate,
+  //! larger arrays go to the heap aligned to 64 bytes, or to an arena when one is given. Copies
+  //! are deep, a copy constructed container uses the heap and an assigned one keeps its arena.
+  //! Moves take over the buffer of the source together with its arena, leaving the source empty.
+  //! Inline elements only have the alignment of T: an over-aligned container could not be held
+  //! by operator new or std::vector before C++17, so the 64 byte guarantee is for larger arrays.
+  template <typename T>
+  class DynamicStorage
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Dynamic containers hold plain element types");
+
+  public:
+    static const size_t alignment = 64;
+    static const size_t inline_capacity = sizeof(T) < 128 ? 128 / sizeof(T) : 1;
+
+    T* v;
+    size_t size;
+
+    //!\brief Elements that fit without reallocating
+    size_t getCapacity() const { return capacity; }
+    bool isInline() const { return v == local; }
+    //!\brief Arena larger buffers come from, nullptr for the heap
+    Arena* getArena() const { return arena; }
+
+  protected:
+    DynamicStorage() : v(local), size(0), capacity(inline_capacity), arena(nullptr) {}
+    explicit DynamicStorage(size_t count) : DynamicStorage() { allocate(count); }
+    DynamicStorage(size_t count, Arena& arena) : DynamicStorage()
+    {
+      this->arena = &arena;
+      allocate(count);
+    }
+    DynamicStorage(const DynamicStorage& other) : DynamicStorage() { assign(other.v, other.size); }
+    DynamicStorage(DynamicStorage&& other) noexcept : DynamicStorage() { take(other); }
+    ~DynamicStorage() { release(); }
+
+    DynamicStorage& operator=(const DynamicStorage& other)
+    {
+      if (this != &other)
+        assign(other.v, other.size);
+      return *this;
+    }
+    DynamicStorage& operator=(DynamicStorage&& other) noexcept
+    {
+      if (this != &other) {
+        release();
+        take(other);
+      }
+      return *this;
+    }
+
+    //!\brief Set the size, the elements are unspecified afterwards.
+    //! The buffer is kept when it is large enough.
+    void allocate(size_t count)
+    {
+      if (count > capacity) {
+        release();
+        v = arena ? arena->allocate<T>(count) : allocateAligned(count);
+        capacity = count;
+      }
+      size = count;
+    }
+    void assign(const T* data, size_t count)
+    {
+      allocate(count);
+      if (count)
+        std::memcpy(v, data, count * sizeof(T));
+    }
+    void swapStorage(DynamicStorage& other) noexcept
+    {
+      DynamicStorage temporary(static_cast<DynamicStorage&&>(other));
+      other.take(*this);
+      take(temporary);
+    }
+
+  private:
+    //!\brief Move the elements of other into this empty storage, leaving other empty
+    void take(DynamicStorage& other) noexcept
+    {
+      arena = other.arena;
+      if (other.isInline()) {
+        std::memcpy(local, other.local, other.size * sizeof(T));
+      }
+      else {
+        v = other.v;
+        capacity = other.capacity;
+        other.v = other.local;
+        other.capacity = inline_capacity;
+      }
+      size = other.size;
+      other.size = 0;
+    }
+    void release() noexcept
+    {
+      if (!isInline() && !arena)
+        freeAligned(v);
+      v = local;
+      size = 0;
+      capacity = inline_capacity;
+    }
+
+    // The pointer returned by operator new is kept just below the aligned block
+    static T* allocateAligned(size_t count)
+    {
+      if (count > (size_t(-1) - alignment - sizeof(void*)) / sizeof(T))
+        throw std::bad_alloc();
+      void* raw = ::operator new(count * sizeof(T) + alignment + sizeof(void*));
+      const uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + alignment - 1) & ~uintptr_t(alignment - 1);
+      reinterpret_cast<void**>(aligned)[-1] = raw;
+      return reinterpret_cast<T*>(aligned);
+    }
+    static void freeAligned(T* data) noexcept
+    {
+      ::operator delete(reinterpret_cast<void**>(data)[-1]);
+    }
+
+    size_t capacity;
+    Arena* arena;
+    T local[inline_capacity];   //!< Not over-aligned, see above
+  };
+}
\ No newline at end of file
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "Camera.h"
+#include "Matrix.h"
+#include "Parallel.h"
+#include "Rotation.h"
+#include "Types.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace dry
+{
+  //!\brief Time indexed camera poses in structure of arrays form.
+  //! A pose is the camera orientation (camera to world) and position, as taken by
+  //! getCameraMatrix. Queries between samples interpolate the orientation by SLERP and the
+  //! position linearly, queries outside the samples clamp to the first or last pose.
+  template <typename T>
+  class Trajectory
+  {
+  public:
+    Trajectory() : inverse_step(0) {}
+
+    size_t size() const { return times.size(); }
+    bool empty() const { return times.empty(); }
+    float64 getStartTime() const { return times.front(); }
+    float64 getEndTime() const { return times.back(); }
+
+    void reserve(size_t count)
+    {
+      times.reserve(count);
+      for (size_t i = 0; i < 4; ++i)
+        orientation[i].reserve(count);
+      for (size_t i = 0; i < 3; ++i)
+        position[i].reserve(count);
+    }
+    void clear()
+    {
+      times.clear();
+      for (size_t i = 0; i < 4; ++i)
+        orientation[i].clear();
+      for (size_t i = 0; i < 3; ++i)
+        position[i].clear();
+      inverse_step = 0;
+    }
+
+    //!\brief Append a pose, times must be increasing
+    void add(float64 time, const Quaternion<T>& q, const Vector3<T>& c)
+    {
+      // Keep consecutive quaternions on the same hemisphere
+      T sign = T(1);
+      if (!times.empty() && q.w*orientation[0].back() + q.x*orientation[1].back() +
+        q.y*orientation[2].back() + q.z*orientation[3].back() < 0)
+        sign = T(-1);
+      times.push_back(time);
+      orientation[0].push_back(sign * q.w);
+      orientation[1].push_back(sign * q.x);
+      orientation[2].push_back(sign * q.y);
+      orientation[3].push_back(sign * q.z);
+      position[0].push_back(c.x);
+      position[1].push_back(c.y);
+      position[2].push_back(c.z);
+
+      // Mean sample rate, used to guess the segment of a time
+      const size_t n = times.size();
+      inverse_step = n > 1 && time > times[0] ? float64(n - 1) / (time - times[0]) : 0;
+    }
+    void add(float64 time, const Matrix3x4<T>& camera)
+    {
+      add(time, getQuaternion(getRotation(camera)), dry::getPosition(camera));
+    }
+
+    Quaternion<T> getOrientation(size_t index) const
+    {
+      return Quaternion<T>(orientation[0][index], orientation[1][index], orientation[2][index], orientation[3][index]);
+    }
+    Vector3<T> getPosition(size_t index) const
+    {
+      return Vector3<T>(position[0][index], position[1][index], position[2][index]);
+    }
+
+    //!\brief Segment [index, index + 1] containing time and the fraction along it.
+    //! The hint, such as the segment of the previous query, is tried before searching.
+    size_t findSegment(float64 time, T& fraction, size_t hint = 0) const
+    {
+      const size_t n = times.size();
+      if (n < 2 || !(time > times[0])) {
+        fraction = T(0);
+        return 0;
+      }
+      if (!(time < times[n - 1])) {
+        fraction = T(1);
+        return n - 2;
+      }
+      size_t index;
+      if (hint + 1 < n && times[hint] <= time && time < times[hint + 1])
+        index = hint;
+      else if (hint + 2 < n && times[hint + 1] <= time && time < times[hint + 2])
+        index = hint + 1;
+      else {
+        // Gallop from the guess, exact for uniformly sampled trajectories
+        size_t low = std::min(size_t((time - times[0]) * inverse_step), n - 2), high = low + 1;
+        for (size_t step = 1; low > 0 && times[low] > time; step *= 2) {
+          high = low;
+          low = low > step ? low - step : 0;
+        }
+        for (size_t step = 1; high < n - 1 && times[high] <= time; step *= 2) {
+          low = high;
+          high = std::min(high + step, n - 1);
+        }
+        index = size_t(std::upper_bound(times.begin() + low, times.begin() + high, time) - times.begin()) - 1;
+      }
+      const float64 span = times[index + 1] - times[index];
+      fraction = T(span > 0 ? std::min(std::max((time - times[index]) / span, 0.0), 1.0) : 0.0);
+      return index;
+    }
+
+    //!\brief Interpolated orientation and position
+    void getPose(float64 time, Quaternion<T>& q, Vector3<T>& c) const
+    {
+      T u;
+      const size_t i = findSegment(time, u);
+      const size_t j = std::min(i + 1, times.size() - 1);
+      q = slerp(getOrientation(i), getOrientation(j), u);
+      c = Vector3<T>(
+        position[0][i] + u * (position[0][j] - position[0][i]),
+        position[1][i] + u * (position[1][j] - position[1][i]),
+        position[2][i] + u * (position[2][j] - position[2][i]));
+    }
+
+    //!\brief Interpolated camera matrix
+    Matrix3x4<T> getCamera(float64 time) const
+    {
+      Matrix3x4<T> camera;
+      interpolate(1, 1, [time](size_t) { return time; }, &camera);
+      return camera;
+    }
+
+    //!\brief Camera matrices at many times, fastest when the times are sorted
+    void getCameras(const float64* query_times, size_t count, Matrix3x4<T>* cameras, size_t threads = 0) const
+    {
+      interpolate(count, threads, [query_times](size_t i) { return query_times[i]; }, cameras);
+    }
+
+    //!\brief Camera matrices of the rows of a rolling shutter image, row r exposed at
+    //! start_time + r * line_delay
+    void getRollingShutterCameras(float64 start_time, float64 line_delay, size_t rows, Matrix3x4<T>* cameras,
+      size_t threads = 0) const
+    {
+      interpolate(rows, threads, [start_time, line_delay](size_t r) { return start_time + float64(r) * line_delay; }, cameras);
+    }
+
+  private:
+    //!\brief Blocks of queries gather their segment end points, interpolate them with the
+    //! batched SLERP and write the camera matrices directly from the quaternions.
+    template <typename F>
+    void interpolate(size_t count, size_t threads, const F& timeOf, Matrix3x4<T>* cameras) const
+    {
+      if (times.empty())
+        return;
+      const size_t min_chunk = 1 << 12;
+      const size_t last = times.size() - 1;
+      parallelFor(count, std::min(threads == 0 ? ThreadPool::global().getThreadCount() : threads, count / min_chunk + 1),
+        [&](size_t begin, size_t end, size_t) {
+          const size_t block = 64;
+          Quaternion<T> a[block], b[block], q[block];
+          T u[block];
+          size_t segment[block];
+          size_t hint = 0;
+          for (size_t offset = begin; offset < end; offset += block) {
+            const size_t n = std::min(block, end - offset);
+            for (size_t k = 0; k < n; ++k) {
+              hint = findSegment(timeOf(offset + k), u[k], hint);
+              segment[k] = hint;
+              a[k] = getOrientation(hint);
+              b[k] = getOrientation(std::min(hint + 1, last));
+            }
+            slerp(a, b, u, q, n);
+
+            for (size_t k = 0; k < n; ++k) {
+              const size_t i = segment[k], j = std::min(i + 1, last);
+              const T cx = position[0][i] + u[k] * (position[0][j] - position[0][i]);
+              const T cy = position[1][i] + u[k] * (position[1][j] - position[1][i]);
+              const T cz = position[2][i] + u[k] * (position[2][j] - position[2][i]);
+
+              // [R^T | -R^T c] with R = getRotation(q)
+              const Quaternion<T>& r = q[k];
+              const T xx = r.x*r.x, yy = r.y*r.y, zz = r.z*r.z;
+              const T xy = r.x*r.y, xz = r.x*r.z, yz = r.y*r.z;
+              const T wx = r.w*r.x, wy = r.w*r.y, wz = r.w*r.z;
+              const T r00 = 1 - 2*(yy + zz), r01 = 2*(xy + wz), r02 = 2*(xz - wy);
+              const T r10 = 2*(xy - wz), r11 = 1 - 2*(xx + zz), r12 = 2*(yz + wx);
+              const T r20 = 2*(xz + wy), r21 = 2*(yz - wx), r22 = 1 - 2*(xx + yy);
+              cameras[offset + k] = Matrix3x4<T>(
+                r00, r01, r02, -(r00*cx + r01*cy + r02*cz),
+                r10, r11, r12, -(r10*cx + r11*cy + r12*cz),
+                r20, r21, r22, -(r20*cx + r21*cy + r22*cz));
+            }
+          }
+        });
+    }
+
+    std::vector<float64> times;
+    std::vector<T> orientation[4];  //!< w, x, y, z
+    std::vector<T> position[3];     //!< x, y, z
+    float64 inverse_step;           //!< Samples per unit of time
+  };
+
+  typedef Trajectory<float32> Trajectoryf;
+  typedef Trajectory<float64> Trajectoryd;
+}
\ No newline at end of file
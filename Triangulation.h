@@ -0,0 +1,235 @@
+#pragma once
+
+#include "FixedSolvers.h"
+#include "MatrixOperations.h"
+#include "Parallel.h"
+#include "VectorOperations.h"
+
+#include <cmath>
+#include <limits>
+
+namespace dry
+{
+  enum class TriangulationMethod
+  {
+    DLT,        //!< Null vector of the stacked projection constraints
+    Midpoint    //!< Point closest to all viewing rays
+  };
+
+  struct TriangulationOptions
+  {
+    TriangulationMethod method = TriangulationMethod::DLT;
+    size_t refine_iterations = 0;   //!< Gauss-Newton steps on the reprojection error after the linear solution
+    double max_error = 0;           //!< Reject points with a larger reprojection error in any view, 0 disables
+    size_t threads = 0;             //!< 0 uses every available thread
+  };
+
+  // In the functions below view k of a track is seen by cameras[camera_indices[k]], or by
+  // cameras[k] when camera_indices is null, at the image position measurements[k].
+
+  //!\brief Linear triangulation from two or more views.
+  //! Returns false for points at infinity.
+  template <typename T>
+  inline bool triangulateDLT(const Matrix3x4<T>* cameras, const uint32* camera_indices, const Vector2<T>* measurements,
+    size_t count, Vector3<T>& X)
+  {
+    if (count < 2)
+      return false;
+    MatrixN<double, 4> A;
+    A.Set(0.0);
+    for (size_t k = 0; k < count; ++k) {
+      const Matrix3x4<T>& P = cameras[camera_indices ? camera_indices[k] : k];
+      const double x = double(measurements[k].x), y = double(measurements[k].y);
+      double rows[2][4];
+      for (size_t c = 0; c < 4; ++c) {
+        rows[0][c] = x * double(P(2, c)) - double(P(0, c));
+        rows[1][c] = y * double(P(2, c)) - double(P(1, c));
+      }
+      // Unit rows keep views with different scales equally weighted
+      for (size_t r = 0; r < 2; ++r) {
+        double norm2 = 0;
+        for (size_t c = 0; c < 4; ++c)
+          norm2 += rows[r][c] * rows[r][c];
+        if (norm2 == 0)
+          continue;
+        const double s = 1.0 / norm2;
+        for (size_t a = 0; a < 4; ++a)
+          for (size_t b = a; b < 4; ++b)
+            A(a, b) += s * rows[r][a] * rows[r][b];
+      }
+    }
+
+    // Fixing w = 1 leaves a 3x3 solve, points near infinity fall back to the null vector
+    const Matrix3d B(
+      A(0, 0), A(0, 1), A(0, 2),
+      A(0, 1), A(1, 1), A(1, 2),
+      A(0, 2), A(1, 2), A(2, 2));
+    if (det(B) > 1e-12 * std::pow(B.a00 + B.a11 + B.a22, 3)) {
+      const Vector3d x = inverse(B) * Vector3d(-A(0, 3), -A(1, 3), -A(2, 3));
+      X = Vector3<T>(T(x.x), T(x.y), T(x.z));
+      return true;
+    }
+
+    for (size_t a = 0; a < 4; ++a)
+      for (size_t b = 0; b < a; ++b)
+        A(a, b) = A(b, a);
+    VectorN<double, 4> h;
+    getNullVector(A, h);
+    if (!(std::abs(h[3]) > 1e-12 * (std::abs(h[0]) + std::abs(h[1]) + std::abs(h[2]))))
+      return false;
+    X = Vector3<T>(T(h[0] / h[3]), T(h[1] / h[3]), T(h[2] / h[3]));
+    return true;
+  }
+
+  //!\brief Point minimizing the sum of squared distances to the viewing rays of two or more views.
+  //! Returns false if the rays are parallel.
+  template <typename T>
+  inline bool triangulateMidpoint(const Matrix3x4<T>* cameras, const uint32* camera_indices, const Vector2<T>* measurements,
+    size_t count, Vector3<T>& X)
+  {
+    if (count < 2)
+      return false;
+    // sum (I - d d^T) X = sum (I - d d^T) c over the rays c + s d
+    Matrix3d A(0, 0, 0, 0, 0, 0, 0, 0, 0);
+    Vector3d b(0, 0, 0);
+    for (size_t k = 0; k < count; ++k) {
+      const Matrix3x4<T>& P = cameras[camera_indices ? camera_indices[k] : k];
+      const Matrix3d M(
+        P.a00, P.a01, P.a02,
+        P.a10, P.a11, P.a12,
+        P.a20, P.a21, P.a22);
+      const Matrix3d Minv = inverse(M);
+      const Vector3d c = (Minv * Vector3d(P.a03, P.a13, P.a23)) * -1.0;
+      const Vector3d d = normalized(Minv * Vector3d(measurements[k].x, measurements[k].y, 1.0));
+      if (!std::isfinite(c.x + c.y + c.z + d.x + d.y + d.z))
+        return false;
+      for (size_t r = 0; r < 3; ++r) {
+        for (size_t s = 0; s < 3; ++s) {
+          const double a = (r == s ? 1.0 : 0.0) - d[r] * d[s];
+          A(r, s) += a;
+          b[r] += a * c[s];
+        }
+      }
+    }
+    const double determinant = det(A);
+    if (!(std::abs(determinant) > 1e-12 * std::pow(A(0, 0) + A(1, 1) + A(2, 2), 3)))
+      return false;
+    const Vector3d x = inverse(A) * b;
+    X = Vector3<T>(T(x.x), T(x.y), T(x.z));
+    return true;
+  }
+
+  //!\brief Gauss-Newton steps on the sum of squared reprojection errors of X.
+  //! Returns the final sum, or infinity if X is behind any of the cameras.
+  template <typename T>
+  inline double refineTriangulation(const Matrix3x4<T>* cameras, const uint32* camera_indices, const Vector2<T>* measurements,
+    size_t count, Vector3<T>& X, size_t iterations)
+  {
+    Vector3d x(X.x, X.y, X.z);
+    double cost = 0;
+    for (size_t iteration = 0; iteration <= iterations; ++iteration) {
+      MatrixN<double, 3> JTJ;
+      VectorN<double, 3> JTf, step;
+      JTJ.Set(0.0);
+      JTf.Set(0.0);
+      cost = 0;
+      for (size_t k = 0; k < count; ++k) {
+        const Matrix3x4<T>& P = cameras[camera_indices ? camera_indices[k] : k];
+        const double p[3] = {
+          P.a00*x.x + P.a01*x.y + P.a02*x.z + P.a03,
+          P.a10*x.x + P.a11*x.y + P.a12*x.z + P.a13,
+          P.a20*x.x + P.a21*x.y + P.a22*x.z + P.a23 };
+        if (!(p[2] > 0))
+          return std::numeric_limits<double>::infinity();
+        const double iz = 1.0 / p[2];
+        const double u = p[0] * iz, v = p[1] * iz;
+        const double f[2] = { u - double(measurements[k].x), v - double(measurements[k].y) };
+        cost += f[0] * f[0] + f[1] * f[1];
+        double J[2][3];
+        for (size_t c = 0; c < 3; ++c) {
+          J[0][c] = (double(P(0, c)) - u * double(P(2, c))) * iz;
+          J[1][c] = (double(P(1, c)) - v * double(P(2, c))) * iz;
+        }
+        for (size_t a = 0; a < 3; ++a) {
+          for (size_t b = a; b < 3; ++b)
+            JTJ(a, b) += J[0][a] * J[0][b] + J[1][a] * J[1][b];
+          JTf[a] -= J[0][a] * f[0] + J[1][a] * f[1];
+        }
+      }
+      if (iteration == iterations || !choleskySolve(JTJ, JTf, step))
+        break;
+      x = x + Vector3d(step[0], step[1], step[2]);
+    }
+    X = Vector3<T>(T(x.x), T(x.y), T(x.z));
+    return cost;
+  }
+
+  //!\brief Triangulate one track with the given options.
+  //! Returns false if the point is at infinity, behind a camera or above the error threshold.
+  template <typename T>
+  inline bool triangulatePoint(const Matrix3x4<T>* cameras, const uint32* camera_indices, const Vector2<T>* measurements,
+    size_t count, Vector3<T>& X, const TriangulationOptions& options = TriangulationOptions())
+  {
+    const bool linear = options.method == TriangulationMethod::Midpoint ?
+      triangulateMidpoint(cameras, camera_indices, measurements, count, X) :
+      triangulateDLT(cameras, camera_indices, measurements, count, X);
+    if (!linear)
+      return false;
+
+    // The refinement also checks that the point is in front of every camera. If a step
+    // crosses behind a camera the linear solution is kept when it passes the check.
+    const double infinity = std::numeric_limits<double>::infinity();
+    Vector3<T> refined = X;
+    if (refineTriangulation(cameras, camera_indices, measurements, count, refined, options.refine_iterations) < infinity)
+      X = refined;
+    else if (options.refine_iterations == 0 || !(refineTriangulation(cameras, camera_indices, measurements, count, X, 0) < infinity))
+      return false;
+    if (options.max_error > 0) {
+      const double max_error2 = options.max_error * options.max_error;
+      for (size_t k = 0; k < count; ++k) {
+        const Matrix3x4<T>& P = cameras[camera_indices ? camera_indices[k] : k];
+        const double z = P.a20*X.x + P.a21*X.y + P.a22*X.z + P.a23;
+        const double dx = (P.a00*X.x + P.a01*X.y + P.a02*X.z + P.a03) / z - measurements[k].x;
+        const double dy = (P.a10*X.x + P.a11*X.y + P.a12*X.z + P.a13) / z - measurements[k].y;
+        if (!(dx*dx + dy*dy <= max_error2))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  //!\brief Triangulate many tracks in parallel. Track t consists of the views
+  //! [track_offsets[t], track_offsets[t + 1]) of camera_indices and measurements. Without
+  //! camera_indices view k of every track is seen by cameras[k].
+  //! valid, if given, receives one flag per track. Returns the number of triangulated points.
+  template <typename T>
+  inline size_t triangulatePoints(const Matrix3x4<T>* cameras, const uint32* camera_indices, const Vector2<T>* measurements,
+    const uint32* track_offsets, size_t track_count, Vector3<T>* points, uint8* valid = nullptr,
+    const TriangulationOptions& options = TriangulationOptions())
+  {
+    // Chunks of at least 4k tracks keep the scheduling cost small against the 4x4 solves
+    const size_t min_chunk = 4096;
+    const size_t max_chunks = 64;
+    size_t threads = options.threads == 0 ? ThreadPool::global().getThreadCount() : options.threads;
+    threads = std::min(std::min(threads, max_chunks), std::max(size_t(1), track_count / min_chunk));
+
+    size_t counts[max_chunks] = {};
+    parallelFor(track_count, threads, [&](size_t begin, size_t end, size_t chunk) {
+      size_t n = 0;
+      for (size_t t = begin; t < end; ++t) {
+        const size_t first = track_offsets[t];
+        const bool ok = triangulatePoint(cameras, camera_indices ? camera_indices + first : nullptr, measurements + first,
+          track_offsets[t + 1] - first, points[t], options);
+        n += ok;
+        if (valid)
+          valid[t] = ok;
+      }
+      counts[chunk] = n;
+    });
+
+    size_t total = 0;
+    for (size_t chunk = 0; chunk < max_chunks; ++chunk)
+      total += counts[chunk];
+    return total;
+  }
+}
\ No newline at end of file
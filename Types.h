@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 // Basic int types
 typedef unsigned char uint8;
 typedef char int8;
@@ -1,68 +1,141 @@
 #pragma once
 
+#include "Expression.h"
+#include "Storage.h"
 #include "Types.h"
 
+#include <cmath>
+
 namespace dry
 {
   template <typename T>
-  class VectorX
+  class VectorX : public DynamicStorage<T>
   {
   public:
-    VectorX(size_t elements) : size(elements) 
+    using DynamicStorage<T>::v;
+    using DynamicStorage<T>::size;
+
+    VectorX() {}
+    VectorX(size_t elements) : DynamicStorage<T>(elements) {}
+    //!\brief Elements in an arena, as are the buffers of later resizes.
+    //! The vector must not be used after the arena is reset or rewound past it.
+    VectorX(size_t elements, Arena& arena) : DynamicStorage<T>(elements, arena) {}
+    explicit VectorX(Arena& arena) : DynamicStorage<T>(0, arena) {}
+
+    template <typename U>
+    VectorX(const VectorX<U>& other) : DynamicStorage<T>(other.size)
     {
-      v = new T[size];
-    };
-    ~VectorX()
+      for (size_t i = 0; i < size; ++i)
+        v[i] = T(other.v[i]);
+    }
+
+    //!\brief Evaluate an elementwise expression such as a*s + b - c
+    template <typename E>
+    VectorX(const Expression<E>& e) : DynamicStorage<T>(e.derived().getRows() * e.derived().getCols())
     {
-      delete[] v;
+      evaluate(e, v);
     }
+    //!\brief Evaluate an expression, which may refer to this vector, without a temporary.
+    //! Only a result that outgrows the buffer is written to a new one, as the old one may
+    //! still be read by the expression.
+    template <typename E>
+    VectorX& operator=(const Expression<E>& e)
+    {
+      const size_t count = e.derived().getRows() * e.derived().getCols();
+      if (count > this->getCapacity()) {
+        VectorX result = this->getArena() ? VectorX(count, *this->getArena()) : VectorX(count);
+        evaluate(e, result.v);
+        swap(result);
+      }
+      else {
+        resize(count);
+        evaluate(e, v);
+      }
+      return *this;
+    }
+
+    void swap(VectorX& other) noexcept { this->swapStorage(other); }
 
-    T* v;
+    //!\brief Change the size, the elements are unspecified afterwards.
+    //! Keeps the buffer when it is large enough so workspaces can be reused.
+    void resize(size_t elements) { this->allocate(elements); }
 
     T& operator[](size_t idx) { return v[idx]; }
     const T& operator[](size_t idx) const { return v[idx]; }
 
     template <typename U>
-    VectorX operator*=(U f)
+    VectorX& operator*=(U f)
     {
       for (size_t i = 0; i < size; ++i)
         v[i] *= f;
       return *this;
     }
     template <typename U>
-    VectorX operator/=(U f)
+    VectorX& operator/=(U f)
     {
       for (size_t i = 0; i < size; ++i)
         v[i] /= f;
       return *this;
     }
     template <typename U>
-    VectorX operator+=(U f)
+    typename std::enable_if<!ExpressionOperand<U>::value, VectorX&>::type operator+=(U f)
     {
       for (size_t i = 0; i < size; ++i)
         v[i] += f;
       return *this;
     }
     template <typename U>
-    VectorX operator-=(U f)
+    typename std::enable_if<!ExpressionOperand<U>::value, VectorX&>::type operator-=(U f)
     {
       for (size_t i = 0; i < size; ++i)
         v[i] -= f;
       return *this;
     }
 
-    T norm() { 
+    template <typename U>
+    typename std::enable_if<ExpressionOperand<U>::value, VectorX&>::type operator+=(const U& other)
+    {
+      return *this = *this + other;
+    }
+    template <typename U>
+    typename std::enable_if<ExpressionOperand<U>::value, VectorX&>::type operator-=(const U& other)
+    {
+      return *this = *this - other;
+    }
+
+    VectorX& Set(const T& value)
+    {
+      for (size_t i = 0; i < size; ++i)
+        v[i] = value;
+      return *this;
+    }
+
+    T norm() const {
       return std::sqrt(norm2());
     }
-    T norm2()
-    { 
+    T norm2() const
+    {
       T sum(0);
       for (size_t i = 0; i < size; ++i)
-        v[i] += v[i] * v[i];
+        sum += v[i] * v[i];
       return sum;
     }
   };
 
+  template <typename T>
+  struct ExpressionOperand<VectorX<T>>
+  {
+    static const bool value = true;
+    typedef ArrayExpression<T> Type;
+    static Type get(const VectorX<T>& x) { return Type(x.v, x.size, 1); }
+  };
+
+  template <typename T>
+  inline void swap(VectorX<T>& a, VectorX<T>& b) noexcept
+  {
+    a.swap(b);
+  }
+
   template <typename T>
   class Vector2
   {
@@ -105,8 +178,8 @@ namespace dry
       return *this;
     }
 
-    T norm() { return std::sqrt(vec.x*vec.x + vec.y*vec.y); }
-    T norm2() { return vec.x*vec.x + vec.y*vec.y; }
+    T norm() const { return std::sqrt(x*x + y*y); }
+    T norm2() const { return x*x + y*y; }
   };
 
   template <typename T>
@@ -156,8 +229,8 @@ namespace dry
       return *this;
     }
 
-    T norm() { return std::sqrt(vec.x*vec.x + vec.y*vec.y + vec.z*vec.z); }
-    T norm2() { return vec.x*vec.x + vec.y*vec.y + vec.z*vec.z; }
+    T norm() const { return std::sqrt(x*x + y*y + z*z); }
+    T norm2() const { return x*x + y*y + z*z; }
   };
 
   template <typename T>
@@ -212,8 +285,80 @@ namespace dry
       return *this;
     }
 
-    T norm() { return std::sqrt(vec.x*vec.x + vec.y*vec.y + vec.z*vec.z + vec.w*vec.w); }
-    T norm2() { return vec.x*vec.x + vec.y*vec.y + vec.z*vec.z + vec.w*vec.w; }
+    T norm() const { return std::sqrt(x*x + y*y + z*z + w*w); }
+    T norm2() const { return x*x + y*y + z*z + w*w; }
+  };
+
+  template <typename T, size_t N>
+  class VectorN
+  {
+  public:
+    VectorN() {}
+
+    T& operator[](size_t idx) { return v[idx]; }
+    const T& operator[](size_t idx) const { return v[idx]; }
+
+    T v[N];
+
+    static const size_t size = N;
+
+    VectorN& Set(const T& value)
+    {
+      for (size_t i = 0; i < N; ++i)
+        v[i] = value;
+      return *this;
+    }
+
+    T norm() const { return std::sqrt(norm2()); }
+    T norm2() const
+    {
+      T sum(0);
+      for (size_t i = 0; i < N; ++i)
+        sum += v[i] * v[i];
+      return sum;
+    }
+  };
+
+  //!\brief Non-owning view of an array of 2D points, x and y may live in separate arrays.
+  //! Element i is (x[i*stride], y[i*stride]).
+  template <typename T>
+  class Vector2View
+  {
+  public:
+    Vector2View() : x(nullptr), y(nullptr), count(0), stride(1) {}
+    Vector2View(const T* x, const T* y, size_t count, size_t stride = 1) : x(x), y(y), count(count), stride(stride) {}
+
+    //!\brief View of interleaved x, y pairs such as an array of Vector2<T>
+    static Vector2View Interleaved(const T* xy, size_t count) { return Vector2View(xy, xy + 1, count, 2); }
+
+    Vector2<T> operator[](size_t idx) const { return Vector2<T>(x[idx*stride], y[idx*stride]); }
+    size_t size() const { return count; }
+
+    const T* x;
+    const T* y;
+    size_t count;
+    size_t stride;
+  };
+
+  //!\brief Non-owning view of an array of 3D points, element i is (x[i*stride], y[i*stride], z[i*stride])
+  template <typename T>
+  class Vector3View
+  {
+  public:
+    Vector3View() : x(nullptr), y(nullptr), z(nullptr), count(0), stride(1) {}
+    Vector3View(const T* x, const T* y, const T* z, size_t count, size_t stride = 1) : x(x), y(y), z(z), count(count), stride(stride) {}
+
+    //!\brief View of interleaved x, y, z triplets such as an array of Vector3<T>
+    static Vector3View Interleaved(const T* xyz, size_t count) { return Vector3View(xyz, xyz + 1, xyz + 2, count, 3); }
+
+    Vector3<T> operator[](size_t idx) const { return Vector3<T>(x[idx*stride], y[idx*stride], z[idx*stride]); }
+    size_t size() const { return count; }
+
+    const T* x;
+    const T* y;
+    const T* z;
+    size_t count;
+    size_t stride;
   };
 
   typedef VectorX<float32> VectorXf;
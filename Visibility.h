@@ -0,0 +1,471 @@
+#pragma once
+
+#include "Matrix.h"
+#include "Parallel.h"
+#include "Types.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace dry
+{
+  //!\brief Axis aligned bounding box, empty (min > max) when default constructed
+  template <typename T>
+  class BoundingBox
+  {
+  public:
+    BoundingBox()
+      : min(std::numeric_limits<T>::max(), std::numeric_limits<T>::max(), std::numeric_limits<T>::max())
+      , max(std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest()) {}
+    BoundingBox(const Vector3<T>& min, const Vector3<T>& max) : min(min), max(max) {}
+
+    void extend(const Vector3<T>& p)
+    {
+      min = Vector3<T>(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+      max = Vector3<T>(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+    void extend(const BoundingBox& box)
+    {
+      min = Vector3<T>(std::min(min.x, box.min.x), std::min(min.y, box.min.y), std::min(min.z, box.min.z));
+      max = Vector3<T>(std::max(max.x, box.max.x), std::max(max.y, box.max.y), std::max(max.z, box.max.z));
+    }
+
+    bool isEmpty() const { return !(min.x <= max.x && min.y <= max.y && min.z <= max.z); }
+    bool contains(const Vector3<T>& p) const
+    {
+      return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z;
+    }
+    bool intersects(const BoundingBox& box) const
+    {
+      return min.x <= box.max.x && box.min.x <= max.x && min.y <= box.max.y && box.min.y <= max.y &&
+        min.z <= box.max.z && box.min.z <= max.z;
+    }
+
+    Vector3<T> getCenter() const { return Vector3<T>((min.x + max.x) / 2, (min.y + max.y) / 2, (min.z + max.z) / 2); }
+    Vector3<T> getSize() const { return Vector3<T>(max.x - min.x, max.y - min.y, max.z - min.z); }
+
+    Vector3<T> min;
+    Vector3<T> max;
+  };
+
+  typedef BoundingBox<float32> BoundingBoxf;
+  typedef BoundingBox<float64> BoundingBoxd;
+
+  //!\brief Plane normal . x + d = 0, points with a positive distance are on the normal side
+  template <typename T>
+  class Plane
+  {
+  public:
+    Plane() {};
+    Plane(const Vector3<T>& normal, const T& d) : normal(normal), d(d) {}
+
+    T getDistance(const Vector3<T>& p) const { return normal.x*p.x + normal.y*p.y + normal.z*p.z + d; }
+
+    Vector3<T> normal;
+    T d;
+  };
+
+  enum class Containment
+  {
+    Outside,
+    Intersects,
+    Inside
+  };
+
+  //!\brief Convex view volume bounded by six planes with inward normals
+  template <typename T>
+  class Frustum
+  {
+  public:
+    enum { Left, Right, Top, Bottom, Near, Far, PlaneCount };
+
+    bool contains(const Vector3<T>& p) const
+    {
+      for (size_t i = 0; i < PlaneCount; ++i)
+        if (planes[i].getDistance(p) < 0)
+          return false;
+      return true;
+    }
+
+    //!\brief Classify a box against the planes whose bits are set in mask. Planes the box is
+    //! entirely inside of are cleared from mask, so that children of a box skip them.
+    Containment classify(const BoundingBox<T>& box, uint8& mask) const
+    {
+      for (size_t i = 0; i < PlaneCount; ++i) {
+        if (!(mask & (1 << i)))
+          continue;
+        const Plane<T>& plane = planes[i];
+        // Box corners farthest along and against the normal
+        const Vector3<T> far_corner(
+          plane.normal.x >= 0 ? box.max.x : box.min.x,
+          plane.normal.y >= 0 ? box.max.y : box.min.y,
+          plane.normal.z >= 0 ? box.max.z : box.min.z);
+        const Vector3<T> near_corner(
+          plane.normal.x >= 0 ? box.min.x : box.max.x,
+          plane.normal.y >= 0 ? box.min.y : box.max.y,
+          plane.normal.z >= 0 ? box.min.z : box.max.z);
+        if (plane.getDistance(far_corner) < 0)
+          return Containment::Outside;
+        if (plane.getDistance(near_corner) >= 0)
+          mask &= ~(1 << i);
+      }
+      return mask ? Containment::Intersects : Containment::Inside;
+    }
+    Containment classify(const BoundingBox<T>& box) const
+    {
+      uint8 mask = (1 << PlaneCount) - 1;
+      return classify(box, mask);
+    }
+
+    Plane<T> planes[PlaneCount];
+  };
+
+  //!\brief View frustum of a camera matrix for the image [0, width] x [0, height] between
+  //! the depths near and far. A far depth of 0 leaves the frustum open.
+  template <typename T>
+  inline Frustum<T> getFrustum(const Matrix3x4<T>& camera, const T& width, const T& height, const T& near, const T& far = T(0))
+  {
+    // Rows r of the camera give u w = r0 X, v w = r1 X and w = r2 X, scaled so that w > 0 in front
+    const T orientation =
+      camera.a00 * (camera.a11 * camera.a22 - camera.a21 * camera.a12) -
+      camera.a01 * (camera.a10 * camera.a22 - camera.a12 * camera.a20) +
+      camera.a02 * (camera.a10 * camera.a21 - camera.a11 * camera.a20) < 0 ? T(-1) : T(1);
+    T rows[3][4];
+    for (size_t r = 0; r < 3; ++r)
+      for (size_t c = 0; c < 4; ++c)
+        rows[r][c] = orientation * camera(r, c);
+    const T depth_scale = std::sqrt(rows[2][0]*rows[2][0] + rows[2][1]*rows[2][1] + rows[2][2]*rows[2][2]);
+
+    // Plane coefficients h with h . (X, 1) >= 0 inside
+    T h[Frustum<T>::PlaneCount][4];
+    for (size_t c = 0; c < 4; ++c) {
+      h[Frustum<T>::Left][c] = rows[0][c];
+      h[Frustum<T>::Right][c] = width * rows[2][c] - rows[0][c];
+      h[Frustum<T>::Top][c] = rows[1][c];
+      h[Frustum<T>::Bottom][c] = height * rows[2][c] - rows[1][c];
+      h[Frustum<T>::Near][c] = rows[2][c] / depth_scale;
+      h[Frustum<T>::Far][c] = -rows[2][c] / depth_scale;
+    }
+    h[Frustum<T>::Near][3] -= near;
+    h[Frustum<T>::Far][3] += far;
+
+    Frustum<T> frustum;
+    for (size_t i = 0; i < Frustum<T>::PlaneCount; ++i) {
+      const T norm = std::sqrt(h[i][0]*h[i][0] + h[i][1]*h[i][1] + h[i][2]*h[i][2]);
+      frustum.planes[i] = Plane<T>(Vector3<T>(h[i][0] / norm, h[i][1] / norm, h[i][2] / norm), h[i][3] / norm);
+    }
+    if (!(far > 0))
+      frustum.planes[Frustum<T>::Far] = Plane<T>(Vector3<T>(0, 0, 0), 1);
+    return frustum;
+  }
+
+  struct BvhOptions
+  {
+    size_t leaf_size = 16;  //!< Largest number of primitives in a leaf
+    size_t threads = 0;     //!< 0 uses every available thread
+  };
+
+  //!\brief Bounding volume hierarchy over points, triangles or boxes.
+  //! Primitives are sorted by the Morton code of their centers and every node splits its
+  //! range of the sorted order in two halves by count. Nodes are stored depth first so that
+  //! every subtree is a contiguous range of nodes and of getIndices(). The
+  //! layout only depends on the primitive count, which lets subtrees build in parallel and
+  //! refit() update the bounds of moved primitives without rebuilding.
+  template <typename T>
+  class Bvh
+  {
+  public:
+    struct Node
+    {
+      BoundingBox<T> bounds;
+      uint32 first;   //!< First primitive of the subtree in getIndices()
+      uint32 count;   //!< Number of primitives in the subtree
+      uint32 right;   //!< Right child, 0 for leaves. The left child directly follows the node.
+    };
+
+    Bvh(const BvhOptions& options = BvhOptions()) : options(options) {}
+
+    void build(const Vector3<T>* points, size_t count)
+    {
+      buildFrom(count, [points](size_t i) { return BoundingBox<T>(points[i], points[i]); });
+    }
+    //!\brief Build over the triangles (triangles[3i], triangles[3i + 1], triangles[3i + 2]) of vertices
+    void build(const Vector3<T>* vertices, const uint32* triangles, size_t triangle_count)
+    {
+      buildFrom(triangle_count, [vertices, triangles](size_t i) { return getTriangleBounds(vertices, triangles + 3*i); });
+    }
+    void build(const BoundingBox<T>* boxes, size_t count)
+    {
+      buildFrom(count, [boxes](size_t i) { return boxes[i]; });
+    }
+
+    //!\brief Recompute the bounds for moved primitives, the count must match the last build
+    void refit(const Vector3<T>* points)
+    {
+      refitFrom([points](size_t i) { return BoundingBox<T>(points[i], points[i]); });
+    }
+    void refit(const Vector3<T>* vertices, const uint32* triangles)
+    {
+      refitFrom([vertices, triangles](size_t i) { return getTriangleBounds(vertices, triangles + 3*i); });
+    }
+    void refit(const BoundingBox<T>* boxes)
+    {
+      refitFrom([boxes](size_t i) { return boxes[i]; });
+    }
+
+    //!\brief Nodes overlapping the frustum: leaves that intersect it and the roots of subtrees
+    //! entirely inside it. inside (optional) receives one flag per returned node.
+    //! Returns the number of primitives below the returned nodes.
+    size_t getVisibleNodes(const Frustum<T>& frustum, std::vector<uint32>& visible, std::vector<uint8>* inside = nullptr) const
+    {
+      visible.clear();
+      if (inside)
+        inside->clear();
+      size_t count = 0;
+      traverse(frustum, [&](uint32 node, bool contained) {
+        visible.push_back(node);
+        if (inside)
+          inside->push_back(contained);
+        count += nodes[node].count;
+      });
+      return count;
+    }
+
+    //!\brief Indices of the points inside the frustum, for a hierarchy built over points.
+    //! Points are only tested in leaves that intersect the frustum boundary.
+    size_t getVisiblePoints(const Frustum<T>& frustum, const Vector3<T>* points, std::vector<uint32>& visible) const
+    {
+      visible.clear();
+      traverse(frustum, [&](uint32 node, bool contained) {
+        const uint32* first = &indices[nodes[node].first];
+        const uint32* last = first + nodes[node].count;
+        if (contained)
+          visible.insert(visible.end(), first, last);
+        else
+          for (const uint32* i = first; i != last; ++i)
+            if (frustum.contains(points[*i]))
+              visible.push_back(*i);
+      });
+      return visible.size();
+    }
+
+    const std::vector<Node>& getNodes() const { return nodes; }
+    //!\brief Primitive indices in tree order, node n covers [first, first + count)
+    const std::vector<uint32>& getIndices() const { return indices; }
+
+    BvhOptions options;
+
+  private:
+    static BoundingBox<T> getTriangleBounds(const Vector3<T>* vertices, const uint32* triangle)
+    {
+      BoundingBox<T> box(vertices[triangle[0]], vertices[triangle[0]]);
+      box.extend(vertices[triangle[1]]);
+      box.extend(vertices[triangle[2]]);
+      return box;
+    }
+
+    //!\brief Number of nodes of a subtree over count primitives, and over count + 1
+    void getNodeCounts(size_t count, size_t& nodes0, size_t& nodes1) const
+    {
+      const size_t leaf_size = std::max(options.leaf_size, size_t(1));
+      if (count <= leaf_size) {
+        nodes0 = 1;
+        nodes1 = count + 1 <= leaf_size ? 1 : 3;
+        return;
+      }
+      size_t half0, half1;
+      getNodeCounts(count / 2, half0, half1);
+      nodes0 = count % 2 ? 1 + half0 + half1 : 1 + 2 * half0;
+      nodes1 = count % 2 ? 1 + 2 * half1 : 1 + half0 + half1;
+    }
+    size_t getNodeCount(size_t count) const
+    {
+      size_t nodes0, nodes1;
+      getNodeCounts(count, nodes0, nodes1);
+      return nodes0;
+    }
+
+    //!\brief Spread the low 10 bits of v to every third bit
+    static uint32 expandBits(uint32 v)
+    {
+      v = (v | (v << 16)) & 0x030000FF;
+      v = (v | (v << 8)) & 0x0300F00F;
+      v = (v | (v << 4)) & 0x030C30C3;
+      v = (v | (v << 2)) & 0x09249249;
+      return v;
+    }
+
+    //!\brief Fill in the nodes of the subtree over [first, first + count) of the sorted primitives.
+    //! Nodes shallower than split_depth go to top, the nodes at that depth to subtrees.
+    void layout(uint32 node, uint32 first, uint32 count, size_t depth, size_t split_depth)
+    {
+      Node& n = nodes[node];
+      n.first = first;
+      n.count = count;
+      n.right = 0;
+      const bool leaf = count <= std::max(options.leaf_size, size_t(1));
+      if (depth == split_depth || (leaf && depth < split_depth))
+        subtrees.push_back(node);
+      else if (depth < split_depth)
+        top.push_back(node);
+      if (leaf)
+        return;
+      n.right = node + 1 + uint32(getNodeCount(count / 2));
+      layout(node + 1, first, count / 2, depth + 1, split_depth);
+      layout(n.right, first + count / 2, count - count / 2, depth + 1, split_depth);
+    }
+
+    template <typename F>
+    void buildFrom(size_t count, const F& getBox)
+    {
+      ThreadPool& pool = ThreadPool::global();
+      const size_t threads = options.threads == 0 ? pool.getThreadCount() : options.threads;
+      nodes.resize(count ? getNodeCount(count) : 0);
+      indices.resize(count);
+      subtrees.clear();
+      top.clear();
+      if (count == 0)
+        return;
+
+      // Primitives are ordered along the Morton curve of their centers, after which the
+      // median splits of every node are spatially coherent halves of the sorted sequence
+      const size_t min_chunk = 1 << 14;
+      const size_t max_chunks = 64;
+      const size_t chunks = std::min(std::min(threads, max_chunks), count / min_chunk + 1);
+      BoundingBox<T> bounds[max_chunks];
+      parallelFor(count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+        for (size_t i = begin; i < end; ++i)
+          bounds[chunk].extend(getBox(i).getCenter());
+      });
+      BoundingBox<T> scene;
+      for (size_t chunk = 0; chunk < max_chunks; ++chunk)
+        scene.extend(bounds[chunk]);
+      const Vector3<T> size = scene.getSize();
+      const T scale[3] = {
+        size.x > 0 ? T(1023.99) / size.x : T(0),
+        size.y > 0 ? T(1023.99) / size.y : T(0),
+        size.z > 0 ? T(1023.99) / size.z : T(0) };
+
+      // Keys hold the 30 bit code above the primitive index
+      keys.resize(count);
+      sorted.resize(count);
+      parallelFor(count, chunks, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+          const Vector3<T> c = getBox(i).getCenter();
+          const uint32 code =
+            (expandBits(uint32((c.x - scene.min.x) * scale[0])) << 2) |
+            (expandBits(uint32((c.y - scene.min.y) * scale[1])) << 1) |
+            expandBits(uint32((c.z - scene.min.z) * scale[2]));
+          keys[i] = (uint64(code) << 32) | i;
+        }
+      });
+
+      // Parallel LSD radix sort over the code in passes of 8 bits. Every chunk scatters
+      // its keys to offsets from the histograms of all chunks.
+      const size_t radix = 1 << 8;
+      std::vector<size_t> histograms(chunks * radix);
+      for (size_t shift = 32; shift < 62; shift += 8) {
+        std::fill(histograms.begin(), histograms.end(), size_t(0));
+        const uint64* source = keys.data();
+        uint64* target = sorted.data();
+        parallelFor(count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+          size_t* histogram = &histograms[chunk * radix];
+          for (size_t i = begin; i < end; ++i)
+            ++histogram[(source[i] >> shift) & (radix - 1)];
+        });
+        size_t offset = 0;
+        for (size_t digit = 0; digit < radix; ++digit) {
+          for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            const size_t n = histograms[chunk * radix + digit];
+            histograms[chunk * radix + digit] = offset;
+            offset += n;
+          }
+        }
+        parallelFor(count, chunks, [&](size_t begin, size_t end, size_t chunk) {
+          size_t* offsets = &histograms[chunk * radix];
+          for (size_t i = begin; i < end; ++i)
+            target[offsets[(source[i] >> shift) & (radix - 1)]++] = source[i];
+        });
+        keys.swap(sorted);
+      }
+      parallelFor(count, chunks, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+          indices[i] = uint32(keys[i]);
+      });
+
+      // Enough subtrees below the top levels to keep every thread busy during refits
+      size_t split_depth = 0;
+      while ((size_t(1) << split_depth) < 8 * threads && (count >> split_depth) > min_chunk)
+        ++split_depth;
+      layout(0, 0, uint32(count), 0, threads > 1 ? split_depth : 0);
+      refitFrom(getBox);
+    }
+
+    template <typename F>
+    void refitFrom(const F& getBox)
+    {
+      if (nodes.empty())
+        return;
+      // Children follow their parent, so a reverse sweep over a subtree sees them first
+      auto fit = [&](uint32 node) {
+        Node& n = nodes[node];
+        BoundingBox<T> box;
+        if (n.right == 0) {
+          for (uint32 i = n.first; i < n.first + n.count; ++i)
+            box.extend(getBox(indices[i]));
+        }
+        else {
+          box = nodes[node + 1].bounds;
+          box.extend(nodes[n.right].bounds);
+        }
+        n.bounds = box;
+      };
+      ThreadPool::global().run(subtrees.size(), options.threads, [&](size_t t) {
+        const uint32 root = subtrees[t];
+        for (uint32 node = root + uint32(getNodeCount(nodes[root].count)); node-- > root;)
+          fit(node);
+      });
+      for (size_t t = top.size(); t-- > 0;)
+        fit(top[t]);
+    }
+
+    template <typename F>
+    void traverse(const Frustum<T>& frustum, const F& visit) const
+    {
+      if (nodes.empty())
+        return;
+      // Median splits keep the depth below 64
+      struct Entry { uint32 node; uint8 mask; };
+      Entry stack[64];
+      size_t size = 0;
+      stack[size++] = Entry{ 0, uint8((1 << Frustum<T>::PlaneCount) - 1) };
+      while (size > 0) {
+        const Entry entry = stack[--size];
+        const Node& n = nodes[entry.node];
+        uint8 mask = entry.mask;
+        const Containment containment = frustum.classify(n.bounds, mask);
+        if (containment == Containment::Outside)
+          continue;
+        if (containment == Containment::Inside || n.right == 0) {
+          visit(entry.node, containment == Containment::Inside);
+          continue;
+        }
+        stack[size++] = Entry{ n.right, mask };
+        stack[size++] = Entry{ entry.node + 1, mask };
+      }
+    }
+
+    std::vector<Node> nodes;
+    std::vector<uint32> indices;
+    std::vector<uint32> subtrees;   //!< Roots of the independently built subtrees
+    std::vector<uint32> top;        //!< Nodes above the subtrees in the order they were split
+    std::vector<uint64> keys;       //!< Sort buffers, kept for rebuilds
+    std::vector<uint64> sorted;
+  };
+
+  typedef Bvh<float32> Bvhf;
+  typedef Bvh<float64> Bvhd;
+}
\ No newline at end of file
@@ -0,0 +1,707 @@
+// Microbenchmarks for the fixed size and dynamic kernels.
+//
+// Usage: Benchmark [--filter=substring] [--min-time=seconds] [--format=table|csv|json] [--output=file]
+//
+// Every benchmark reports the time of one kernel application (ns/op) and the throughput in
+// items per second, where an item is one element for the elementwise kernels and one point
+// for the kernels working on point sets. The csv and json formats are meant for comparing
+// runs between releases.
+
+#include "Camera.h"
+#include "DenseSolvers.h"
+#include "Epipolar.h"
+#include "Gemm.h"
+#include "Homography.h"
+#include "Intrinsics.h"
+#include "MatrixOperations.h"
+#include "Pnp.h"
+#include "Projection.h"
+#include "Rig.h"
+#include "Rotation.h"
+#include "Trajectory.h"
+#include "Triangulation.h"
+#include "Visibility.h"
+#include "VectorOperations.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace dry;
+
+namespace
+{
+  template <typename T>
+  inline void doNotOptimize(const T& value)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+  }
+
+  template <typename T> const char* getTypeName();
+  template <> const char* getTypeName<float>() { return "float"; }
+  template <> const char* getTypeName<double>() { return "double"; }
+
+  struct Result
+  {
+    std::string name;
+    std::string type;
+    size_t batch;
+    size_t items_per_op;
+    double ns_per_op;
+    double items_per_second;
+    size_t iterations;
+  };
+
+  struct Options
+  {
+    std::string filter;
+    std::string format = "table";
+    std::string output;
+    double min_time = 0.1;
+  };
+
+  class Runner
+  {
+  public:
+    explicit Runner(const Options& options) : options(options) {}
+
+    bool isEnabled(const std::string& name) const
+    {
+      return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    }
+
+    //!\brief Time fn, which applies a kernel ops_per_call times to items_per_op items each
+    template <typename F>
+    void run(const std::string& name, const char* type, size_t batch, size_t ops_per_call, size_t items_per_op, F fn)
+    {
+      if (!isEnabled(name))
+        return;
+      fn();  // Warm up caches and page in the buffers
+
+      size_t calls = 1;
+      double seconds = 0;
+      for (;;) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; ++i)
+          fn();
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (seconds >= options.min_time || calls >= (size_t(1) << 30))
+          break;
+        // Aim a bit past the minimum time based on the rate measured so far
+        double scale = seconds > 0 ? 1.2 * options.min_time / seconds : 100.0;
+        calls = size_t(double(calls) * std::min(std::max(scale, 2.0), 100.0));
+      }
+
+      Result result;
+      result.name = name;
+      result.type = type;
+      result.batch = batch;
+      result.items_per_op = items_per_op;
+      result.iterations = calls * ops_per_call;
+      result.ns_per_op = seconds * 1e9 / double(result.iterations);
+      result.items_per_second = double(result.iterations * items_per_op) / seconds;
+      results.push_back(result);
+      if (options.format == "table" && options.output.empty())
+        printRow(stdout, result);
+    }
+
+    void finish() const
+    {
+      FILE* out = stdout;
+      if (!options.output.empty()) {
+        out = std::fopen(options.output.c_str(), "w");
+        if (!out) {
+          std::fprintf(stderr, "Cannot open %s\n", options.output.c_str());
+          return;
+        }
+      }
+
+      if (options.format == "csv") {
+        std::fprintf(out, "name,type,batch,items_per_op,ns_per_op,items_per_second,iterations\n");
+        for (const Result& r : results)
+          std::fprintf(out, "%s,%s,%zu,%zu,%.4f,%.6e,%zu\n",
+            r.name.c_str(), r.type.c_str(), r.batch, r.items_per_op, r.ns_per_op, r.items_per_second, r.iterations);
+      }
+      else if (options.format == "json") {
+        std::fprintf(out, "{\n  \"benchmarks\": [\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+          const Result& r = results[i];
+          std::fprintf(out, "    {\"name\": \"%s\", \"type\": \"%s\", \"batch\": %zu, \"items_per_op\": %zu, "
+            "\"ns_per_op\": %.4f, \"items_per_second\": %.6e, \"iterations\": %zu}%s\n",
+            r.name.c_str(), r.type.c_str(), r.batch, r.items_per_op, r.ns_per_op, r.items_per_second, r.iterations,
+            i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+      }
+      else if (out != stdout) {
+        for (const Result& r : results)
+          printRow(out, r);
+      }
+
+      if (out != stdout)
+        std::fclose(out);
+    }
+
+    static void printHeader()
+    {
+      std::printf("%-32s %-7s %9s %14s %16s\n", "name", "type", "batch", "ns/op", "items/s");
+    }
+
+  private:
+    static void printRow(FILE* out, const Result& r)
+    {
+      std::fprintf(out, "%-32s %-7s %9zu %14.3f %16.4e\n", r.name.c_str(), r.type.c_str(), r.batch, r.ns_per_op, r.items_per_second);
+    }
+
+    Options options;
+    std::vector<Result> results;
+  };
+
+  const size_t element_batches[] = { 1, 64, 4096, 262144 };
+  const size_t point_batches[] = { 16, 256, 4096, 65536, 1048576 };
+  const size_t estimate_batches[] = { 4, 16, 256, 4096, 65536 };
+
+  template <typename T>
+  Matrix3<T> randomMatrix3(std::mt19937& rng)
+  {
+    std::uniform_real_distribution<T> d(T(-1), T(1));
+    Matrix3<T> m;
+    for (size_t i = 0; i < 9; ++i)
+      m[i] = d(rng);
+    m.a00 += 2; m.a11 += 2; m.a22 += 2;  // Keep it well conditioned
+    return m;
+  }
+  template <typename T>
+  Vector3<T> randomVector3(std::mt19937& rng)
+  {
+    std::uniform_real_distribution<T> d(T(-1), T(1));
+    return Vector3<T>(d(rng), d(rng), d(rng));
+  }
+
+  template <typename T>
+  void runElementwise(Runner& runner)
+  {
+    const char* type = getTypeName<T>();
+    std::mt19937 rng(1);
+    for (size_t batch : element_batches) {
+      std::vector<Matrix3<T>> a(batch), b(batch), m(batch);
+      std::vector<Vector3<T>> u(batch), v(batch), w(batch);
+      std::vector<Matrix3x4<T>> c(batch);
+      for (size_t i = 0; i < batch; ++i) {
+        a[i] = randomMatrix3<T>(rng);
+        b[i] = randomMatrix3<T>(rng);
+        u[i] = randomVector3<T>(rng);
+        v[i] = randomVector3<T>(rng);
+      }
+
+      runner.run("Matrix3 multiply", type, batch, batch, 1, [&] {
+        for (size_t i = 0; i < batch; ++i)
+          m[i] = a[i] * b[i];
+        doNotOptimize(m[0]);
+      });
+      runner.run("Matrix3 inverse", type, batch, batch, 1, [&] {
+        for (size_t i = 0; i < batch; ++i)
+          m[i] = inverse(a[i]);
+        doNotOptimize(m[0]);
+      });
+      runner.run("Matrix3 det", type, batch, batch, 1, [&] {
+        T sum(0);
+        for (size_t i = 0; i < batch; ++i)
+          sum += det(a[i]);
+        doNotOptimize(sum);
+      });
+      runner.run("getRotationEuler", type, batch, batch, 1, [&] {
+        for (size_t i = 0; i < batch; ++i)
+          m[i] = getRotationEuler(u[i].x, u[i].y, u[i].z);
+        doNotOptimize(m[0]);
+      });
+      runner.run("Vector3 normalized", type, batch, batch, 1, [&] {
+        for (size_t i = 0; i < batch; ++i)
+          w[i] = normalized(u[i]);
+        doNotOptimize(w[0]);
+      });
+      runner.run("Vector3 cross", type, batch, batch, 1, [&] {
+        for (size_t i = 0; i < batch; ++i)
+          w[i] = cross(u[i], v[i]);
+        doNotOptimize(w[0]);
+      });
+      runner.run("getCameraMatrix", type, batch, batch, 1, [&] {
+        for (size_t i = 0; i < batch; ++i)
+          c[i] = getCameraMatrix(a[i], u[i]);
+        doNotOptimize(c[0]);
+      });
+
+      VectorX<T> x(batch), y(batch), z(batch), r(batch);
+      x.Set(T(1));
+      y.Set(T(2));
+      z.Set(T(3));
+      runner.run("VectorX a*s + b - c", type, batch, 1, batch, [&] {
+        r = x * T(0.5) + y - z;
+        doNotOptimize(r[0]);
+      });
+      runner.run("VectorX norm2(a - b)", type, batch, 1, batch, [&] {
+        doNotOptimize(norm2(x - y));
+      });
+      // A frame of short lived temporaries too large to be stored inline
+      if (batch > 4096)
+        continue;
+      runner.run("MatrixX temporaries heap", type, batch, batch, 1, [&] {
+        for (size_t i = 0; i < batch; ++i) {
+          MatrixX<T> t(64, 8);
+          t[0] = T(i);
+          doNotOptimize(t[0]);
+        }
+      });
+      runner.run("MatrixX temporaries arena", type, batch, batch, 1, [&] {
+        Arena& arena = Arena::local();
+        for (size_t i = 0; i < batch; ++i) {
+          MatrixX<T> t(64, 8, arena);
+          t[0] = T(i);
+          doNotOptimize(t[0]);
+        }
+        arena.reset();
+      });
+    }
+  }
+
+  template <typename T>
+  void makeCorrespondences(size_t count, std::vector<T>& lx, std::vector<T>& ly, std::vector<T>& rx, std::vector<T>& ry)
+  {
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<double> pixel(0, 1920);
+    std::normal_distribution<double> noise(0, 0.5);
+    const Matrix3d H(1.1, 0.05, 30, -0.02, 0.95, -12, 1e-4, 2e-4, 1);
+    lx.resize(count); ly.resize(count); rx.resize(count); ry.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      Vector2d l(pixel(rng), pixel(rng));
+      Vector2d r = toInhomogeneous(H * l);
+      lx[i] = T(l.x); ly[i] = T(l.y);
+      rx[i] = T(r.x + noise(rng)); ry[i] = T(r.y + noise(rng));
+    }
+  }
+
+  template <typename T>
+  void runPointSets(Runner& runner)
+  {
+    const char* type = getTypeName<T>();
+    std::vector<T> lx, ly, rx, ry;
+    for (size_t batch : point_batches) {
+      makeCorrespondences(batch, lx, ly, rx, ry);
+      Vector2View<T> points(lx.data(), ly.data(), batch);
+      runner.run("getHartleyNormalization", type, batch, 1, batch, [&] {
+        Matrix3d normalization;
+        getHartleyNormalization(points, normalization);
+        doNotOptimize(normalization);
+      });
+    }
+
+    for (size_t batch : point_batches) {
+      std::mt19937 rng(3);
+      std::uniform_real_distribution<T> d(T(-50), T(50));
+      std::vector<T> x(batch), y(batch), z(batch), u(batch), v(batch), depth(batch);
+      std::vector<uint8> valid(batch);
+      for (size_t i = 0; i < batch; ++i) {
+        x[i] = d(rng); y[i] = d(rng); z[i] = d(rng);
+      }
+      const Matrix3x4<T> P = Matrix3<T>(800, 0, 640, 0, 800, 360, 0, 0, 1) *
+        getCameraMatrix(getRotationEuler(T(0.1), T(0.2), T(0.3)), Vector3<T>(1, 2, -60));
+      Vector3View<T> points(x.data(), y.data(), z.data(), batch);
+      runner.run("projectPoints", type, batch, 1, batch, [&] {
+        size_t visible = projectPoints(P, points, u.data(), v.data(), depth.data(), valid.data());
+        doNotOptimize(visible);
+      });
+
+      // Eight cameras around a vehicle, items counts one point in one camera
+      const size_t cameras = 8;
+      CameraRig<T> rig;
+      for (size_t k = 0; k < cameras; ++k)
+        rig.addCamera(Matrix3<T>(800, 0, 640, 0, 800, 360, 0, 0, 1) *
+          getCameraMatrix(getRotationEuler(T(0), T(0.785) * T(k), T(0)), Vector3<T>(1, T(0.5), 0)));
+      std::vector<T> rig_u(cameras * batch), rig_v(cameras * batch);
+      RigProjection<T> outputs[cameras];
+      for (size_t k = 0; k < cameras; ++k) {
+        outputs[k].u = rig_u.data() + k * batch;
+        outputs[k].v = rig_v.data() + k * batch;
+      }
+      const Matrix3x4<T> body = getCameraMatrix(getRotationEuler(T(0.1), T(0.2), T(0.3)), Vector3<T>(1, 2, 3));
+      runner.run("CameraRig::projectPoints", type, batch, 1, batch * cameras, [&] {
+        doNotOptimize(rig.projectPoints(body, points, outputs));
+      });
+    }
+
+    for (size_t batch : estimate_batches) {
+      makeCorrespondences(batch, lx, ly, rx, ry);
+      Homography homography;
+      homography.setCorrespondences(Vector2View<T>(lx.data(), ly.data(), batch), Vector2View<T>(rx.data(), ry.data(), batch));
+      runner.run("Homography::estimate", type, batch, 1, batch, [&] {
+        Matrix3d H;
+        homography.estimate(H);
+        doNotOptimize(H);
+      });
+    }
+  }
+
+  template <typename T>
+  void runMatrixProducts(Runner& runner)
+  {
+    const char* type = getTypeName<T>();
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<T> d(-1, 1);
+    for (size_t n : { 16, 64, 256, 1024 }) {
+      MatrixX<T> A(n, n), B(n, n), C;
+      VectorX<T> x(n), y;
+      for (size_t i = 0; i < A.size; ++i) {
+        A[i] = d(rng);
+        B[i] = d(rng);
+      }
+      for (size_t i = 0; i < n; ++i)
+        x[i] = d(rng);
+      // items are multiply adds
+      runner.run("gemm", type, n, 1, n * n * n, [&] {
+        multiply(A, B, C);
+        doNotOptimize(C[0]);
+      });
+      runner.run("gemm A^T A", type, n, 1, n * n * n, [&] {
+        multiplyTransposed(A, A, C);
+        doNotOptimize(C[0]);
+      });
+      runner.run("gemv", type, n, 1, n * n, [&] {
+        multiply(A, x, y);
+        doNotOptimize(y[0]);
+      });
+      runner.run("gemv A^T x", type, n, 1, n * n, [&] {
+        multiplyTransposed(A, x, y);
+        doNotOptimize(y[0]);
+      });
+    }
+  }
+
+  template <typename T>
+  void runDecompositions(Runner& runner)
+  {
+    const char* type = getTypeName<T>();
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<T> d(-1, 1);
+    for (size_t n : { 16, 64, 256 }) {
+      MatrixX<T> A(n, n), S, F;
+      VectorX<T> tau, s;
+      DenseWorkspace<T> workspace;
+      for (size_t i = 0; i < A.size; ++i)
+        A[i] = d(rng);
+      multiplyTransposed(A, A, S);
+      for (size_t i = 0; i < n; ++i)
+        S(i, i) += T(n);
+      // items are decompositions, the workspace is reused so nothing is allocated after the first run
+      runner.run("Cholesky", type, n, 1, 1, [&] {
+        F = S;
+        choleskyDecompose(F);
+        doNotOptimize(F[0]);
+      });
+      runner.run("QR", type, n, 1, 1, [&] {
+        F = A;
+        qrDecompose(F, tau, workspace);
+        doNotOptimize(F[0]);
+      });
+      runner.run("SVD values", type, n, 1, 1, [&] {
+        svdDecompose(A, s, nullptr, nullptr, workspace);
+        doNotOptimize(s[0]);
+      });
+    }
+  }
+
+  template <typename T>
+  void runRotations(Runner& runner)
+  {
+    const char* type = getTypeName<T>();
+    std::mt19937 rng(7);
+    std::normal_distribution<T> n;
+    std::uniform_real_distribution<T> u(0, 1);
+    for (size_t batch : point_batches) {
+      std::vector<Quaternion<T>> a(batch), b(batch), q(batch);
+      std::vector<Vector3<T>> points(batch), rotated(batch);
+      std::vector<T> t(batch);
+      for (size_t i = 0; i < batch; ++i) {
+        a[i] = normalized(Quaternion<T>(n(rng), n(rng), n(rng), n(rng)));
+        b[i] = normalized(Quaternion<T>(n(rng), n(rng), n(rng), n(rng)));
+        points[i] = Vector3<T>(n(rng), n(rng), n(rng));
+        t[i] = u(rng);
+      }
+      runner.run("compose", type, batch, 1, batch, [&] {
+        compose(a.data(), b.data(), q.data(), batch);
+        doNotOptimize(q[0]);
+      });
+      runner.run("slerp", type, batch, 1, batch, [&] {
+        slerp(a.data(), b.data(), t.data(), q.data(), batch);
+        doNotOptimize(q[0]);
+      });
+      runner.run("rotatePoints", type, batch, 1, batch, [&] {
+        rotatePoints(a[0], points.data(), rotated.data(), batch);
+        doNotOptimize(rotated[0]);
+      });
+    }
+  }
+
+  void runTrajectory(Runner& runner)
+  {
+    std::mt19937 rng(10);
+    std::normal_distribution<double> n;
+    Trajectoryd trajectory;
+    Quaterniond q = Quaterniond::Identity();
+    Vector3d c(0, 0, 0);
+    for (size_t i = 0; i < 1000; ++i) {
+      q = normalized(q * getQuaternion(Vector3d(n(rng), n(rng), n(rng)) * 0.01));
+      c = c + Vector3d(n(rng), n(rng), n(rng)) * 0.01;
+      trajectory.add(0.01 * double(i) + 1e-4 * n(rng), q, c);
+    }
+    std::uniform_real_distribution<double> time(trajectory.getStartTime(), trajectory.getEndTime());
+    for (size_t batch : point_batches) {
+      std::vector<double> times(batch);
+      for (size_t i = 0; i < batch; ++i)
+        times[i] = time(rng);
+      std::vector<Matrix3x4d> cameras(batch);
+      runner.run("Trajectory::getCameras", "double", batch, 1, batch, [&] {
+        trajectory.getCameras(times.data(), batch, cameras.data());
+        doNotOptimize(cameras[0]);
+      });
+      runner.run("Trajectory::getRollingShutterCameras", "double", batch, 1, batch, [&] {
+        trajectory.getRollingShutterCameras(1.0, 5.0 / double(batch), batch, cameras.data());
+        doNotOptimize(cameras[0]);
+      });
+    }
+  }
+
+  void runPose(Runner& runner)
+  {
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> d(-3, 3);
+    std::normal_distribution<double> noise(0, 5e-4);
+    const Matrix3x4d C = getCameraMatrix(getRotationEuler(0.3, -0.2, 0.5), Vector3d(0.5, -1, -8));
+    for (size_t batch : estimate_batches) {
+      std::vector<Vector3d> world(batch);
+      std::vector<Vector2d> image(batch);
+      for (size_t i = 0; i < batch; ++i) {
+        world[i] = Vector3d(d(rng), d(rng), d(rng));
+        Vector2d m = toInhomogeneous(C * world[i]);
+        image[i] = Vector2d(m.x + noise(rng), m.y + noise(rng));
+        if (i % 4 == 3)
+          image[i] = Vector2d(d(rng) / 3, d(rng) / 3);  // Outlier
+      }
+      runner.run("solvePnP", "double", batch, 1, batch, [&] {
+        Matrix3x4d camera;
+        solvePnP(world.data(), image.data(), batch, camera);
+        doNotOptimize(camera);
+      });
+      if (batch < 16)
+        continue;
+      RansacPnpOptions options;
+      options.deterministic = true;
+      RansacPnp ransac(options);
+      runner.run("RansacPnp::estimate", "double", batch, 1, batch, [&] {
+        Matrix3x4d camera;
+        ransac.estimate(world.data(), image.data(), batch, camera);
+        doNotOptimize(camera);
+      });
+    }
+  }
+
+  void runEpipolar(Runner& runner)
+  {
+    std::mt19937 rng(8);
+    std::uniform_real_distribution<double> d(-3, 3);
+    std::normal_distribution<double> noise(0, 5e-4);
+    const Matrix3d R = getRotationEuler(0.1, -0.05, 0.2);
+    const Vector3d t(1, 0.1, -0.2);
+    for (size_t batch : estimate_batches) {
+      if (batch < 8)
+        continue;
+      std::vector<Vector2d> left(batch), right(batch);
+      for (size_t i = 0; i < batch; ++i) {
+        const Vector3d X(d(rng), d(rng), 10 + d(rng));
+        const Vector3d Y = R * X + t;
+        left[i] = Vector2d(X.x / X.z + noise(rng), X.y / X.z + noise(rng));
+        right[i] = Vector2d(Y.x / Y.z + noise(rng), Y.y / Y.z + noise(rng));
+      }
+      runner.run("estimateFundamental", "double", batch, 1, batch, [&] {
+        Matrix3d F;
+        estimateFundamental(left.data(), right.data(), batch, F);
+        doNotOptimize(F);
+      });
+      if (batch != 16)
+        continue;
+      runner.run("solveEssential", "double", 5, 1, 5, [&] {
+        Matrix3d E[10];
+        doNotOptimize(solveEssential(left.data(), right.data(), E));
+        doNotOptimize(E[0]);
+      });
+      Matrix3d E[10];
+      solveEssential(left.data(), right.data(), E);
+      runner.run("getRelativePose", "double", batch, 1, batch, [&] {
+        Matrix3x4d camera;
+        doNotOptimize(getRelativePose(E[0], left.data(), right.data(), batch, camera));
+        doNotOptimize(camera);
+      });
+    }
+  }
+
+  void runVisibility(Runner& runner)
+  {
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> d(-100, 100);
+    const Matrix3x4f camera = Matrix3f(800, 0, 640, 0, 800, 360, 0, 0, 1) *
+      getCameraMatrix(getRotationEuler(0.3f, 1.2f, 0.1f), Vector3f(-60, -70, 10));
+    const Frustum<float> frustum = getFrustum(camera, 1280.0f, 720.0f, 0.5f, 80.0f);
+    for (size_t batch : point_batches) {
+      if (batch < 4096)
+        continue;
+      std::vector<Vector3f> points(batch);
+      for (size_t i = 0; i < batch; ++i)
+        points[i] = Vector3f(d(rng), d(rng), d(rng) / 5);
+      Bvhf bvh;
+      runner.run("Bvh::build", "float", batch, 1, batch, [&] {
+        bvh.build(points.data(), batch);
+        doNotOptimize(bvh.getNodes()[0]);
+      });
+      runner.run("Bvh::refit", "float", batch, 1, batch, [&] {
+        bvh.refit(points.data());
+        doNotOptimize(bvh.getNodes()[0]);
+      });
+      std::vector<uint32> visible;
+      runner.run("Bvh::getVisiblePoints", "float", batch, 1, batch, [&] {
+        doNotOptimize(bvh.getVisiblePoints(frustum, points.data(), visible));
+      });
+      runner.run("Frustum::contains", "float", batch, 1, batch, [&] {
+        visible.clear();
+        for (size_t i = 0; i < batch; ++i)
+          if (frustum.contains(points[i]))
+            visible.push_back(uint32(i));
+        doNotOptimize(visible.size());
+      });
+    }
+  }
+
+  void runTriangulation(Runner& runner)
+  {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> d(-3, 3);
+    std::normal_distribution<double> noise(0, 0.5);
+    const Matrix3d K(800, 0, 640, 0, 800, 360, 0, 0, 1);
+    Matrix3x4d cameras[4];
+    for (size_t i = 0; i < 4; ++i)
+      cameras[i] = K * getCameraMatrix(getRotationEuler(0.05 * i, 0.02 * i, -0.03 * i), Vector3d(0.5 * i, 0.1 * i, -10.0));
+    for (size_t batch : point_batches) {
+      std::vector<uint32> offsets(batch + 1), indices;
+      std::vector<Vector2d> measurements;
+      std::vector<Vector3d> points(batch);
+      for (size_t t = 0; t < batch; ++t) {
+        offsets[t] = uint32(indices.size());
+        const Vector3d X(d(rng), d(rng), d(rng));
+        for (uint32 k = 0; k < 2 + t % 3; ++k) {
+          const Vector2d m = toInhomogeneous(cameras[k] * X);
+          indices.push_back(k);
+          measurements.push_back(Vector2d(m.x + noise(rng), m.y + noise(rng)));
+        }
+      }
+      offsets[batch] = uint32(indices.size());
+      TriangulationOptions options;
+      runner.run("triangulatePoints", "double", batch, 1, batch, [&] {
+        size_t n = triangulatePoints(cameras, indices.data(), measurements.data(), offsets.data(), batch, points.data(), nullptr, options);
+        doNotOptimize(n);
+      });
+      options.refine_iterations = 3;
+      runner.run("triangulatePoints refined", "double", batch, 1, batch, [&] {
+        size_t n = triangulatePoints(cameras, indices.data(), measurements.data(), offsets.data(), batch, points.data(), nullptr, options);
+        doNotOptimize(n);
+      });
+    }
+  }
+
+  void runDistortion(Runner& runner)
+  {
+    const Intrinsicsd K(900, 880, 640.5, 360.2, -0.28, 0.09, 0.001, -0.0005, -0.01);
+    const size_t width = 1280, height = 720;
+    UndistortionMap map;
+    map.build(K, width, height);
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<double> x(0, width - 1), y(0, height - 1);
+    for (size_t batch : point_batches) {
+      std::vector<Vector2d> pixels(batch), normalized(batch);
+      for (size_t i = 0; i < batch; ++i)
+        pixels[i] = Vector2d(x(rng), y(rng));
+      runner.run("undistortPoints", "double", batch, 1, batch, [&] {
+        undistortPoints(K, pixels.data(), normalized.data(), batch);
+        doNotOptimize(normalized[0]);
+      });
+      runner.run("UndistortionMap::undistortPoints", "double", batch, 1, batch, [&] {
+        map.undistortPoints(pixels.data(), normalized.data(), batch);
+        doNotOptimize(normalized[0]);
+      });
+    }
+
+    std::vector<uint8> src(width * height * 3, 128), dst(width * height * 3);
+    const ImageView<const uint8> source(src.data(), width, height, 3);
+    const ImageView<uint8> target(dst.data(), width, height, 3);
+    runner.run("UndistortionMap::undistortImage", "uint8", width * height, 1, width * height, [&] {
+      map.undistortImage(source, target);
+      doNotOptimize(dst[0]);
+    });
+    UndistortionMap fixed;
+    fixed.build(K, width, height, UndistortionMap::Storage::Fixed);
+    runner.run("undistortImage fixed", "uint8", width * height, 1, width * height, [&] {
+      fixed.undistortImage(source, target);
+      doNotOptimize(dst[0]);
+    });
+  }
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (std::strncmp(arg, "--filter=", 9) == 0)
+      options.filter = arg + 9;
+    else if (std::strncmp(arg, "--min-time=", 11) == 0)
+      options.min_time = std::atof(arg + 11);
+    else if (std::strncmp(arg, "--format=", 9) == 0)
+      options.format = arg + 9;
+    else if (std::strncmp(arg, "--output=", 9) == 0)
+      options.output = arg + 9;
+    else {
+      std::fprintf(stderr, "Usage: %s [--filter=substring] [--min-time=seconds] [--format=table|csv|json] [--output=file]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  Runner runner(options);
+  if (options.format == "table" && options.output.empty())
+    Runner::printHeader();
+
+  runElementwise<float>(runner);
+  runElementwise<double>(runner);
+  runPointSets<float>(runner);
+  runPointSets<double>(runner);
+  runMatrixProducts<float>(runner);
+  runMatrixProducts<double>(runner);
+  runDecompositions<float>(runner);
+  runDecompositions<double>(runner);
+  runRotations<float>(runner);
+  runRotations<double>(runner);
+  runTrajectory(runner);
+  runPose(runner);
+  runEpipolar(runner);
+  runTriangulation(runner);
+  runDistortion(runner);
+  runVisibility(runner);
+
+  runner.finish();
+  return 0;
+}
\ No newline at end of file
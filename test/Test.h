@@ -0,0 +1,79 @@
+// Checking helpers shared by the tests.
+//
+// Every test is a small executable that compares results against synthetic ground truth and
+// returns the number of failed checks, so CTest reports a failure for any of them.
+
+#pragma once
+
+#include "Matrix.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace dry
+{
+  namespace test
+  {
+    inline int& getFailureCount()
+    {
+      static int failures = 0;
+      return failures;
+    }
+
+    inline void check(bool condition, const char* expression, const char* file, int line)
+    {
+      if (condition)
+        return;
+      std::printf("%s:%d: check failed: %s\n", file, line, expression);
+      ++getFailureCount();
+    }
+
+    //!\brief Print the outcome, the result is the exit code of the test
+    inline int report()
+    {
+      const int failures = getFailureCount();
+      if (failures)
+        std::printf("%d checks failed\n", failures);
+      else
+        std::printf("All checks passed\n");
+      return failures;
+    }
+
+    //!\brief Largest absolute difference between the first count elements of a and b
+    template <typename A, typename B>
+    inline double getDifference(const A& a, const B& b, size_t count)
+    {
+      double difference = 0;
+      for (size_t i = 0; i < count; ++i)
+        difference = std::max(difference, std::abs(double(a[i]) - double(b[i])));
+      return difference;
+    }
+    template <typename T>
+    inline double getDifference(const Matrix3<T>& a, const Matrix3<T>& b) { return getDifference(a, b, 9); }
+    template <typename T>
+    inline double getDifference(const Matrix3x4<T>& a, const Matrix3x4<T>& b) { return getDifference(a, b, 12); }
+    template <typename T>
+    inline double getDifference(const Vector2<T>& a, const Vector2<T>& b)
+    {
+      return std::max(std::abs(double(a.x - b.x)), std::abs(double(a.y - b.y)));
+    }
+    template <typename T>
+    inline double getDifference(const Vector3<T>& a, const Vector3<T>& b)
+    {
+      return std::max(std::max(std::abs(double(a.x - b.x)), std::abs(double(a.y - b.y))), std::abs(double(a.z - b.z)));
+    }
+
+    //!\brief Largest difference of two homographies after scaling both to a22 = 1
+    inline double getHomographyDifference(const Matrix3d& a, const Matrix3d& b)
+    {
+      double difference = 0;
+      for (size_t i = 0; i < 9; ++i)
+        difference = std::max(difference, std::abs(a[i] / a.a22 - b[i] / b.a22));
+      return difference;
+    }
+  }
+}
+
+#define CHECK(condition) dry::test::check((condition), #condition, __FILE__, __LINE__)
\ No newline at end of file
@@ -0,0 +1,153 @@
+// Arena allocation: alignment, marks and scopes, block merging on reset, and containers and
+// decompositions that take their buffers from an arena and keep it when they grow.
+
+#include "DenseSolvers.h"
+#include "Test.h"
+
+#include <random>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  bool isAligned(const void* p) { return reinterpret_cast<uintptr_t>(p) % 64 == 0; }
+
+  void testAllocation()
+  {
+    Arena arena(4096);
+    CHECK(arena.getUsed() == 0 && arena.getCapacity() == 0);
+    char* c = static_cast<char*>(arena.allocate(3, 1));
+    double* p = arena.allocate<double>(100);
+    CHECK(isAligned(p) && reinterpret_cast<char*>(p) >= c + 3);
+    CHECK(arena.getUsed() >= 803 && arena.getCapacity() == 4096);
+
+    // Marks release what was allocated after them, scopes take one on entry
+    const Arena::Mark mark = arena.getMark();
+    const size_t used = arena.getUsed();
+    float* f = arena.allocate<float>(10);
+    CHECK(arena.getUsed() > used);
+    arena.rewind(mark);
+    CHECK(arena.getUsed() == used);
+    CHECK(arena.allocate<float>(10) == f);
+    arena.rewind(mark);
+    {
+      ArenaScope scope(arena);
+      CHECK(&scope.getArena() == &arena);
+      // Larger than a block
+      char* large = arena.allocate<char>(10000);
+      CHECK(isAligned(large) && arena.getCapacity() > 4096);
+      {
+        ArenaScope inner(arena);
+        arena.allocate<double>(1000);
+      }
+    }
+    CHECK(arena.getUsed() == used);
+
+    // A frame that needed several blocks leaves a single block of their total size
+    const size_t capacity = arena.getCapacity();
+    arena.reset();
+    CHECK(arena.getUsed() == 0 && arena.getCapacity() == capacity);
+    char* whole = arena.allocate<char>(capacity - 64);
+    CHECK(whole != nullptr && arena.getCapacity() == capacity);
+    arena.reset();
+
+    // Every thread has its own
+    CHECK(&Arena::local() == &Arena::local());
+    {
+      ArenaScope scope;
+      CHECK(&scope.getArena() == &Arena::local());
+    }
+  }
+
+  void testContainers()
+  {
+    Arena arena;
+    const size_t used = arena.getUsed();
+    {
+      ArenaScope scope(arena);
+      MatrixXd small(2, 2, arena);
+      CHECK(small.isInline() && small.getArena() == &arena && arena.getUsed() == used);
+      MatrixXd large(64, 64, arena);
+      CHECK(!large.isInline() && large.getArena() == &arena && isAligned(large.v));
+      CHECK(arena.getUsed() >= used + 64 * 64 * sizeof(double));
+
+      // Growing keeps the arena, through resize and through expressions
+      VectorXd v(3, arena), a(500), b(500);
+      for (size_t i = 0; i < 500; ++i) {
+        a[i] = double(i);
+        b[i] = 1.0;
+      }
+      const size_t before = arena.getUsed();
+      v = a + b;
+      CHECK(v.getArena() == &arena && v.size == 500 && v[499] == 500.0);
+      CHECK(arena.getUsed() > before);
+      small.resize(30, 30);
+      CHECK(small.getArena() == &arena && !small.isInline());
+
+      // Copies assigned into an arena container stay in the arena, copies made from one do not
+      VectorXd copy(v);
+      CHECK(copy.getArena() == nullptr && copy.size == 500 && copy[10] == 11.0);
+      VectorXd target(arena);
+      target = copy;
+      CHECK(target.getArena() == &arena && target[10] == 11.0);
+
+      // Products whose result is an operand swap in a temporary from the same arena
+      MatrixXd A(40, 40, arena);
+      for (size_t i = 0; i < A.size; ++i)
+        A[i] = double(i % 7);
+      const MatrixXd A0 = A;
+      multiply(A, A0, A);
+      CHECK(A.getArena() == &arena && A.rows == 40 && A.cols == 40);
+      double s = 0;
+      for (size_t p = 0; p < 40; ++p)
+        s += A0(3, p) * A0(p, 5);
+      CHECK(std::abs(A(3, 5) - s) < 1e-12);
+      VectorXd x(40, arena);
+      for (size_t i = 0; i < 40; ++i)
+        x[i] = 1.0;
+      multiply(A0, x, x);
+      CHECK(x.getArena() == &arena && x.size == 40);
+    }
+    CHECK(arena.getUsed() == used);
+  }
+
+  void testWorkspace()
+  {
+    std::mt19937 rng(8);
+    std::uniform_real_distribution<double> d(-1, 1);
+    MatrixXd A(120, 40);
+    VectorXd b(120);
+    for (size_t i = 0; i < A.size; ++i)
+      A[i] = d(rng);
+    for (size_t i = 0; i < b.size; ++i)
+      b[i] = d(rng);
+
+    VectorXd expected, x;
+    CHECK(leastSquares(A, b, expected));
+    // Blocks much smaller than the workspace of the first frame
+    Arena arena(4096);
+    for (int frame = 0; frame < 3; ++frame) {
+      {
+        DenseWorkspace<double> workspace(arena);
+        CHECK(leastSquares(A, b, x, workspace));
+        CHECK(workspace.matrix.getArena() == &arena && workspace.tau.getArena() == &arena);
+        VectorXd s;
+        svdDecompose(A, s, nullptr, nullptr, workspace);
+        CHECK(s.size == 40 && s[0] >= s[39]);
+      }
+      CHECK(getDifference(x.v, expected.v, 40) == 0);
+      // After the first frame a single block serves the whole frame
+      CHECK((frame == 0) == (arena.getMark().block > 0));
+      arena.reset();
+    }
+  }
+}
+
+int main()
+{
+  testAllocation();
+  testContainers();
+  testWorkspace();
+  return report();
+}
\ No newline at end of file
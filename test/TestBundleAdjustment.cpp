@@ -0,0 +1,113 @@
+// Sparse bundle adjustment: convergence to the true cameras and points from a perturbed start,
+// with any number of threads and with the Huber loss, and rejection of malformed problems.
+
+#include "BundleAdjustment.h"
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  const size_t camera_count = 5, point_count = 80;
+
+  struct Problem
+  {
+    Matrix3x4d truth[camera_count], cameras[camera_count];
+    std::vector<Vector3d> truth_points, points;
+    std::vector<Observation> observations;
+  };
+
+  Problem makeProblem()
+  {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> d(-3, 3);
+    std::uniform_real_distribution<double> perturbation(-0.02, 0.02);
+    Problem problem;
+    for (size_t i = 0; i < camera_count; ++i)
+      problem.cameras[i] = problem.truth[i] = getCameraMatrix(getRotationEuler(0.04 * i, 0.03 * i, -0.02 * i), Vector3d(0.8 * i, 0.1 * i, 0));
+    for (size_t j = 0; j < point_count; ++j) {
+      problem.truth_points.push_back(Vector3d(d(rng), d(rng), 10 + d(rng)));
+      for (size_t i = 0; i < camera_count; ++i)
+        problem.observations.push_back(Observation{ uint32(i), uint32(j), toInhomogeneous(problem.truth[i] * problem.truth_points[j]) });
+      problem.points.push_back(problem.truth_points[j] + Vector3d(perturbation(rng), perturbation(rng), perturbation(rng)));
+    }
+    // Two fixed cameras remove the scale freedom as well
+    for (size_t i = 2; i < camera_count; ++i) {
+      const Matrix3d R = getRotationRodrigues(Vector3d(perturbation(rng), perturbation(rng), perturbation(rng))) * getRotation(problem.truth[i]);
+      problem.cameras[i] = getCameraMatrix(R, getPosition(problem.truth[i]) + Vector3d(perturbation(rng), perturbation(rng), perturbation(rng)));
+    }
+    return problem;
+  }
+
+  double getError(const Problem& problem)
+  {
+    double error = 0;
+    for (size_t i = 0; i < camera_count; ++i)
+      error = std::max(error, getDifference(problem.cameras[i], problem.truth[i]));
+    for (size_t j = 0; j < point_count; ++j)
+      error = std::max(error, getDifference(problem.points[j], problem.truth_points[j]));
+    return error;
+  }
+
+  void testConvergence()
+  {
+    for (size_t threads : { 1, 4 }) {
+      Problem problem = makeProblem();
+      BundleAdjustmentOptions options;
+      options.fixed_cameras = 2;
+      options.threads = threads;
+      BundleAdjuster adjuster(options);
+      CHECK(adjuster.adjust(problem.cameras, camera_count, problem.points.data(), point_count, problem.observations.data(), problem.observations.size()));
+      CHECK(adjuster.getIterationCount() > 0);
+      CHECK(adjuster.getFinalCost() < 1e-20 + 1e-12 * adjuster.getInitialCost());
+      CHECK(getError(problem) < 1e-6);
+
+      // A robust loss leaves exact data exact
+      BundleAdjustmentOptions huber = options;
+      huber.huber = 1e-3;
+      CHECK(BundleAdjuster(huber).adjust(problem.cameras, camera_count, problem.points.data(), point_count, problem.observations.data(), problem.observations.size()));
+      CHECK(getError(problem) < 1e-6);
+    }
+  }
+
+  void testHuber()
+  {
+    // A few grossly wrong observations pull plain least squares away, the Huber loss much less
+    Problem plain = makeProblem();
+    for (size_t k = 7; k < plain.observations.size(); k += 37)
+      plain.observations[k].measurement = plain.observations[k].measurement + Vector2d(0.05, -0.05);
+    Problem robust = plain;
+    BundleAdjustmentOptions options;
+    options.fixed_cameras = 2;
+    CHECK(BundleAdjuster(options).adjust(plain.cameras, camera_count, plain.points.data(), point_count, plain.observations.data(), plain.observations.size()));
+    options.huber = 1e-3;
+    CHECK(BundleAdjuster(options).adjust(robust.cameras, camera_count, robust.points.data(), point_count, robust.observations.data(), robust.observations.size()));
+    CHECK(getError(robust) < getError(plain));
+  }
+
+  void testMalformed()
+  {
+    Problem problem = makeProblem();
+    BundleAdjuster adjuster;
+    problem.observations[3].point = uint32(point_count);
+    CHECK(!adjuster.adjust(problem.cameras, camera_count, problem.points.data(), point_count, problem.observations.data(), problem.observations.size()));
+    problem.observations[3].point = 0;
+    problem.observations[5].camera = uint32(camera_count);
+    CHECK(!adjuster.adjust(problem.cameras, camera_count, problem.points.data(), point_count, problem.observations.data(), problem.observations.size()));
+    CHECK(!adjuster.adjust(problem.cameras, camera_count, problem.points.data(), point_count, problem.observations.data(), 0));
+  }
+}
+
+int main()
+{
+  testConvergence();
+  testHuber();
+  testMalformed();
+  return report();
+}
\ No newline at end of file
@@ -0,0 +1,231 @@
+// Dense decompositions: Cholesky, blocked Householder QR, least squares and the Jacobi SVD,
+// checked through reconstructions and residuals on random matrices larger than one block.
+
+#include "DenseSolvers.h"
+#include "Test.h"
+
+#include <random>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  MatrixXd makeMatrix(size_t rows, size_t cols, std::mt19937& rng)
+  {
+    std::uniform_real_distribution<double> d(-1, 1);
+    MatrixXd M(rows, cols);
+    for (size_t i = 0; i < M.size; ++i)
+      M[i] = d(rng);
+    return M;
+  }
+
+  VectorXd makeVector(size_t n, std::mt19937& rng)
+  {
+    std::uniform_real_distribution<double> d(-1, 1);
+    VectorXd v(n);
+    for (size_t i = 0; i < n; ++i)
+      v[i] = d(rng);
+    return v;
+  }
+
+  //!\brief Largest difference of A from the product of the rows x depth B and the depth x cols C
+  double getProductError(const MatrixXd& A, const MatrixXd& B, const MatrixXd& C)
+  {
+    double error = 0;
+    for (size_t i = 0; i < A.rows; ++i)
+      for (size_t j = 0; j < A.cols; ++j) {
+        double s = 0;
+        for (size_t p = 0; p < B.cols; ++p)
+          s += B(i, p) * C(p, j);
+        error = std::max(error, std::abs(A(i, j) - s));
+      }
+    return error;
+  }
+
+  //!\brief Largest difference of the columns of M from being orthonormal
+  double getOrthonormalityError(const MatrixXd& M)
+  {
+    double error = 0;
+    for (size_t i = 0; i < M.cols; ++i)
+      for (size_t j = 0; j < M.cols; ++j) {
+        double s = 0;
+        for (size_t p = 0; p < M.rows; ++p)
+          s += M(p, i) * M(p, j);
+        error = std::max(error, std::abs(s - (i == j ? 1.0 : 0.0)));
+      }
+    return error;
+  }
+
+  void testCholesky()
+  {
+    std::mt19937 rng(3);
+    const size_t n = 150;
+    const MatrixXd M = makeMatrix(n, n, rng);
+    MatrixXd A;
+    multiplyTransposed(M, M, A);
+    for (size_t i = 0; i < n; ++i)
+      A(i, i) += 1.0;
+    const VectorXd b = makeVector(n, rng);
+
+    for (size_t threads : { 1, 4 }) {
+      GemmOptions options;
+      options.threads = threads;
+      MatrixXd R = A;
+      CHECK(choleskyDecompose(R, options));
+      for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < i; ++j)
+          R(i, j) = 0;
+      MatrixXd Rt(n, n);
+      for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < n; ++j)
+          Rt(i, j) = R(j, i);
+      CHECK(getProductError(A, Rt, R) < 1e-10);
+    }
+
+    VectorXd x;
+    CHECK(choleskySolve(A, b, x));
+    double residual = 0;
+    for (size_t i = 0; i < n; ++i) {
+      double s = -b[i];
+      for (size_t j = 0; j < n; ++j)
+        s += A(i, j) * x[j];
+      residual = std::max(residual, std::abs(s));
+    }
+    CHECK(residual < 1e-10);
+
+    // An indefinite matrix
+    MatrixXd B = A;
+    B(70, 70) = -1.0;
+    CHECK(!choleskyDecompose(B));
+  }
+
+  void testQr()
+  {
+    std::mt19937 rng(4);
+    for (size_t cols : { 20, 70 }) {
+      const size_t rows = 150;
+      const MatrixXd A = makeMatrix(rows, cols, rng);
+      MatrixXd QR = A;
+      VectorXd tau;
+      DenseWorkspace<double> workspace;
+      qrDecompose(QR, tau, workspace);
+      CHECK(tau.size == cols);
+
+      // Q R with R taken from the upper triangle gives back A
+      MatrixXd R(rows, cols);
+      for (size_t i = 0; i < rows; ++i)
+        for (size_t j = 0; j < cols; ++j)
+          R(i, j) = i <= j ? QR(i, j) : 0.0;
+      qrMultiply(QR, tau, R, false, workspace);
+      double error = 0;
+      for (size_t i = 0; i < A.size; ++i)
+        error = std::max(error, std::abs(R[i] - A[i]));
+      CHECK(error < 1e-12);
+
+      // Q is orthogonal, Q^T undoes Q for vectors and the vector and block forms agree
+      const VectorXd x = makeVector(rows, rng);
+      VectorXd y = x;
+      qrMultiply(QR, tau, y, false);
+      CHECK(std::abs(y.norm2() - x.norm2()) < 1e-10);
+      MatrixXd X(rows, 1);
+      for (size_t i = 0; i < rows; ++i)
+        X[i] = x[i];
+      qrMultiply(QR, tau, X, false, workspace);
+      CHECK(getDifference(X.v, y.v, rows) < 1e-12);
+      qrMultiply(QR, tau, y, true);
+      CHECK(getDifference(x.v, y.v, rows) < 1e-12);
+    }
+  }
+
+  void testLeastSquares()
+  {
+    std::mt19937 rng(5);
+    const size_t rows = 200, cols = 45;
+    const MatrixXd A = makeMatrix(rows, cols, rng);
+    const VectorXd b = makeVector(rows, rng);
+    VectorXd x;
+    CHECK(leastSquares(A, b, x));
+    CHECK(x.size == cols);
+
+    // The normal equations A^T A x = A^T b give the same solution on a well conditioned problem
+    MatrixXd N;
+    VectorXd c, expected;
+    multiplyTransposed(A, A, N);
+    multiplyTransposed(A, b, c);
+    CHECK(choleskySolve(N, c, expected));
+    CHECK(getDifference(x.v, expected.v, cols) < 1e-10);
+
+    // A consistent system is solved exactly
+    VectorXd truth = makeVector(cols, rng), exact;
+    VectorXd consistent;
+    multiply(A, truth, consistent);
+    CHECK(leastSquares(A, consistent, exact));
+    CHECK(getDifference(exact.v, truth.v, cols) < 1e-12);
+
+    // Wide systems, right hand sides of the wrong size and rank deficient matrices
+    CHECK(!leastSquares(makeMatrix(10, 20, rng), makeVector(10, rng), x));
+    CHECK(!leastSquares(A, makeVector(rows - 1, rng), x));
+    MatrixXd D = A;
+    for (size_t i = 0; i < rows; ++i)
+      D(i, 7) = 0;
+    CHECK(!leastSquares(D, b, x));
+  }
+
+  void testSvd()
+  {
+    std::mt19937 rng(6);
+    const size_t shapes[3][2] = { { 90, 30 }, { 30, 90 }, { 40, 40 } };
+    for (const auto& shape : shapes)
+      for (size_t threads : { 1, 4 }) {
+        const MatrixXd A = makeMatrix(shape[0], shape[1], rng);
+        const size_t k = std::min(shape[0], shape[1]);
+        VectorXd s;
+        MatrixXd U, V;
+        DenseWorkspace<double> workspace;
+        GemmOptions options;
+        options.threads = threads;
+        svdDecompose(A, s, &U, &V, workspace, options);
+        CHECK(s.size == k && U.rows == A.rows && U.cols == k && V.rows == A.cols && V.cols == k);
+        bool descending = s[k - 1] > 0;
+        for (size_t i = 1; i < k; ++i)
+          descending = descending && s[i - 1] >= s[i];
+        CHECK(descending);
+        CHECK(getOrthonormalityError(U) < 1e-12);
+        CHECK(getOrthonormalityError(V) < 1e-12);
+
+        // U diag(s) V^T gives back A
+        MatrixXd Us = U, Vt(k, A.cols);
+        for (size_t i = 0; i < A.rows; ++i)
+          for (size_t j = 0; j < k; ++j)
+            Us(i, j) *= s[j];
+        for (size_t i = 0; i < k; ++i)
+          for (size_t j = 0; j < A.cols; ++j)
+            Vt(i, j) = V(j, i);
+        CHECK(getProductError(A, Us, Vt) < 1e-12);
+
+        // The singular values alone
+        VectorXd t;
+        svdDecompose(A, t);
+        CHECK(getDifference(s.v, t.v, k) < 1e-12);
+      }
+
+    // Rank one: one nonzero singular value
+    MatrixXd R(20, 10);
+    for (size_t i = 0; i < 20; ++i)
+      for (size_t j = 0; j < 10; ++j)
+        R(i, j) = double(i + 1) * double(j + 2);
+    VectorXd s;
+    svdDecompose(R, s);
+    CHECK(s[0] > 1 && s[1] < 1e-12 * s[0]);
+  }
+}
+
+int main()
+{
+  testCholesky();
+  testQr();
+  testLeastSquares();
+  testSvd();
+  return report();
+}
\ No newline at end of file
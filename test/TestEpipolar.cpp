@@ -0,0 +1,108 @@
+// Two-view geometry: the 8-point fundamental matrix, the 5-point essential matrix and the
+// relative pose recovered from it, on exact correspondences of a known camera pair.
+
+#include "Epipolar.h"
+#include "MatrixOperations.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  const Matrix3d rotation = getRotationEuler(0.1, -0.05, 0.2);
+  const Vector3d translation(1, 0.1, -0.2);
+
+  void makeCorrespondences(size_t count, std::vector<Vector2d>& left, std::vector<Vector2d>& right)
+  {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> d(-3, 3);
+    left.resize(count);
+    right.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      const Vector3d X(d(rng), d(rng), 10 + d(rng));
+      const Vector3d Y = rotation * X + translation;
+      left[i] = Vector2d(X.x / X.z, X.y / X.z);
+      right[i] = Vector2d(Y.x / Y.z, Y.y / Y.z);
+    }
+  }
+
+  void testFundamental()
+  {
+    const size_t count = 50;
+    std::vector<Vector2d> left, right;
+    makeCorrespondences(count, left, right);
+
+    Matrix3d F;
+    CHECK(estimateFundamental(left.data(), right.data(), count, F));
+    double error = 0, norm2 = 0;
+    for (size_t i = 0; i < count; ++i)
+      error = std::max(error, getSampsonError2(F, left[i], right[i]));
+    for (size_t i = 0; i < 9; ++i)
+      norm2 += F[i] * F[i];
+    CHECK(error < 1e-16);
+    CHECK(std::abs(norm2 - 1) < 1e-12);
+    CHECK(std::abs(det(F)) < 1e-12);
+
+    // Separate float coordinates give the same geometry to single precision
+    std::vector<float> lx, ly, rx, ry;
+    for (size_t i = 0; i < count; ++i) {
+      lx.push_back(float(left[i].x));
+      ly.push_back(float(left[i].y));
+      rx.push_back(float(right[i].x));
+      ry.push_back(float(right[i].y));
+    }
+    const Vector2View<float> l(lx.data(), ly.data(), count), r(rx.data(), ry.data(), count);
+    Matrix3d G;
+    CHECK(estimateFundamental(l, r, G));
+    error = 0;
+    for (size_t i = 0; i < count; ++i)
+      error = std::max(error, getSampsonError2(G, left[i], right[i]));
+    CHECK(error < 1e-10);
+
+    // Too few correspondences, and views of different lengths
+    CHECK(!estimateFundamental(left.data(), right.data(), 7, F));
+    CHECK(!estimateFundamental(l, Vector2View<float>(rx.data(), ry.data(), count - 1), F));
+  }
+
+  void testEssential()
+  {
+    const size_t count = 50;
+    std::vector<Vector2d> left, right;
+    makeCorrespondences(count, left, right);
+
+    // The baseline of the relative pose is normalized
+    const double baseline = translation.norm();
+    const Matrix3x4d expected(
+      rotation.a00, rotation.a01, rotation.a02, translation.x / baseline,
+      rotation.a10, rotation.a11, rotation.a12, translation.y / baseline,
+      rotation.a20, rotation.a21, rotation.a22, translation.z / baseline);
+    Matrix3d E[10];
+    const size_t solutions = solveEssential(left.data(), right.data(), E);
+    CHECK(solutions > 0 && solutions <= 10);
+    bool found = false, decomposed = false;
+    for (size_t s = 0; s < solutions; ++s) {
+      Matrix3x4d camera = Matrix3x4d::Identity();
+      if (getRelativePose(E[s], left.data(), right.data(), count, camera) == count)
+        found = found || getDifference(camera, expected) < 1e-6;
+
+      // One of the four decompositions of the true solution is the pose
+      Matrix3x4d cameras[4];
+      if (decomposeEssential(E[s], cameras))
+        for (size_t k = 0; k < 4; ++k)
+          decomposed = decomposed || getDifference(cameras[k], expected) < 1e-6;
+    }
+    CHECK(found);
+    CHECK(decomposed);
+  }
+}
+
+int main()
+{
+  testFundamental();
+  testEssential();
+  return report();
+}
\ No newline at end of file
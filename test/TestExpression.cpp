@@ -0,0 +1,166 @@
+// Elementwise expressions over MatrixX and VectorX: fused evaluation against the loops written out,
+// reductions, targets that are also operands and operands of different shapes.
+
+#include "Matrix.h"
+#include "Test.h"
+#include "Vector.h"
+
+#include <random>
+#include <stdexcept>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  VectorXd makeVector(size_t n, std::mt19937& rng)
+  {
+    std::uniform_real_distribution<double> d(1, 2);
+    VectorXd v(n);
+    for (size_t i = 0; i < n; ++i)
+      v[i] = d(rng);
+    return v;
+  }
+
+  void testVectors()
+  {
+    std::mt19937 rng(1);
+    const size_t n = 500;
+    const VectorXd a = makeVector(n, rng), b = makeVector(n, rng), c = makeVector(n, rng);
+
+    VectorXd r = a * 2.0 + b - c;
+    bool equal = r.size == n;
+    for (size_t i = 0; i < n && equal; ++i)
+      equal = std::abs(r[i] - (a[i] * 2.0 + b[i] - c[i])) < 1e-12;
+    CHECK(equal);
+
+    // Scalars on either side, negation and division by a scalar
+    r = 1.0 - a / 4.0 + -b;
+    equal = r.size == n;
+    for (size_t i = 0; i < n && equal; ++i)
+      equal = std::abs(r[i] - (1.0 - a[i] / 4.0 - b[i])) < 1e-12;
+    CHECK(equal);
+
+    r = multiplyElements(a, b) + divideElements(c, b);
+    equal = r.size == n;
+    for (size_t i = 0; i < n && equal; ++i)
+      equal = std::abs(r[i] - (a[i] * b[i] + c[i] / b[i])) < 1e-12;
+    CHECK(equal);
+
+    double expected_dot = 0, expected_norm2 = 0, expected_sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      expected_dot += a[i] * b[i];
+      expected_norm2 += (a[i] - b[i]) * (a[i] - b[i]);
+      expected_sum += a[i] + c[i];
+    }
+    CHECK(std::abs(dot(a, b) - expected_dot) < 1e-9 * expected_dot);
+    CHECK(std::abs(norm2(a - b) - expected_norm2) < 1e-9 * expected_norm2);
+    CHECK(std::abs(sum(a + c) - expected_sum) < 1e-9 * expected_sum);
+
+    // Compound assignment of an expression
+    r = a;
+    r += b * 2.0;
+    r -= c;
+    equal = true;
+    for (size_t i = 0; i < n && equal; ++i)
+      equal = std::abs(r[i] - (a[i] + b[i] * 2.0 - c[i])) < 1e-12;
+    CHECK(equal);
+
+    // Single precision expressions stay single precision
+    VectorXf f(n);
+    for (size_t i = 0; i < n; ++i)
+      f[i] = float(a[i]);
+    const VectorXf g = f * 0.5 + f;
+    CHECK(g.size == n && g[7] == f[7] * 0.5f + f[7]);
+  }
+
+  void testAliasing()
+  {
+    std::mt19937 rng(2);
+    const size_t n = 300;
+    const VectorXd a = makeVector(n, rng), b = makeVector(n, rng);
+
+    // The target may be one of the operands
+    VectorXd x = a;
+    x = x * 3.0 - b;
+    bool equal = true;
+    for (size_t i = 0; i < n && equal; ++i)
+      equal = x[i] == a[i] * 3.0 - b[i];
+    CHECK(equal);
+
+    // A target smaller than the result grows, from the inline elements and from a heap buffer
+    for (size_t capacity : { 3, 100 }) {
+      VectorXd small(capacity);
+      small = a + b;
+      equal = small.size == n;
+      for (size_t i = 0; i < n && equal; ++i)
+        equal = small[i] == a[i] + b[i];
+      CHECK(equal);
+    }
+
+    MatrixXd A(7, 9), B(7, 9), M(2, 2);
+    for (size_t i = 0; i < A.size; ++i) {
+      A[i] = a[i];
+      B[i] = b[i];
+    }
+    M = A * 0.5 + B;
+    CHECK(M.rows == 7 && M.cols == 9);
+    equal = true;
+    for (size_t i = 0; i < M.size && equal; ++i)
+      equal = M[i] == A[i] * 0.5 + B[i];
+    CHECK(equal);
+    M = M - A;
+    equal = true;
+    for (size_t i = 0; i < M.size && equal; ++i)
+      equal = M[i] == (A[i] * 0.5 + B[i]) - A[i];
+    CHECK(equal);
+  }
+
+  void testShapes()
+  {
+    const VectorXd a(3), b(4);
+    const MatrixXd A(2, 6), B(3, 4), C(6, 2);
+    bool thrown = false;
+    try {
+      VectorXd r = a + b;
+    }
+    catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+
+    // Matrices of the same size but a different shape, and products of elements
+    thrown = false;
+    try {
+      MatrixXd R = A - C;
+    }
+    catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+    thrown = false;
+    try {
+      MatrixXd R = multiplyElements(A, B);
+    }
+    catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+    thrown = false;
+    try {
+      dot(a, b);
+    }
+    catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+}
+
+int main()
+{
+  testVectors();
+  testAliasing();
+  testShapes();
+  return report();
+}
\ No newline at end of file
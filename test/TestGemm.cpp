@@ -0,0 +1,196 @@
+// Matrix products: the blocked gemm and gemv against the loops written out, for shapes that do
+// not fill whole blocks, a long depth split over threads, transposed operands and aliased results.
+
+#include "Gemm.h"
+#include "Test.h"
+
+#include <random>
+#include <stdexcept>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  template <typename T>
+  MatrixX<T> makeMatrix(size_t rows, size_t cols, std::mt19937& rng)
+  {
+    std::uniform_real_distribution<double> d(-1, 1);
+    MatrixX<T> M(rows, cols);
+    for (size_t i = 0; i < M.size; ++i)
+      M[i] = T(d(rng));
+    return M;
+  }
+
+  //!\brief Largest difference of C from op(A) * op(B)
+  template <typename T>
+  double getProductError(const MatrixX<T>& A, bool transpose_a, const MatrixX<T>& B, bool transpose_b, const MatrixX<T>& C)
+  {
+    const size_t m = transpose_a ? A.cols : A.rows, k = transpose_a ? A.rows : A.cols;
+    const size_t n = transpose_b ? B.rows : B.cols;
+    if (C.rows != m || C.cols != n)
+      return 1e300;
+    double error = 0;
+    for (size_t i = 0; i < m; ++i)
+      for (size_t j = 0; j < n; ++j) {
+        double s = 0;
+        for (size_t p = 0; p < k; ++p)
+          s += double(transpose_a ? A(p, i) : A(i, p)) * double(transpose_b ? B(j, p) : B(p, j));
+        error = std::max(error, std::abs(double(C(i, j)) - s));
+      }
+    return error;
+  }
+
+  template <typename T>
+  void testProducts(double tolerance)
+  {
+    std::mt19937 rng(2);
+    // The second shape has a long depth so that it takes the path splitting k over threads
+    const size_t shapes[3][3] = { { 37, 53, 29 }, { 8, 3000, 8 }, { 1, 5, 70 } };
+    for (const auto& shape : shapes) {
+      const size_t m = shape[0], k = shape[1], n = shape[2];
+      const MatrixX<T> A = makeMatrix<T>(m, k, rng), B = makeMatrix<T>(k, n, rng);
+      const MatrixX<T> At = makeMatrix<T>(k, m, rng), Bt = makeMatrix<T>(n, k, rng);
+      for (size_t threads : { 1, 8 }) {
+        GemmOptions options;
+        options.threads = threads;
+        MatrixX<T> C;
+        multiply(A, B, C, options);
+        CHECK(getProductError(A, false, B, false, C) < tolerance);
+        multiplyTransposed(At, B, C, options);
+        CHECK(getProductError(At, true, B, false, C) < tolerance);
+
+        // The raw interface with both operands transposed, alpha and beta
+        MatrixX<T> D = makeMatrix<T>(m, n, rng);
+        const MatrixX<T> D0 = D;
+        gemm(true, true, m, n, k, T(2), At.v, m, Bt.v, k, T(-1), D.v, n, options);
+        double error = 0;
+        for (size_t i = 0; i < m; ++i)
+          for (size_t j = 0; j < n; ++j) {
+            double s = 0;
+            for (size_t p = 0; p < k; ++p)
+              s += double(At(p, i)) * double(Bt(j, p));
+            error = std::max(error, std::abs(double(D(i, j)) - (2 * s - double(D0(i, j)))));
+          }
+        CHECK(error < 2 * tolerance);
+      }
+
+      // A^T A is symmetric and only half of it is computed
+      MatrixX<T> N;
+      multiplyTransposed(A, A, N);
+      CHECK(getProductError(A, true, A, false, N) < tolerance);
+
+      const MatrixX<T> x = makeMatrix<T>(n, 1, rng), z = makeMatrix<T>(k, 1, rng);
+      VectorX<T> u(n), w(k), y;
+      for (size_t j = 0; j < n; ++j)
+        u[j] = x[j];
+      for (size_t i = 0; i < k; ++i)
+        w[i] = z[i];
+      multiply(B, u, y);
+      CHECK(y.size == k);
+      MatrixX<T> Y(k, 1);
+      for (size_t i = 0; i < k; ++i)
+        Y[i] = y[i];
+      CHECK(getProductError(B, false, x, false, Y) < tolerance);
+      multiplyTransposed(B, w, y);
+      CHECK(y.size == n);
+      Y.resize(n, 1);
+      for (size_t j = 0; j < n; ++j)
+        Y[j] = y[j];
+      CHECK(getProductError(B, true, z, false, Y) < tolerance);
+    }
+  }
+
+  void testGemv()
+  {
+    // Large enough that gemv spreads the outputs over threads
+    std::mt19937 rng(3);
+    const MatrixXd A = makeMatrix<double>(600, 700, rng);
+    VectorXd x(700), w(600), y1, y8, z1, z8;
+    for (size_t j = 0; j < 700; ++j)
+      x[j] = A(j % 600, j);
+    for (size_t i = 0; i < 600; ++i)
+      w[i] = A(i, i);
+    GemmOptions single, parallel;
+    single.threads = 1;
+    parallel.threads = 8;
+    multiply(A, x, y1, single);
+    multiply(A, x, y8, parallel);
+    multiplyTransposed(A, w, z1, single);
+    multiplyTransposed(A, w, z8, parallel);
+    CHECK(y1.size == 600 && getDifference(y1.v, y8.v, 600) == 0);
+    CHECK(z1.size == 700 && getDifference(z1.v, z8.v, 700) == 0);
+    double error = 0;
+    for (size_t i = 0; i < 600; ++i) {
+      double s = 0;
+      for (size_t j = 0; j < 700; ++j)
+        s += A(i, j) * x[j];
+      error = std::max(error, std::abs(y1[i] - s));
+    }
+    CHECK(error < 1e-10);
+  }
+
+  void testAliasing()
+  {
+    std::mt19937 rng(4);
+    const MatrixXd A0 = makeMatrix<double>(30, 30, rng), B = makeMatrix<double>(30, 20, rng);
+    MatrixXd A = A0;
+    multiply(A, B, A);
+    CHECK(getProductError(A0, false, B, false, A) < 1e-10);
+    A = A0;
+    multiplyTransposed(A, A, A);
+    CHECK(getProductError(A0, true, A0, false, A) < 1e-10);
+    MatrixXd C = B;
+    multiplyTransposed(A0, C, C);
+    CHECK(getProductError(A0, true, B, false, C) < 1e-10);
+
+    VectorXd x(30), x0;
+    for (size_t i = 0; i < 30; ++i)
+      x[i] = B(i, 0);
+    x0 = x;
+    multiply(A0, x, x);
+    double error = 0;
+    for (size_t i = 0; i < 30; ++i) {
+      double s = 0;
+      for (size_t j = 0; j < 30; ++j)
+        s += A0(i, j) * x0[j];
+      error = std::max(error, std::abs(x[i] - s));
+    }
+    CHECK(error < 1e-10);
+    x = x0;
+    multiplyTransposed(A0, x, x);
+    error = 0;
+    for (size_t j = 0; j < 30; ++j) {
+      double s = 0;
+      for (size_t i = 0; i < 30; ++i)
+        s += A0(i, j) * x0[i];
+      error = std::max(error, std::abs(x[j] - s));
+    }
+    CHECK(error < 1e-10);
+  }
+
+  void testShapes()
+  {
+    const MatrixXd A(3, 4), B(5, 2);
+    const VectorXd x(3);
+    MatrixXd C;
+    VectorXd y;
+    size_t thrown = 0;
+    try { multiply(A, B, C); } catch (const std::invalid_argument&) { ++thrown; }
+    try { multiplyTransposed(A, B, C); } catch (const std::invalid_argument&) { ++thrown; }
+    try { multiply(A, x, y); } catch (const std::invalid_argument&) { ++thrown; }
+    try { multiplyTransposed(B, x, y); } catch (const std::invalid_argument&) { ++thrown; }
+    CHECK(thrown == 4);
+    CHECK(C.size == 0 && y.size == 0);
+  }
+}
+
+int main()
+{
+  testProducts<double>(1e-10);
+  testProducts<float>(1e-3);
+  testGemv();
+  testAliasing();
+  testShapes();
+  return report();
+}
\ No newline at end of file
@@ -0,0 +1,257 @@
+// Homography estimation: the normalized DLT, batched sets, the streaming accumulator, the point
+// statistics behind the normalization and the Levenberg-Marquardt refinement.
+
+#include "Homography.h"
+#include "HomographyRefinement.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  const Matrix3d truth(
+    1.1, 0.05, 20,
+    -0.03, 0.95, -10,
+    1e-4, -5e-5, 1);
+
+  Vector2d transfer(const Matrix3d& H, const Vector2d& p)
+  {
+    return toInhomogeneous(H * Vector3d(p.x, p.y, 1.0));
+  }
+
+  void makeCorrespondences(size_t count, unsigned seed, std::vector<Vector2d>& left, std::vector<Vector2d>& right)
+  {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> x(0, 640), y(0, 480);
+    left.resize(count);
+    right.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      left[i] = Vector2d(x(rng), y(rng));
+      right[i] = transfer(truth, left[i]);
+    }
+  }
+
+  void testEstimate()
+  {
+    std::vector<Vector2d> left, right;
+    makeCorrespondences(50, 1, left, right);
+
+    Homography homography;
+    homography.reserve(left.size());
+    for (size_t i = 0; i < left.size(); ++i)
+      homography.addCorrespondence(left[i], right[i]);
+    CHECK(homography.getCorrespondenceCount() == left.size());
+    Matrix3d H;
+    CHECK(homography.estimate(H));
+    CHECK(getHomographyDifference(H, truth) < 1e-8);
+
+    CHECK(estimateHomography(left.data(), right.data(), 4, H));
+    CHECK(getHomographyDifference(H, truth) < 1e-6);
+    CHECK(!estimateHomography(left.data(), right.data(), 3, H));
+  }
+
+  void testViews()
+  {
+    std::vector<Vector2d> left, right;
+    makeCorrespondences(40, 2, left, right);
+
+    // Separate coordinate arrays in float, used without copying
+    std::vector<float> lx, ly, rx, ry;
+    for (size_t i = 0; i < left.size(); ++i) {
+      lx.push_back(float(left[i].x));
+      ly.push_back(float(left[i].y));
+      rx.push_back(float(right[i].x));
+      ry.push_back(float(right[i].y));
+    }
+    Homography homography;
+    homography.setCorrespondences(Vector2View<float>(lx.data(), ly.data(), lx.size()), Vector2View<float>(rx.data(), ry.data(), rx.size()));
+    CHECK(homography.getCorrespondenceCount() == left.size());
+    Matrix3d H;
+    CHECK(homography.estimate(H));
+    CHECK(getHomographyDifference(H, truth) < 1e-3);
+
+    const Vector2View<double> l = Vector2View<double>::Interleaved(&left[0].x, left.size());
+    const Vector2View<double> r = Vector2View<double>::Interleaved(&right[0].x, right.size());
+    CHECK(estimateHomography(l, r, H));
+    CHECK(getHomographyDifference(H, truth) < 1e-8);
+
+    // Views of different lengths are rejected rather than normalized over points not in the system
+    CHECK(!estimateHomography(l, Vector2View<double>::Interleaved(&right[0].x, right.size() - 1), H));
+  }
+
+  void testStreaming()
+  {
+    std::vector<Vector2d> left, right;
+    makeCorrespondences(60, 3, left, right);
+
+    Homography homography;
+    homography.setStreaming(true);
+    CHECK(homography.isStreaming());
+    for (size_t i = 0; i < left.size(); ++i)
+      homography.addCorrespondence(left[i], right[i]);
+    // A wrong correspondence that is taken back again, and a decay that keeps the solution
+    const Vector2d outlier(100, 100);
+    homography.addCorrespondence(outlier, Vector2d(400, 20));
+    homography.removeCorrespondence(outlier, Vector2d(400, 20));
+    homography.decay(0.5);
+    CHECK(homography.getCorrespondenceCount() == left.size());
+    Matrix3d H;
+    CHECK(homography.estimate(H));
+    CHECK(getHomographyDifference(H, truth) < 1e-6);
+
+    // Caller buffers leave streaming mode, so they are what gets estimated
+    const Vector2View<double> l = Vector2View<double>::Interleaved(&left[0].x, 10);
+    const Vector2View<double> r = Vector2View<double>::Interleaved(&right[0].x, 10);
+    homography.setCorrespondences(l, r);
+    CHECK(!homography.isStreaming());
+    CHECK(homography.getCorrespondenceCount() == 10);
+    CHECK(homography.estimate(H));
+    CHECK(getHomographyDifference(H, truth) < 1e-8);
+
+    // Outside streaming mode removing and decaying leave the stored correspondences alone
+    Homography stored;
+    for (size_t i = 0; i < 8; ++i)
+      stored.addCorrespondence(left[i], right[i]);
+    stored.removeCorrespondence(left[0], right[0]);
+    stored.decay(0.0);
+    CHECK(stored.getCorrespondenceCount() == 8);
+    CHECK(stored.estimate(H));
+    CHECK(getHomographyDifference(H, truth) < 1e-8);
+  }
+
+  void testAccumulator()
+  {
+    std::vector<Vector2d> left, right;
+    makeCorrespondences(30, 4, left, right);
+
+    HomographyAccumulator accumulator;
+    Matrix3d H;
+    for (size_t i = 0; i < 3; ++i)
+      accumulator.add(left[i], right[i]);
+    CHECK(!accumulator.estimate(H));
+    for (size_t i = 3; i < left.size(); ++i)
+      accumulator.add(left[i], right[i], 0.5 + double(i % 3));
+    CHECK(accumulator.getCount() == left.size());
+    CHECK(accumulator.estimate(H));
+    CHECK(getHomographyDifference(H, truth) < 1e-6);
+
+    accumulator.add(Vector2d(10, 10), Vector2d(300, 300));
+    CHECK(getHomographyDifference((accumulator.estimate(H), H), truth) > 1e-3);
+    accumulator.remove(Vector2d(10, 10), Vector2d(300, 300));
+    accumulator.scale(0.25);
+    CHECK(accumulator.estimate(H));
+    CHECK(getHomographyDifference(H, truth) < 1e-6);
+
+    accumulator.clear();
+    CHECK(accumulator.getCount() == 0 && !accumulator.estimate(H));
+  }
+
+  void testBatched()
+  {
+    // Sets of varying size, one of them too small to be solved
+    const size_t sizes[] = { 4, 12, 7, 3, 25, 9, 5 };
+    const size_t set_count = sizeof(sizes) / sizeof(sizes[0]);
+    std::vector<Vector2d> left, right;
+    std::vector<size_t> offsets(1, 0);
+    std::vector<Matrix3d> expected;
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> x(0, 640), y(0, 480), d(-0.05, 0.05);
+    for (size_t s = 0; s < set_count; ++s) {
+      const Matrix3d H(1 + d(rng), d(rng), 100 * d(rng), d(rng), 1 + d(rng), 100 * d(rng), d(rng) / 1000, d(rng) / 1000, 1);
+      expected.push_back(H);
+      for (size_t i = 0; i < sizes[s]; ++i) {
+        left.push_back(Vector2d(x(rng), y(rng)));
+        right.push_back(transfer(H, left.back()));
+      }
+      offsets.push_back(left.size());
+    }
+
+    std::vector<Matrix3d> H(set_count);
+    std::vector<uint8> valid(set_count);
+    CHECK(estimateHomographies(left.data(), right.data(), offsets.data(), set_count, H.data(), valid.data(), 2) == set_count - 1);
+    for (size_t s = 0; s < set_count; ++s) {
+      CHECK(bool(valid[s]) == (sizes[s] >= 4));
+      if (valid[s])
+        CHECK(getHomographyDifference(H[s], expected[s]) < 1e-6);
+    }
+  }
+
+  void testNormalization()
+  {
+    std::mt19937 rng(6);
+    std::normal_distribution<double> x(300, 50), y(-20, 5);
+    const size_t count = 200000;
+    std::vector<Vector2d> points(count);
+    double sx = 0, sy = 0;
+    for (size_t i = 0; i < count; ++i) {
+      points[i] = Vector2d(x(rng), y(rng));
+      sx += points[i].x;
+      sy += points[i].y;
+    }
+    const Vector2d mean(sx / count, sy / count);
+    double vx = 0, vy = 0;
+    for (size_t i = 0; i < count; ++i) {
+      vx += (points[i].x - mean.x) * (points[i].x - mean.x);
+      vy += (points[i].y - mean.y) * (points[i].y - mean.y);
+    }
+    const Vector2d stdev(std::sqrt(vx / count), std::sqrt(vy / count));
+
+    // Serial and threaded reductions agree with the two pass statistics
+    for (size_t threads : { 1, 4 }) {
+      const PointStatistics statistics = getPointStatistics(points.data(), count, threads);
+      CHECK(statistics.weight == double(count));
+      CHECK(getDifference(statistics.mean, mean) < 1e-9);
+      CHECK(getDifference(statistics.getStdev(), stdev) < 1e-9);
+    }
+
+    // The normalized points are centered with an average distance of about sqrt(2)
+    Matrix3d T;
+    getHartleyNormalization(points.data(), count, T, 4);
+    double nx = 0, ny = 0, n2 = 0;
+    for (size_t i = 0; i < count; ++i) {
+      const Vector2d p = transfer(T, points[i]);
+      nx += p.x;
+      ny += p.y;
+      n2 += p.norm2();
+    }
+    CHECK(std::abs(nx / count) < 1e-9 && std::abs(ny / count) < 1e-9);
+    CHECK(std::abs(n2 / count - 4.0) < 1e-9);
+  }
+
+  void testRefinement()
+  {
+    std::vector<Vector2d> left, right;
+    makeCorrespondences(100, 7, left, right);
+    std::vector<uint8> mask(left.size(), 1);
+    for (size_t i = 0; i < left.size(); i += 10) {
+      right[i] = right[i] + Vector2d(50, -30);
+      mask[i] = 0;
+    }
+
+    const Vector2View<double> l = Vector2View<double>::Interleaved(&left[0].x, left.size());
+    const Vector2View<double> r = Vector2View<double>::Interleaved(&right[0].x, right.size());
+    CHECK(getTransferError(truth, l, r, mask.data()) < 1e-16);
+    Matrix3d H = truth;
+    H.a02 += 2;
+    H.a10 += 0.01;
+    H.a21 += 1e-5;
+    CHECK(refineHomography(left.data(), right.data(), left.size(), H, mask.data()));
+    CHECK(getHomographyDifference(H, truth) < 1e-8);
+  }
+}
+
+int main()
+{
+  testEstimate();
+  testViews();
+  testStreaming();
+  testAccumulator();
+  testBatched();
+  testNormalization();
+  testRefinement();
+  return report();
+}
\ No newline at end of file
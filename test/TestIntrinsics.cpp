@@ -0,0 +1,136 @@
+// Camera intrinsics and lens distortion: the iterative undistortion against the distortion model,
+// and the cached undistortion map for points and images in both storage formats.
+
+#include "Intrinsics.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  const Intrinsicsd camera(500, 510, 321, 239, -0.28, 0.09, 1e-3, -5e-4, -0.01);
+  const size_t width = 640, height = 480;
+
+  void testDistortion()
+  {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> d(-0.6, 0.6);
+    std::vector<Vector2d> normalized(20000), pixels(20000), restored(20000);
+    for (Vector2d& p : normalized)
+      p = Vector2d(d(rng), d(rng) * 0.75);
+    for (size_t threads : { 1, 4 }) {
+      distortPoints(camera, normalized.data(), pixels.data(), normalized.size(), threads);
+      const Vector2d check = distort(camera, normalized[9]);
+      CHECK(getDifference(pixels[9], Vector2d(camera.fx * check.x + camera.cx, camera.fy * check.y + camera.cy)) == 0);
+      undistortPoints(camera, pixels.data(), restored.data(), pixels.size(), 10, threads);
+      CHECK(getDifference(&restored[0].x, &normalized[0].x, 2 * normalized.size()) < 1e-10);
+    }
+    CHECK(camera.hasDistortion());
+    CHECK(Intrinsicsd(500, 510, 321, 239) == Intrinsicsf(500, 510, 321, 239));
+    CHECK(!Intrinsicsd(500, 510, 321, 239).hasDistortion());
+  }
+
+  void testMapPoints()
+  {
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<double> x(0, width - 1), y(0, height - 1);
+    std::vector<Vector2d> pixels(5000), expected(5000), mapped(5000);
+    for (Vector2d& p : pixels)
+      p = Vector2d(x(rng), y(rng));
+    undistortPoints(camera, pixels.data(), expected.data(), pixels.size(), 10);
+
+    UndistortionMap map;
+    CHECK(!map.matches(camera, width, height));
+    CHECK(map.build(camera, width, height, UndistortionMap::Storage::Float, 2));
+    CHECK(map.matches(camera, width, height));
+    CHECK(!map.matches(camera, width + 1, height));
+    map.undistortPoints(pixels.data(), mapped.data(), pixels.size(), 2);
+    // The table is interpolated between pixels, a small fraction of a pixel
+    CHECK(getDifference(&mapped[0].x, &expected[0].x, 2 * pixels.size()) < 1e-3 / camera.fx);
+    // Outside the image the iterative solve is used
+    const Vector2d outside(-20.5, 10);
+    const Vector2d solved = undistort(camera, Vector2d((outside.x - camera.cx) / camera.fx, (outside.y - camera.cy) / camera.fy));
+    CHECK(getDifference(map.undistortPoint(outside), solved) < 1e-12);
+
+    // A map for another target does not serve the default target
+    const Intrinsicsd target(400, 400, 320, 240);
+    CHECK(map.build(camera, target, width, height));
+    CHECK(map.matches(camera, target, width, height));
+    CHECK(!map.matches(camera, width, height));
+    CHECK(!map.matches(camera, Intrinsicsd(401, 400, 320, 240), width, height));
+    CHECK(!map.build(camera, 40000, 10, UndistortionMap::Storage::Fixed));
+  }
+
+  //!\brief An image whose value is linear in the pixel position, so bilinear sampling is exact
+  std::vector<float32> makeRamp(size_t channels)
+  {
+    std::vector<float32> image(width * height * channels);
+    for (size_t y = 0; y < height; ++y)
+      for (size_t x = 0; x < width; ++x)
+        for (size_t c = 0; c < channels; ++c)
+          image[(y * width + x) * channels + c] = float32(0.2 * x + 0.3 * y + 10 * c);
+    return image;
+  }
+
+  void testMapImage()
+  {
+    // A wider target than the camera, so the corners have no source
+    const Intrinsicsd target(300, 300, 320, 240);
+    const size_t channels = 2;
+    const std::vector<float32> ramp = makeRamp(channels);
+    const ImageView<const float32> src(ramp.data(), width, height, channels);
+    for (UndistortionMap::Storage storage : { UndistortionMap::Storage::Float, UndistortionMap::Storage::Fixed }) {
+      UndistortionMap map;
+      CHECK(map.build(camera, target, width, height, storage, 3));
+      CHECK(map.getStorage() == storage);
+      std::vector<float32> out(width * height * channels);
+      map.undistortImage(src, ImageView<float32>(out.data(), width, height, channels), Interpolation::Bilinear, -1.0f, 3);
+      double error = 0;
+      size_t inside = 0, outside = 0;
+      bool border = true;
+      for (size_t y = 0; y < height; ++y)
+        for (size_t x = 0; x < width; ++x) {
+          const Vector2d d = distort(camera, Vector2d((x - target.cx) / target.fx, (y - target.cy) / target.fy));
+          const double sx = camera.fx * d.x + camera.cx, sy = camera.fy * d.y + camera.cy;
+          if (sx < -1 || sy < -1 || sx > width || sy > height) {
+            ++outside;
+            border = border && out[(y * width + x) * channels] == -1.0f;
+          }
+          if (sx < 1 || sy < 1 || sx > width - 2 || sy > height - 2)
+            continue;
+          ++inside;
+          for (size_t c = 0; c < channels; ++c)
+            error = std::max(error, std::abs(out[(y * width + x) * channels + c] - (0.2 * sx + 0.3 * sy + 10 * c)));
+        }
+      CHECK(inside > width * height / 4 && outside > 0 && border);
+      // Fixed point weights are accurate to 1/2048 of a pixel
+      CHECK(error < (storage == UndistortionMap::Storage::Float ? 1e-3 : 1e-3 + 0.5 / 2048));
+    }
+  }
+
+  void testMapMismatch()
+  {
+    UndistortionMap map;
+    CHECK(map.build(camera, width, height));
+    const std::vector<float32> ramp = makeRamp(3);
+    std::vector<float32> out(width * height, 7.0f);
+    // Fewer channels in dst, and a smaller dst, leave dst untouched
+    map.undistortImage(ImageView<const float32>(ramp.data(), width, height, 3), ImageView<float32>(out.data(), width, height, 1));
+    CHECK(out == std::vector<float32>(width * height, 7.0f));
+    map.undistortImage(ImageView<const float32>(ramp.data(), width, height, 3), ImageView<float32>(out.data(), width / 3, height, 3));
+    CHECK(out == std::vector<float32>(width * height, 7.0f));
+  }
+}
+
+int main()
+{
+  testDistortion();
+  testMapPoints();
+  testMapImage();
+  testMapMismatch();
+  return report();
+}
\ No newline at end of file
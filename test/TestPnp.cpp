@@ -0,0 +1,127 @@
+// Camera pose from world to image correspondences: absolute orientation, EPnP, the planar case,
+// P3P and both kinds of RANSAC hypothesis under outliers.
+
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "Pnp.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  const Matrix3x4d truth = getCameraMatrix(getRotationEuler(0.3, -0.2, 0.5), Vector3d(0.5, -1, -8));
+
+  void testAbsoluteOrientation()
+  {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> d(-3, 3);
+    const Matrix3d R = getRotationEuler(-0.7, 0.4, 1.9);
+    const Vector3d t(3, -1, 2);
+    std::vector<Vector3d> from(10), to(10);
+    for (size_t i = 0; i < from.size(); ++i) {
+      from[i] = Vector3d(d(rng), d(rng), d(rng));
+      to[i] = R * from[i] + t;
+    }
+    Matrix3d R1;
+    Vector3d t1;
+    getAbsoluteOrientation(from.data(), to.data(), from.size(), R1, t1);
+    CHECK(getDifference(R1, R) < 1e-10);
+    CHECK(getDifference(t1, t) < 1e-10);
+  }
+
+  void testSolvers()
+  {
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> d(-3, 3);
+    const size_t count = 100;
+    std::vector<Vector3d> world(count), plane(count);
+    std::vector<Vector2d> image(count), plane_image(count);
+    for (size_t i = 0; i < count; ++i) {
+      world[i] = Vector3d(d(rng), d(rng), d(rng));
+      image[i] = toInhomogeneous(truth * world[i]);
+      // A tilted plane through the cloud
+      plane[i] = Vector3d(world[i].x, world[i].y, 0.3 * world[i].x - 0.2 * world[i].y + 1);
+      plane_image[i] = toInhomogeneous(truth * plane[i]);
+    }
+
+    Matrix3x4d camera;
+    CHECK(solvePnP(world.data(), image.data(), count, camera));
+    CHECK(getDifference(camera, truth) < 1e-8);
+    CHECK(solvePnP(world.data(), image.data(), 4, camera));
+    CHECK(getDifference(camera, truth) < 1e-6);
+    CHECK(solvePnP(plane.data(), plane_image.data(), count, camera));
+    CHECK(getDifference(camera, truth) < 1e-8);
+    CHECK(!solvePnP(world.data(), image.data(), 3, camera));
+
+    Matrix3x4d cameras[4];
+    const size_t solutions = solveP3P(world.data(), image.data(), cameras);
+    bool found = false;
+    for (size_t s = 0; s < solutions; ++s)
+      found = found || getDifference(cameras[s], truth) < 1e-6;
+    CHECK(found);
+  }
+
+  void testRansac()
+  {
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> d(-3, 3);
+    const size_t count = 200;
+    std::vector<Vector3d> world(count);
+    std::vector<Vector2d> image(count);
+    std::vector<uint8> outlier(count);
+    for (size_t i = 0; i < count; ++i) {
+      world[i] = Vector3d(d(rng), d(rng), d(rng));
+      image[i] = toInhomogeneous(truth * world[i]);
+    }
+    // A quarter of the correspondences are moved far from their projection
+    for (size_t i = 3; i < count; i += 4) {
+      image[i] = Vector2d(image[i].x + 0.1 + d(rng) / 10, image[i].y - 0.1 + d(rng) / 10);
+      outlier[i] = 1;
+    }
+    std::vector<uint8> mask(count);
+    for (size_t i = 0; i < count; ++i)
+      mask[i] = !outlier[i];
+    Matrix3x4d camera;
+    CHECK(solvePnP(world.data(), image.data(), count, camera, mask.data()));
+    CHECK(getDifference(camera, truth) < 1e-8);
+
+    for (bool minimal_p3p : { true, false }) {
+      Matrix3x4d reference = Matrix3x4d::Identity();
+      for (size_t threads : { 1, 3 }) {
+        RansacPnpOptions options;
+        options.deterministic = true;
+        options.minimal_p3p = minimal_p3p;
+        options.threads = threads;
+        RansacPnp ransac(options);
+        std::vector<uint8> inliers(count);
+        CHECK(ransac.estimate(world.data(), image.data(), count, camera, inliers.data()));
+        CHECK(getDifference(camera, truth) < 1e-8);
+        CHECK(ransac.getInlierCount() == count - count / 4);
+        CHECK(ransac.getIterationCount() > 0);
+        bool flags = true;
+        for (size_t i = 0; i < count; ++i)
+          flags = flags && inliers[i] == !outlier[i];
+        CHECK(flags);
+        if (threads == 1)
+          reference = camera;
+        CHECK(getDifference(camera, reference) == 0);
+      }
+    }
+
+    RansacPnp ransac;
+    CHECK(!ransac.estimate(world.data(), image.data(), 3, camera));
+  }
+}
+
+int main()
+{
+  testAbsoluteOrientation();
+  testSolvers();
+  testRansac();
+  return report();
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+// Batched point cloud projection: every layout and thread count against projecting each point
+// through the camera matrix.
+
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "Projection.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  template <typename T>
+  void testProjection()
+  {
+    const Matrix3x4<T> P = Matrix3<T>(800, 0, 320, 0, 800, 240, 0, 0, 1) *
+      getCameraMatrix(getRotationEuler(T(0.1), T(-0.2), T(0.3)), Vector3<T>(1, -2, -5));
+    // Enough points for several chunks, part of them behind the camera
+    const size_t count = 50000;
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<T> d(-20, 20);
+    std::vector<Vector3<T>> points(count);
+    std::vector<T> x(count), y(count), z(count), padded(4 * count);
+    std::vector<T> u0(count), v0(count), depth0(count);
+    size_t visible0 = 0;
+    const T min_depth = T(0.5);
+    for (size_t i = 0; i < count; ++i) {
+      points[i] = Vector3<T>(d(rng), d(rng), d(rng));
+      x[i] = padded[4 * i] = points[i].x;
+      y[i] = padded[4 * i + 1] = points[i].y;
+      z[i] = padded[4 * i + 2] = points[i].z;
+      const Vector3<T> p = P * points[i];
+      u0[i] = p.x / p.z;
+      v0[i] = p.y / p.z;
+      depth0[i] = p.z;
+      visible0 += p.z > min_depth;
+    }
+    CHECK(visible0 > 0 && visible0 < count);
+
+    const Vector3View<T> views[] = {
+      Vector3View<T>(x.data(), y.data(), z.data(), count),
+      Vector3View<T>::Interleaved(&points[0].x, count),
+      Vector3View<T>(&padded[0], &padded[1], &padded[2], count, 4)
+    };
+    for (const Vector3View<T>& view : views)
+      for (size_t threads : { 1, 4 }) {
+        std::vector<T> u(count), v(count), depth(count);
+        std::vector<uint8> valid(count);
+        CHECK(projectPoints(P, view, u.data(), v.data(), depth.data(), valid.data(), min_depth, threads) == visible0);
+        double error = 0;
+        bool flags = true;
+        for (size_t i = 0; i < count; ++i) {
+          flags = flags && bool(valid[i]) == (depth0[i] > min_depth);
+          if (valid[i])
+            error = std::max(error, double(std::abs(u[i] - u0[i]) + std::abs(v[i] - v0[i])) / (1 + std::abs(u0[i]) + std::abs(v0[i])));
+        }
+        CHECK(flags);
+        CHECK(error < 1e-5);
+        CHECK(getDifference(depth, depth0, count) < 1e-3);
+
+        // Without the optional outputs only the count is reported
+        CHECK(projectPoints(P, view, u.data(), v.data(), (T*)nullptr, nullptr, min_depth, threads) == visible0);
+      }
+  }
+}
+
+int main()
+{
+  testProjection<float>();
+  testProjection<double>();
+  return report();
+}
\ No newline at end of file
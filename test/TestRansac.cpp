@@ -0,0 +1,145 @@
+// Parallel RANSAC homography estimation: recovery of the model and the inlier set under outliers,
+// and reproducible results in deterministic mode whatever the number of threads.
+
+#include "Ransac.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  const Matrix3d truth(
+    1.1, 0.05, 20,
+    -0.03, 0.95, -10,
+    1e-4, -5e-5, 1);
+
+  struct Scene
+  {
+    std::vector<Vector2d> left, right;
+    std::vector<uint8> inlier;
+  };
+
+  //!\brief Exact correspondences of which every fourth is moved off the model
+  Scene makeScene(size_t count, double noise)
+  {
+    std::mt19937 rng(8);
+    std::uniform_real_distribution<double> x(0, 640), y(0, 480), offset(40, 80), jitter(-noise, noise);
+    Scene scene;
+    scene.inlier.assign(count, 1);
+    for (size_t i = 0; i < count; ++i) {
+      const Vector2d l(x(rng), y(rng));
+      const Vector2d r = toInhomogeneous(truth * Vector3d(l.x, l.y, 1.0));
+      scene.left.push_back(l);
+      scene.right.push_back(Vector2d(r.x + jitter(rng), r.y + jitter(rng)));
+    }
+    for (size_t i = 1; i < count; i += 4) {
+      scene.right[i] = Vector2d(scene.right[i].x + offset(rng), scene.right[i].y - offset(rng));
+      scene.inlier[i] = 0;
+    }
+    return scene;
+  }
+
+  //!\brief Mean transfer error of H over the correspondences that are not outliers
+  double getInlierError(const Scene& scene, const Matrix3d& H)
+  {
+    double error = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < scene.left.size(); ++i)
+      if (scene.inlier[i]) {
+        error += std::sqrt(getReprojectionError2(H, scene.left[i], scene.right[i]));
+        ++count;
+      }
+    return error / double(count);
+  }
+
+  void testIterations()
+  {
+    CHECK(getRansacIterations(1.0, 4, 0.99, 1000) == 1);
+    CHECK(getRansacIterations(0.0, 4, 0.99, 1000) == 1000);
+    // Fewer inliers or larger samples need more iterations
+    const size_t half = getRansacIterations(0.5, 4, 0.99, 100000);
+    CHECK(half > getRansacIterations(0.8, 4, 0.99, 100000));
+    CHECK(half < getRansacIterations(0.5, 8, 0.99, 100000));
+    CHECK(half < getRansacIterations(0.5, 4, 0.999, 100000));
+
+    SplitMix64 a(7), b(7);
+    bool same = true, in_range = true;
+    for (size_t i = 0; i < 1000; ++i) {
+      same = same && a() == b();
+      in_range = in_range && a(13) < 13;
+      b();
+    }
+    CHECK(same && in_range);
+  }
+
+  void testEstimate()
+  {
+    const Scene scene = makeScene(400, 0.0);
+    RansacOptions options;
+    options.deterministic = true;
+    RansacHomography ransac(options);
+    Matrix3d H;
+    CHECK(ransac.estimate(scene.left, scene.right, H));
+    CHECK(getHomographyDifference(H, truth) < 1e-6);
+    CHECK(ransac.getInlierCount() == 300);
+    CHECK(ransac.getInliers() == scene.inlier);
+    CHECK(ransac.getIterationCount() > 0 && ransac.getIterationCount() < options.max_iterations);
+
+    // Too few correspondences for a sample
+    CHECK(!ransac.estimate(scene.left.data(), scene.right.data(), 3, H));
+    CHECK(ransac.getInlierCount() == 0);
+  }
+
+  void testDeterministic()
+  {
+    const Scene scene = makeScene(1000, 0.5);
+    Matrix3d reference = Matrix3d::Identity();
+    std::vector<uint8> inliers;
+    for (size_t threads : { 1, 2, 4, 7 }) {
+      RansacOptions options;
+      options.deterministic = true;
+      options.seed = 42;
+      options.threads = threads;
+      RansacHomography ransac(options);
+      Matrix3d H;
+      CHECK(ransac.estimate(scene.left, scene.right, H));
+      if (threads == 1) {
+        reference = H;
+        inliers = ransac.getInliers();
+        CHECK(getInlierError(scene, H) < 1.0);
+      }
+      CHECK(getDifference(H, reference) == 0);
+      CHECK(ransac.getInliers() == inliers);
+    }
+  }
+
+  void testRefine()
+  {
+    // With noise the refined model has a lower transfer error on the same inliers
+    const Scene scene = makeScene(500, 1.0);
+    RansacOptions options;
+    options.deterministic = true;
+    options.threads = 2;
+    RansacHomography plain(options);
+    options.refine = true;
+    RansacHomography refined(options);
+    Matrix3d H0, H1;
+    CHECK(plain.estimate(scene.left, scene.right, H0));
+    CHECK(refined.estimate(scene.left, scene.right, H1));
+    CHECK(refined.getInliers() == scene.inlier);
+    CHECK(getInlierError(scene, H1) <= getInlierError(scene, H0) * (1 + 1e-9));
+  }
+}
+
+int main()
+{
+  testIterations();
+  testEstimate();
+  testDeterministic();
+  testRefine();
+  return report();
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+// Camera rigs: the composed cameras against the offsets applied to the body pose by hand, and the
+// single pass projection against projecting the cloud into every camera separately.
+
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "Rig.h"
+#include "Test.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  bool isClose(double a, double b) { return std::abs(a - b) <= 1e-12 * std::max(1.0, std::abs(b)); }
+
+  //!\brief Four cameras looking forward, left, right and back, the last one without intrinsics
+  CameraRigd makeRig()
+  {
+    const Matrix3d K(600, 0, 320, 0, 600, 240, 0, 0, 1);
+    CameraRigd rig;
+    for (size_t k = 0; k < 3; ++k)
+      rig.addCamera(K * getCameraMatrix(getRotationEuler(0.0, 1.5707963 * (double(k) - 1), 0.0), Vector3d(0.1 * k, 0, 0.5)));
+    CHECK(rig.addCamera(getCameraMatrix(getRotationEuler(0.0, 3.14159265, 0.0), Vector3d(0, 0, -0.5))) == 3);
+    return rig;
+  }
+
+  void testCameras()
+  {
+    CameraRigd rig = makeRig();
+    CHECK(rig.size() == 4);
+    const Matrix3d R = getRotationEuler(0.2, -0.4, 0.1);
+    const Vector3d c(3, -2, 1);
+    const Matrix3x4d body = getCameraMatrix(R, c);
+    Matrix3x4d cameras[4];
+    rig.getCameras(body, cameras);
+
+    // Camera k maps a world point through the body and then through the offset
+    const Vector3d X(1, 2, 3);
+    const Vector3d B = body * X;
+    for (size_t k = 0; k < rig.size(); ++k)
+      CHECK(getDifference(cameras[k] * X, rig.getOffset(k) * B) < 1e-12);
+
+    rig.setOffset(3, Matrix3x4d::Identity());
+    rig.getCameras(body, cameras);
+    CHECK(getDifference(cameras[3], body) < 1e-15);
+  }
+
+  void testProjection()
+  {
+    const CameraRigd rig = makeRig();
+    const Matrix3x4d body = getCameraMatrix(getRotationEuler(0.1, 0.3, -0.2), Vector3d(1, 2, 0));
+    Matrix3x4d cameras[4];
+    rig.getCameras(body, cameras);
+
+    const size_t count = 40000;
+    std::mt19937 rng(12);
+    std::uniform_real_distribution<double> d(-30, 30);
+    std::vector<Vector3d> points(count);
+    for (Vector3d& p : points)
+      p = Vector3d(d(rng), d(rng), d(rng));
+    const Vector3View<double> view = Vector3View<double>::Interleaved(&points[0].x, count);
+
+    // Reference: every camera on its own
+    std::vector<double> u0(4 * count), v0(4 * count), depth0(4 * count);
+    std::vector<uint8> valid0(4 * count);
+    size_t visible0[4], total0 = 0;
+    for (size_t k = 0; k < 4; ++k) {
+      visible0[k] = projectPoints(cameras[k], view, &u0[k * count], &v0[k * count], &depth0[k * count], &valid0[k * count], 0.5, 1);
+      total0 += visible0[k];
+      CHECK(visible0[k] > 0);
+    }
+
+    for (size_t threads : { 1, 3 }) {
+      std::vector<double> u(4 * count), v(4 * count), depth(4 * count);
+      std::vector<uint8> valid(4 * count);
+      RigProjection<double> outputs[4];
+      for (size_t k = 0; k < 4; ++k) {
+        outputs[k].u = &u[k * count];
+        outputs[k].v = &v[k * count];
+        // The last camera only wants coordinates
+        if (k < 3) {
+          outputs[k].depth = &depth[k * count];
+          outputs[k].valid = &valid[k * count];
+        }
+      }
+      size_t visible[4];
+      CHECK(rig.projectPoints(body, view, outputs, visible, 0.5, threads) == total0);
+      // The same arithmetic, but the compiler may contract it into FMAs differently per call site
+      bool same = true;
+      for (size_t k = 0; k < 4; ++k) {
+        same = same && visible[k] == visible0[k];
+        for (size_t i = k * count; i < (k + 1) * count; ++i)
+          same = same && isClose(u[i], u0[i]) && isClose(v[i], v0[i]) && (k == 3 || (isClose(depth[i], depth0[i]) && valid[i] == valid0[i]));
+      }
+      CHECK(same);
+    }
+  }
+}
+
+int main()
+{
+  testCameras();
+  testProjection();
+  return report();
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+// Quaternion and axis-angle rotations: agreement with the rotation matrices, the conversions
+// between the representations and the batched compose, rotate and SLERP.
+
+#include "MatrixOperations.h"
+#include "Rotation.h"
+#include "Test.h"
+#include "VectorOperations.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  template <typename T>
+  double getQuaternionDifference(const Quaternion<T>& a, const Quaternion<T>& b)
+  {
+    // q and -q are the same rotation
+    const double sign = dot(a, b) < 0 ? -1 : 1;
+    return std::max(std::max(std::abs(a.w - sign * b.w), std::abs(a.x - sign * b.x)),
+      std::max(std::abs(a.y - sign * b.y), std::abs(a.z - sign * b.z)));
+  }
+
+  Quaterniond getRandomQuaternion(std::mt19937& rng)
+  {
+    std::normal_distribution<double> d;
+    return normalized(Quaterniond(d(rng), d(rng), d(rng), d(rng)));
+  }
+
+  //!\brief SLERP evaluated in long double from the angle between a and b, which is taken
+  //! from the lengths of their difference and sum to stay accurate for small angles
+  Quaterniond getReferenceSlerp(const Quaterniond& a, const Quaterniond& b, double t)
+  {
+    const long double sign = dot(a, b) < 0 ? -1 : 1;
+    const long double p[4] = { a.w, a.x, a.y, a.z }, q[4] = { sign * b.w, sign * b.x, sign * b.y, sign * b.z };
+    long double difference = 0, sum = 0;
+    for (size_t c = 0; c < 4; ++c) {
+      difference += (p[c] - q[c]) * (p[c] - q[c]);
+      sum += (p[c] + q[c]) * (p[c] + q[c]);
+    }
+    const long double angle = 2 * std::atan2(std::sqrt(difference), std::sqrt(sum));
+    if (angle == 0)
+      return a;
+    const long double s0 = std::sin((1 - t) * angle) / std::sin(angle), s1 = sign * std::sin(t * angle) / std::sin(angle);
+    return Quaterniond(double(s0 * a.w + s1 * b.w), double(s0 * a.x + s1 * b.x), double(s0 * a.y + s1 * b.y), double(s0 * a.z + s1 * b.z));
+  }
+
+  void testConversions()
+  {
+    const Matrix3d R = getRotationEuler(0.3, -1.1, 2.5);
+    const Quaterniond q = getQuaternion(R);
+    CHECK(q.w >= 0);
+    CHECK(std::abs(norm(q) - 1) < 1e-15);
+    CHECK(getDifference(getRotation(q), R) < 1e-15);
+    CHECK(getQuaternionDifference(getQuaternionEuler(0.3, -1.1, 2.5), q) < 1e-15);
+
+    const AxisAngled r = getAxisAngle(q);
+    CHECK(r.angle >= 0 && r.angle <= 3.14159265358979324);
+    CHECK(getDifference(getRotation(r), R) < 1e-14);
+    CHECK(getQuaternionDifference(getQuaternion(r), q) < 1e-15);
+    CHECK(getQuaternionDifference(getQuaternion(r.axis * r.angle), q) < 1e-15);
+    CHECK(getDifference(getRotation(getQuaternion(Vector3d(0, 0, 0))), Matrix3d::Identity()) == 0);
+
+    // Composition and rotation follow the matrices
+    const Quaterniond p = getQuaternionEuler(-0.4, 0.2, 0.9);
+    CHECK(getDifference(getRotation(p * q), getRotation(p) * R) < 1e-15);
+    const Vector3d v(1, -2, 3);
+    CHECK(getDifference(q * v, R * v) < 1e-14);
+    CHECK(getDifference(getRotation(inverse(q) * q), Matrix3d::Identity()) < 1e-15);
+    CHECK(getDifference(getRotation(conjugate(q)), transpose(R)) < 1e-15);
+
+    // Angles near pi take a different branch of Shepperd's method
+    const AxisAngled half(normalized(Vector3d(1, 2, -2)), 3.14159);
+    CHECK(getDifference(getRotation(getQuaternion(getRotation(half))), getRotation(half)) < 1e-14);
+  }
+
+  void testBatched()
+  {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const size_t count = 1000 + 7;
+    std::vector<Quaterniond> a(count), b(count), out(count);
+    std::vector<double> t(count);
+    for (size_t i = 0; i < count; ++i) {
+      a[i] = getRandomQuaternion(rng);
+      b[i] = getRandomQuaternion(rng);
+      t[i] = uniform(rng);
+    }
+    // Identical, nearly identical, opposite and nearly opposite pairs, and both ends
+    b[0] = a[0];
+    b[1] = normalized(Quaterniond(a[1].w + 1e-9, a[1].x, a[1].y, a[1].z));
+    b[2] = Quaterniond(-a[2].w, -a[2].x, -a[2].y, -a[2].z);
+    b[3] = normalized(Quaterniond(-a[3].w, -a[3].x + 1e-3, -a[3].y, -a[3].z));
+    t[4] = 0;
+    t[5] = 1;
+    t[6] = 0.5;
+
+    slerp(a.data(), b.data(), t.data(), out.data(), count);
+    double error = 0;
+    for (size_t i = 0; i < count; ++i)
+      error = std::max(error, getQuaternionDifference(out[i], getReferenceSlerp(a[i], b[i], t[i])));
+    CHECK(error < 1e-14);
+    CHECK(getQuaternionDifference(out[4], a[4]) < 1e-15 && getQuaternionDifference(out[5], b[5]) < 1e-15);
+    // The scalar form agrees where it does not fall back to a normalized lerp
+    CHECK(getQuaternionDifference(slerp(a[10], b[10], t[10]), out[10]) < 1e-14);
+
+    // Single precision, in place
+    std::vector<Quaternionf> af(count), bf(count);
+    std::vector<float> tf(count);
+    for (size_t i = 0; i < count; ++i) {
+      af[i] = Quaternionf(a[i]);
+      bf[i] = Quaternionf(b[i]);
+      tf[i] = float(t[i]);
+    }
+    slerp(af.data(), bf.data(), tf.data(), af.data(), count);
+    error = 0;
+    for (size_t i = 0; i < count; ++i)
+      error = std::max(error, getQuaternionDifference(Quaterniond(af[i]), out[i]));
+    CHECK(error < 1e-5);
+
+    compose(a.data(), b.data(), out.data(), count);
+    error = 0;
+    for (size_t i = 0; i < count; ++i)
+      error = std::max(error, getDifference(getRotation(out[i]), getRotation(a[i]) * getRotation(b[i])));
+    CHECK(error < 1e-14);
+
+    std::vector<Vector3d> points(count), rotated(count);
+    for (size_t i = 0; i < count; ++i)
+      points[i] = Vector3d(uniform(rng), uniform(rng), uniform(rng));
+    rotatePoints(a[0], points.data(), rotated.data(), count);
+    const Matrix3d R = getRotation(a[0]);
+    error = 0;
+    for (size_t i = 0; i < count; ++i)
+      error = std::max(error, getDifference(rotated[i], R * points[i]));
+    CHECK(error < 1e-14);
+  }
+}
+
+int main()
+{
+  testConversions();
+  testBatched();
+  return report();
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+// Value semantics of MatrixX and VectorX: copies, moves and swaps across the inline and heap
+// storage, resizes that keep their buffer and the alignment of heap buffers.
+
+#include "Matrix.h"
+#include "Test.h"
+#include "Vector.h"
+
+#include <utility>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  MatrixXd makeMatrix(size_t rows, size_t cols, double offset)
+  {
+    MatrixXd m(rows, cols);
+    for (size_t i = 0; i < m.size; ++i)
+      m[i] = offset + double(i);
+    return m;
+  }
+
+  bool hasValues(const MatrixXd& m, size_t rows, size_t cols, double offset)
+  {
+    bool same = m.rows == rows && m.cols == cols && m.size == rows * cols;
+    for (size_t i = 0; same && i < m.size; ++i)
+      same = m[i] == offset + double(i);
+    return same;
+  }
+
+  bool isAligned(const void* p) { return reinterpret_cast<uintptr_t>(p) % 64 == 0; }
+
+  void testInline()
+  {
+    const size_t capacity = DynamicStorage<double>::inline_capacity;
+    CHECK(capacity == 16);
+    MatrixXd empty;
+    CHECK(empty.isInline() && empty.size == 0 && empty.getCapacity() == capacity);
+
+    MatrixXd small = makeMatrix(4, 4, 1);
+    CHECK(small.isInline());
+    MatrixXd large = makeMatrix(5, 4, 100);
+    CHECK(!large.isInline() && isAligned(large.v));
+    CHECK(large.getCapacity() == 20);
+
+    // Growing past the inline elements moves to the heap, shrinking keeps the heap buffer
+    MatrixXd m(2, 2);
+    m.resize(3, 7);
+    CHECK(!m.isInline() && m.getCapacity() == 21 && isAligned(m.v));
+    const double* buffer = m.v;
+    m.resize(1, 5);
+    CHECK(m.v == buffer && m.rows == 1 && m.cols == 5 && m.size == 5);
+    m.resize(7, 3);
+    CHECK(m.v == buffer);
+  }
+
+  void testCopyMove()
+  {
+    for (size_t rows : { 2, 30 }) {
+      const MatrixXd source = makeMatrix(rows, 3, 7);
+      MatrixXd copy(source);
+      CHECK(hasValues(copy, rows, 3, 7));
+      CHECK(copy.v != source.v && copy == source);
+
+      // Assignment into a larger buffer keeps it, into a smaller one grows it
+      MatrixXd assigned = makeMatrix(40, 3, 0);
+      const double* buffer = assigned.v;
+      assigned = source;
+      CHECK(hasValues(assigned, rows, 3, 7) && assigned.v == buffer);
+      MatrixXd grown;
+      grown = source;
+      CHECK(hasValues(grown, rows, 3, 7));
+      grown = grown;
+      CHECK(hasValues(grown, rows, 3, 7));
+
+      // Moves take the heap buffer and leave the source empty
+      const double* heap = copy.isInline() ? nullptr : copy.v;
+      MatrixXd moved(std::move(copy));
+      CHECK(hasValues(moved, rows, 3, 7));
+      CHECK(copy.size == 0 && copy.rows == 0 && copy.cols == 0 && copy.isInline());
+      CHECK(!heap || moved.v == heap);
+      MatrixXd target = makeMatrix(50, 1, 0);
+      target = std::move(moved);
+      CHECK(hasValues(target, rows, 3, 7) && moved.size == 0 && moved.isInline());
+
+      // Elements of another type are converted
+      const MatrixXf single(source);
+      CHECK(single.rows == rows && single.cols == 3 && single[5] == 12.0f);
+    }
+
+    std::vector<VectorXd> vectors;
+    for (size_t n = 0; n < 40; ++n) {
+      VectorXd vector(n);
+      for (size_t i = 0; i < n; ++i)
+        vector[i] = double(i);
+      vectors.push_back(vector);
+    }
+    bool same = true;
+    for (size_t n = 0; n < 40; ++n)
+      for (size_t i = 0; i < n; ++i)
+        same = same && vectors[n].size == n && vectors[n][i] == double(i);
+    CHECK(same);
+  }
+
+  void testSwap()
+  {
+    // Every combination of inline and heap storage
+    for (size_t a : { 3, 40 })
+      for (size_t b : { 5, 60 }) {
+        MatrixXd x = makeMatrix(a, 1, 1), y = makeMatrix(1, b, 1000);
+        const double* heap_x = x.isInline() ? nullptr : x.v;
+        const double* heap_y = y.isInline() ? nullptr : y.v;
+        x.swap(y);
+        CHECK(hasValues(x, 1, b, 1000) && hasValues(y, a, 1, 1));
+        CHECK(!heap_y || x.v == heap_y);
+        CHECK(!heap_x || y.v == heap_x);
+        swap(x, y);
+        CHECK(hasValues(x, a, 1, 1) && hasValues(y, 1, b, 1000));
+        CHECK(x.isInline() == (a <= 16) && y.isInline() == (b <= 16));
+      }
+
+    VectorXd u(3), w(100);
+    u.Set(1.0);
+    w.Set(2.0);
+    u.swap(w);
+    CHECK(u.size == 100 && w.size == 3 && u[99] == 2.0 && w[2] == 1.0 && w.isInline());
+  }
+
+  void testOperators()
+  {
+    // Compound operators work in place and return the container itself
+    VectorXd v(20);
+    v.Set(3.0);
+    VectorXd& result = (v *= 2.0);
+    CHECK(&result == &v && v[19] == 6.0);
+    CHECK(v.norm2() == 20 * 36.0);
+    MatrixXd m = makeMatrix(3, 3, 0);
+    CHECK(&(m += 1.0) == &m && m[8] == 9.0);
+    CHECK(m != makeMatrix(9, 1, 1) && m == makeMatrix(3, 3, 1));
+  }
+}
+
+int main()
+{
+  testInline();
+  testCopyMove();
+  testSwap();
+  testOperators();
+  return report();
+}
\ No newline at end of file
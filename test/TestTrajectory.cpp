@@ -0,0 +1,139 @@
+// Camera trajectories: segment search, pose interpolation and the batched and rolling shutter
+// camera queries against interpolating each pose on its own.
+
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "Test.h"
+#include "Trajectory.h"
+#include "VectorOperations.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  //!\brief Irregularly sampled poses, with the sign of every third quaternion flipped
+  template <typename T>
+  Trajectory<T> makeTrajectory(size_t count)
+  {
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<double> step(0.5, 1.5), d(-0.1, 0.1);
+    Trajectory<T> trajectory;
+    trajectory.reserve(count);
+    double time = 2.0, phi = 0, theta = 0, psi = 0;
+    Vector3<T> c(0, 0, 0);
+    for (size_t i = 0; i < count; ++i) {
+      Quaternion<T> q = getQuaternionEuler(T(phi), T(theta), T(psi));
+      if (i % 3 == 0)
+        q = Quaternion<T>(-q.w, -q.x, -q.y, -q.z);
+      trajectory.add(time, q, c);
+      time += 0.01 * step(rng);
+      phi += d(rng);
+      theta += d(rng);
+      psi += d(rng);
+      c = Vector3<T>(c.x + T(d(rng)), c.y + 1, c.z + T(d(rng)));
+    }
+    return trajectory;
+  }
+
+  //!\brief Camera of the pose interpolated as a * (a^-1 b)^u through the axis and angle
+  Matrix3x4d getReferenceCamera(const Trajectory<double>& trajectory, double time)
+  {
+    double u;
+    const size_t i = trajectory.findSegment(time, u);
+    const Quaterniond a = trajectory.getOrientation(i), b = trajectory.getOrientation(i + 1);
+    const AxisAngled r = getAxisAngle(conjugate(a) * b);
+    const Quaterniond q = a * getQuaternion(AxisAngled(r.axis, r.angle * u));
+    const Vector3d c = trajectory.getPosition(i) * (1 - u) + trajectory.getPosition(i + 1) * u;
+    return getCameraMatrix(getRotation(q), c);
+  }
+
+  void testSamples()
+  {
+    const Trajectory<double> trajectory = makeTrajectory<double>(100);
+    CHECK(trajectory.size() == 100 && !trajectory.empty());
+    CHECK(trajectory.getStartTime() == 2.0);
+
+    // Stored quaternions stay on one hemisphere and the poses are reproduced at the samples
+    bool hemisphere = true;
+    double error = 0;
+    for (size_t i = 0; i < trajectory.size(); ++i) {
+      if (i > 0)
+        hemisphere = hemisphere && dot(trajectory.getOrientation(i - 1), trajectory.getOrientation(i)) > 0;
+      double fraction;
+      const size_t segment = trajectory.findSegment(2.0 + 0.01 * i, fraction);
+      CHECK(segment < trajectory.size() - 1 && fraction >= 0 && fraction <= 1);
+    }
+    CHECK(hemisphere);
+
+    Trajectory<double> copy;
+    for (size_t i = 0; i < trajectory.size(); ++i)
+      copy.add(double(i), getCameraMatrix(getRotation(trajectory.getOrientation(i)), trajectory.getPosition(i)));
+    for (size_t i = 0; i < trajectory.size(); ++i)
+      error = std::max(error, getDifference(copy.getCamera(double(i)), getCameraMatrix(getRotation(trajectory.getOrientation(i)), trajectory.getPosition(i))));
+    CHECK(error < 1e-12);
+
+    // Hints before, at and after the segment give the same answer
+    double fraction0, fraction1;
+    const double time = 50.25;
+    const size_t segment = copy.findSegment(time, fraction0);
+    CHECK(segment == 50 && std::abs(fraction0 - 0.25) < 1e-12);
+    for (size_t hint : { size_t(0), segment - 1, segment, segment + 1, copy.size() - 1 }) {
+      CHECK(copy.findSegment(time, fraction1, hint) == segment);
+      CHECK(fraction1 == fraction0);
+    }
+
+    // Queries outside the samples clamp
+    CHECK(getDifference(copy.getCamera(-5.0), copy.getCamera(0.0)) == 0);
+    CHECK(getDifference(copy.getCamera(1e6), copy.getCamera(double(copy.size() - 1))) == 0);
+  }
+
+  void testQueries()
+  {
+    const Trajectory<double> trajectory = makeTrajectory<double>(500);
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> uniform(trajectory.getStartTime() - 0.1, trajectory.getEndTime() + 0.1);
+    const size_t count = 3000;
+    std::vector<double> times(count);
+    for (double& time : times)
+      time = uniform(rng);
+    std::vector<double> sorted = times;
+    std::sort(sorted.begin(), sorted.end());
+
+    for (size_t threads : { 1, 4 })
+      for (const std::vector<double>* query : { &times, &sorted }) {
+        std::vector<Matrix3x4d> cameras(count);
+        trajectory.getCameras(query->data(), count, cameras.data(), threads);
+        double error = 0;
+        for (size_t i = 0; i < count; ++i)
+          error = std::max(error, getDifference(cameras[i], getReferenceCamera(trajectory, (*query)[i])));
+        // Relative to positions of up to 500
+        CHECK(error < 1e-10);
+      }
+
+    const size_t rows = 1080;
+    const double start = trajectory.getStartTime() + 1.0, delay = 3e-5;
+    std::vector<Matrix3x4d> cameras(rows);
+    trajectory.getRollingShutterCameras(start, delay, rows, cameras.data(), 3);
+    double error = 0;
+    for (size_t r = 0; r < rows; ++r)
+      error = std::max(error, getDifference(cameras[r], trajectory.getCamera(start + r * delay)));
+    CHECK(error == 0);
+
+    // Single precision
+    const Trajectory<float> single = makeTrajectory<float>(500);
+    const Matrix3x4f camera = single.getCamera(start);
+    const Matrix3x4d reference = getReferenceCamera(trajectory, start);
+    CHECK(getDifference(&camera[0], &reference[0], 12) < 1e-2);
+  }
+}
+
+int main()
+{
+  testSamples();
+  testQueries();
+  return report();
+}
\ No newline at end of file
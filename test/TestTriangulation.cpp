@@ -0,0 +1,140 @@
+// Multi-view triangulation: both linear methods, the refinement and the error threshold, tracks
+// with and without camera indices, and the parallel batch against single tracks.
+
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "Test.h"
+#include "Triangulation.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  const size_t camera_count = 4;
+
+  struct Scene
+  {
+    Matrix3x4d cameras[camera_count];
+    std::vector<Vector3d> truth;
+  };
+
+  Scene makeScene(size_t count)
+  {
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<double> d(-3, 3);
+    Scene scene;
+    for (size_t k = 0; k < camera_count; ++k)
+      scene.cameras[k] = getCameraMatrix(getRotationEuler(0.05 * k, -0.03 * k, 0.02 * k), Vector3d(double(k), 0.2 * k, 0));
+    for (size_t t = 0; t < count; ++t)
+      scene.truth.push_back(Vector3d(d(rng), d(rng), 10 + d(rng)));
+    return scene;
+  }
+
+  double getError(const std::vector<Vector3d>& points, const std::vector<Vector3d>& truth)
+  {
+    double error = 0;
+    for (size_t t = 0; t < points.size(); ++t)
+      error = std::max(error, getDifference(points[t], truth[t]));
+    return error;
+  }
+
+  void testAllViews()
+  {
+    // Every track seen by all cameras in order, without camera indices
+    const size_t count = 100;
+    const Scene scene = makeScene(count);
+    std::vector<Vector2d> measurements;
+    std::vector<uint32> offsets(1, 0);
+    for (size_t t = 0; t < count; ++t) {
+      for (size_t k = 0; k < camera_count; ++k)
+        measurements.push_back(toInhomogeneous(scene.cameras[k] * scene.truth[t]));
+      offsets.push_back(uint32(measurements.size()));
+    }
+    std::vector<Vector3d> points(count);
+    std::vector<uint8> valid(count);
+    CHECK(triangulatePoints(scene.cameras, (const uint32*)nullptr, measurements.data(), offsets.data(), count, points.data(), valid.data()) == count);
+    CHECK(getError(points, scene.truth) < 1e-8);
+    CHECK(valid == std::vector<uint8>(count, 1));
+
+    Vector3d X;
+    CHECK(triangulateMidpoint(scene.cameras, (const uint32*)nullptr, measurements.data(), camera_count, X));
+    CHECK(getDifference(X, scene.truth[0]) < 1e-8);
+    CHECK(!triangulateDLT(scene.cameras, (const uint32*)nullptr, measurements.data(), 1, X));
+  }
+
+  void testIndexedTracks()
+  {
+    // Tracks of two to four views of varying cameras, refined and checked against a threshold
+    const size_t count = 10000;
+    const Scene scene = makeScene(count);
+    std::vector<uint32> indices, offsets(1, 0);
+    std::vector<Vector2d> measurements;
+    for (size_t t = 0; t < count; ++t) {
+      const size_t views = 2 + t % 3;
+      for (size_t v = 0; v < views; ++v) {
+        const uint32 k = uint32((t + v) % camera_count);
+        indices.push_back(k);
+        measurements.push_back(toInhomogeneous(scene.cameras[k] * scene.truth[t]));
+      }
+      offsets.push_back(uint32(measurements.size()));
+    }
+    // One track is moved off its point, it fails the threshold
+    measurements[offsets[17]] = measurements[offsets[17]] + Vector2d(0.01, 0);
+
+    for (TriangulationMethod method : { TriangulationMethod::DLT, TriangulationMethod::Midpoint })
+      for (size_t threads : { 1, 4 }) {
+        TriangulationOptions options;
+        options.method = method;
+        options.refine_iterations = 2;
+        options.max_error = 1e-6;
+        options.threads = threads;
+        std::vector<Vector3d> points(count);
+        std::vector<uint8> valid(count);
+        CHECK(triangulatePoints(scene.cameras, indices.data(), measurements.data(), offsets.data(), count, points.data(), valid.data(), options) == count - 1);
+        CHECK(!valid[17]);
+        points[17] = scene.truth[17];
+        CHECK(getError(points, scene.truth) < 1e-8);
+
+        // The batch agrees with triangulating a single track
+        Vector3d X;
+        CHECK(triangulatePoint(scene.cameras, &indices[offsets[5]], &measurements[offsets[5]], offsets[6] - offsets[5], X, options));
+        CHECK(getDifference(X, points[5]) == 0);
+      }
+  }
+
+  void testRefinement()
+  {
+    // With noisy measurements the refinement lowers the reprojection error of the linear solution
+    const Scene scene = makeScene(1);
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> noise(-1e-3, 1e-3);
+    Vector2d measurements[camera_count];
+    for (size_t k = 0; k < camera_count; ++k)
+      measurements[k] = toInhomogeneous(scene.cameras[k] * scene.truth[0]) + Vector2d(noise(rng), noise(rng));
+    Vector3d linear, refined;
+    CHECK(triangulateDLT(scene.cameras, (const uint32*)nullptr, measurements, camera_count, linear));
+    refined = linear;
+    const double before = refineTriangulation(scene.cameras, (const uint32*)nullptr, measurements, camera_count, linear, 0);
+    const double after = refineTriangulation(scene.cameras, (const uint32*)nullptr, measurements, camera_count, refined, 3);
+    CHECK(after <= before);
+
+    // A point behind the cameras is rejected
+    TriangulationOptions options;
+    for (size_t k = 0; k < camera_count; ++k)
+      measurements[k] = toInhomogeneous(scene.cameras[k] * Vector3d(0, 0, -10.0));
+    Vector3d X;
+    CHECK(!triangulatePoint(scene.cameras, (const uint32*)nullptr, measurements, camera_count, X, options));
+  }
+}
+
+int main()
+{
+  testAllViews();
+  testIndexedTracks();
+  testRefinement();
+  return report();
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+// Visibility queries: frustum culling through the BVH against testing every primitive, for points,
+// triangles and boxes, after parallel builds and after refits of moved primitives.
+
+#include "Camera.h"
+#include "MatrixOperations.h"
+#include "Test.h"
+#include "Visibility.h"
+
+#include <random>
+#include <vector>
+
+using namespace dry;
+using namespace dry::test;
+
+namespace
+{
+  Frustum<float> getTestFrustum()
+  {
+    const Matrix3x4f camera = Matrix3f(800, 0, 640, 0, 800, 360, 0, 0, 1) *
+      getCameraMatrix(getRotationEuler(0.3f, 1.2f, 0.1f), Vector3f(-60, -70, 10));
+    return getFrustum(camera, 1280.0f, 720.0f, 0.5f, 80.0f);
+  }
+
+  //!\brief Whether the nodes form a valid hierarchy: children within their parent, leaves
+  //! bounding their primitives and every primitive listed once
+  bool isValid(const Bvhf& bvh, const std::vector<BoundingBoxf>& boxes)
+  {
+    const std::vector<Bvhf::Node>& nodes = bvh.getNodes();
+    std::vector<uint32> indices = bvh.getIndices();
+    bool valid = indices.size() == boxes.size() && nodes[0].first == 0 && nodes[0].count == boxes.size();
+    for (size_t n = 0; n < nodes.size(); ++n) {
+      const Bvhf::Node& node = nodes[n];
+      if (node.right) {
+        const Bvhf::Node& left = nodes[n + 1];
+        const Bvhf::Node& right = nodes[node.right];
+        valid = valid && left.first == node.first && right.first == left.first + left.count && left.count + right.count == node.count;
+        valid = valid && node.bounds.contains(left.bounds.min) && node.bounds.contains(left.bounds.max);
+        valid = valid && node.bounds.contains(right.bounds.min) && node.bounds.contains(right.bounds.max);
+      }
+      else {
+        valid = valid && node.count <= bvh.options.leaf_size;
+        for (size_t i = node.first; i < node.first + node.count; ++i)
+          valid = valid && node.bounds.contains(boxes[indices[i]].min) && node.bounds.contains(boxes[indices[i]].max);
+      }
+    }
+    std::sort(indices.begin(), indices.end());
+    for (size_t i = 0; i < indices.size(); ++i)
+      valid = valid && indices[i] == i;
+    return valid;
+  }
+
+  void testPoints()
+  {
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> d(-100, 100);
+    const Frustum<float> frustum = getTestFrustum();
+    const size_t count = 20000;
+    std::vector<Vector3f> points(count);
+    for (size_t i = 0; i < count; ++i)
+      points[i] = Vector3f(d(rng), d(rng), d(rng) / 5);
+
+    for (size_t threads : { 1, 4 }) {
+      std::vector<Vector3f> moved = points;
+      BvhOptions options;
+      options.threads = threads;
+      Bvhf bvh(options);
+      bvh.build(moved.data(), count);
+      for (int pass = 0; pass < 2; ++pass) {
+        std::vector<BoundingBoxf> boxes(count);
+        std::vector<uint32> expected, visible, nodes;
+        for (size_t i = 0; i < count; ++i) {
+          boxes[i] = BoundingBoxf(moved[i], moved[i]);
+          if (frustum.contains(moved[i]))
+            expected.push_back(uint32(i));
+        }
+        CHECK(isValid(bvh, boxes));
+        CHECK(!expected.empty() && expected.size() < count);
+        CHECK(bvh.getVisiblePoints(frustum, moved.data(), visible) == expected.size());
+        std::sort(visible.begin(), visible.end());
+        CHECK(visible == expected);
+
+        // Subtrees reported as inside hold only visible points
+        std::vector<uint8> inside;
+        CHECK(bvh.getVisibleNodes(frustum, nodes, &inside) >= expected.size());
+        CHECK(inside.size() == nodes.size());
+        bool contained = true;
+        for (size_t k = 0; k < nodes.size(); ++k) {
+          const Bvhf::Node& node = bvh.getNodes()[nodes[k]];
+          CHECK(frustum.classify(node.bounds) != Containment::Outside);
+          for (size_t i = node.first; inside[k] && i < node.first + node.count; ++i)
+            contained = contained && frustum.contains(moved[bvh.getIndices()[i]]);
+        }
+        CHECK(contained);
+
+        // Move the points and refit instead of rebuilding
+        for (size_t i = 0; i < count; ++i)
+          moved[i] = Vector3f(moved[i].x + 10, moved[i].y - 5, moved[i].z);
+        bvh.refit(moved.data());
+      }
+    }
+  }
+
+  void testTriangles()
+  {
+    // A grid of small triangles, and the same triangles as boxes
+    std::mt19937 rng(10);
+    std::uniform_real_distribution<float> d(-100, 100), e(-1, 1);
+    const size_t count = 5000;
+    std::vector<Vector3f> vertices;
+    std::vector<uint32> triangles;
+    std::vector<BoundingBoxf> boxes(count);
+    for (size_t t = 0; t < count; ++t) {
+      const Vector3f center(d(rng), d(rng), d(rng) / 5);
+      for (size_t k = 0; k < 3; ++k) {
+        triangles.push_back(uint32(vertices.size()));
+        vertices.push_back(Vector3f(center.x + e(rng), center.y + e(rng), center.z + e(rng)));
+        boxes[t].extend(vertices.back());
+      }
+    }
+
+    const Frustum<float> frustum = getTestFrustum();
+    Bvhf from_triangles, from_boxes;
+    from_triangles.build(vertices.data(), triangles.data(), count);
+    from_boxes.build(boxes.data(), count);
+    CHECK(isValid(from_triangles, boxes));
+    CHECK(isValid(from_boxes, boxes));
+    CHECK(from_triangles.getIndices() == from_boxes.getIndices());
+
+    // Every triangle that is partly visible lies below a reported node
+    std::vector<uint32> nodes;
+    from_triangles.getVisibleNodes(frustum, nodes);
+    std::vector<uint8> covered(count);
+    for (uint32 n : nodes) {
+      const Bvhf::Node& node = from_triangles.getNodes()[n];
+      for (size_t i = node.first; i < node.first + node.count; ++i)
+        covered[from_triangles.getIndices()[i]] = 1;
+    }
+    bool complete = true;
+    for (size_t t = 0; t < count; ++t)
+      for (size_t k = 0; k < 3; ++k)
+        complete = complete && (covered[t] || !frustum.contains(vertices[triangles[3 * t + k]]));
+    CHECK(complete);
+
+    for (Vector3f& v : vertices)
+      v = Vector3f(v.x, v.y, v.z + 3);
+    from_triangles.refit(vertices.data(), triangles.data());
+    for (BoundingBoxf& box : boxes)
+      box = BoundingBoxf(Vector3f(box.min.x, box.min.y, box.min.z + 3), Vector3f(box.max.x, box.max.y, box.max.z + 3));
+    CHECK(isValid(from_triangles, boxes));
+  }
+}
+
+int main()
+{
+  testPoints();
+  testTriangles();
+  return report();
+}
\ No newline at end of file